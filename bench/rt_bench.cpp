@@ -0,0 +1,518 @@
+// rt_bench: repeatable performance measurements for the regression gate.
+// For every scene (and replicated, larger variants of it) this measures scene parsing,
+// BVH construction, CPU primary-ray throughput and headless GPU render time, then
+// writes median/p95 statistics as JSON. Procedural scenes (--generate) give scaling curves
+// at arbitrary primitive counts.
+#include "parser.h"
+#include "scene_generator.h"
+#include "gpu_raytracer.h"
+#include "parallel.h"
+#include "error_handling.h"
+#include "sampler.h"
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    struct BenchConfig {
+        std::vector<std::string> scene_files;
+        std::vector<SceneGenerator::Options> generated;  // --generate entries, measured at scale 1
+        std::string examples_dir = "examples";
+        std::vector<int> scales = {1, 4, 16};  // Copies of the scene geometry per variant
+        int warmup_runs = 2;
+        int measured_runs = 7;
+        int width = 320;
+        int height = 180;
+        int samples = 4;                       // Samples per pixel for the GPU render
+        int max_depth = 8;
+        int light_samples = 1;                 // Light tree samples per shading point
+        Sampling::Type sampler = Sampling::Type::SOBOL;
+        bool run_gpu = true;
+        std::string output_file;               // Empty = stdout
+    };
+
+    struct Summary {
+        double median = 0.0;
+        double p95 = 0.0;
+        double min = 0.0;
+        double mean = 0.0;
+    };
+
+    Summary summarize(std::vector<double> values) {
+        Summary summary;
+        if (values.empty()) return summary;
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        summary.median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+        // Nearest-rank percentile
+        const size_t p95_rank = static_cast<size_t>(std::ceil(0.95 * n));
+        summary.p95 = values[std::max<size_t>(p95_rank, 1) - 1];
+        summary.min = values.front();
+        double sum = 0.0;
+        for (double v : values) sum += v;
+        summary.mean = sum / n;
+        return summary;
+    }
+
+    // Runs body warmup + measured times and returns the measured durations in milliseconds
+    std::vector<double> time_runs(const BenchConfig& config, const std::function<void()>& body) {
+        std::vector<double> times;
+        for (int run = 0; run < config.warmup_runs + config.measured_runs; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            if (run >= config.warmup_runs) {
+                times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+        }
+        return times;
+    }
+
+    std::shared_ptr<Geometry> translated_copy(Scene& scene, const std::shared_ptr<Geometry>& geometry, const Vec3& offset) {
+        if (auto sphere = std::dynamic_pointer_cast<Sphere>(geometry)) {
+            return scene.make_object<Sphere>(sphere->center + offset, sphere->radius, sphere->material_id);
+        }
+        if (auto triangle = std::dynamic_pointer_cast<Triangle>(geometry)) {
+            return scene.make_object<Triangle>(triangle->v0 + offset, triangle->v1 + offset, triangle->v2 + offset,
+                                               triangle->material_id);
+        }
+        if (auto cylinder = std::dynamic_pointer_cast<Cylinder>(geometry)) {
+            return scene.make_object<Cylinder>(cylinder->base_center + offset, cylinder->axis, cylinder->radius,
+                                               cylinder->height, cylinder->material_id);
+        }
+        return nullptr;  // Planes are unbounded; one copy is enough
+    }
+
+    // Tiles the scene's bounded geometry on a square grid in the XZ plane so the variant
+    // has roughly `copies` times the primitives, and pulls the camera back to keep it in view
+    void replicate_scene(Scene& scene, int copies) {
+        if (copies <= 1) return;
+
+        Vec3 min_bounds(std::numeric_limits<float>::max());
+        Vec3 max_bounds(std::numeric_limits<float>::lowest());
+        std::vector<std::shared_ptr<Geometry>> bounded;
+        for (const auto& object : scene.objects) {
+            if (std::dynamic_pointer_cast<Plane>(object)) continue;
+            bounded.push_back(object);
+            const Vec3 lo = object->get_min_bounds();
+            const Vec3 hi = object->get_max_bounds();
+            min_bounds = Vec3(std::min(min_bounds.x, lo.x), std::min(min_bounds.y, lo.y), std::min(min_bounds.z, lo.z));
+            max_bounds = Vec3(std::max(max_bounds.x, hi.x), std::max(max_bounds.y, hi.y), std::max(max_bounds.z, hi.z));
+        }
+        if (bounded.empty()) return;
+
+        const int grid = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(copies))));
+        const Vec3 extent = max_bounds - min_bounds;
+        const float spacing_x = extent.x * 1.1f + 1e-3f;
+        const float spacing_z = extent.z * 1.1f + 1e-3f;
+
+        for (int copy = 1; copy < copies; ++copy) {
+            const Vec3 offset((copy % grid) * spacing_x, 0.0f, (copy / grid) * spacing_z);
+            for (const auto& object : bounded) {
+                if (auto moved = translated_copy(scene, object, offset)) {
+                    scene.objects.push_back(moved);
+                }
+            }
+        }
+
+        // Look at the middle of the grid from further away
+        const Vec3 center_shift((grid - 1) * spacing_x * 0.5f, 0.0f, (grid - 1) * spacing_z * 0.5f);
+        Camera& camera = scene.camera;
+        const Vec3 view = camera.position - camera.target;
+        camera.target = camera.target + center_shift;
+        camera.position = camera.target + view * static_cast<float>(grid);
+        camera.update_camera();
+    }
+
+    struct SceneResult {
+        std::string name;
+        int scale = 1;
+        size_t primitives = 0;
+        bool generated = false;    // parse_ms then holds SceneGenerator::generate time
+        Summary parse_ms;
+        Summary bvh_build_ms;
+        size_t cpu_rays = 0;
+        double cpu_hit_fraction = 0.0;
+        Summary cpu_mrays_per_sec;
+        bool gpu_measured = false;
+        Summary gpu_render_ms;     // Wall clock: submission to completion
+        Summary gpu_trace_ms;      // Compute dispatch time from timer queries
+    };
+
+    // Primary rays jittered by the first pixel sample of the configured sampler, the same
+    // offsets the shader uses, so every run traces the same rays
+    std::vector<Ray> generate_primary_rays(const Camera& camera, int width, int height, Sampling::Type sampler_type) {
+        std::vector<Ray> rays;
+        rays.reserve(static_cast<size_t>(width) * height);
+        Sampler sampler(sampler_type);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                float jitter_x, jitter_y;
+                sampler.start_pixel_sample(x, y, 0);
+                sampler.get_2d(0, jitter_x, jitter_y);
+                const float u = (x + jitter_x) / width;
+                const float v = (y + jitter_y) / height;
+                const Vec3 direction = camera.lower_left_corner + camera.horizontal * u + camera.vertical * v - camera.position;
+                rays.emplace_back(camera.position, direction.normalize());
+            }
+        }
+        return rays;
+    }
+
+    void bench_cpu(const BenchConfig& config, Scene& scene, SceneResult& result) {
+        // BVH construction reorders the object list, so each run starts from the same copy
+        const std::vector<std::shared_ptr<Geometry>> objects = scene.objects;
+        result.bvh_build_ms = summarize(time_runs(config, [&]() {
+            std::vector<std::shared_ptr<Geometry>> working = objects;
+            BVH bvh(working);
+        }));
+        scene.build_acceleration_structure();
+
+        const std::vector<Ray> rays = generate_primary_rays(scene.camera, config.width, config.height, config.sampler);
+        result.cpu_rays = rays.size();
+
+        const int band_count = std::max(1, Parallel::thread_count() * 4);
+        const size_t band_size = (rays.size() + band_count - 1) / band_count;
+        std::vector<size_t> band_hits(band_count);
+
+        std::vector<double> times = time_runs(config, [&]() {
+            Parallel::parallel_for(band_count, [&](int band) {
+                size_t hits = 0;
+                const size_t end = std::min(rays.size(), (band + 1) * band_size);
+                for (size_t i = band * band_size; i < end; ++i) {
+                    HitRecord rec;
+                    if (scene.hit(rays[i], Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec)) hits++;
+                }
+                band_hits[band] = hits;
+            });
+        });
+
+        size_t hits = 0;
+        for (size_t h : band_hits) hits += h;
+        result.cpu_hit_fraction = rays.empty() ? 0.0 : static_cast<double>(hits) / rays.size();
+
+        std::vector<double> throughput;
+        for (double ms : times) {
+            throughput.push_back(ms > 0.0 ? rays.size() / (ms * 1000.0) : 0.0);
+        }
+        result.cpu_mrays_per_sec = summarize(throughput);
+    }
+
+    void bench_gpu(const BenchConfig& config, const Scene& scene, SceneResult& result) {
+        GPURayTracer tracer(config.width, config.height);
+        if (!tracer.initialize()) {
+            ErrorHandling::Logger::warning("GPU ray tracer failed to initialize, skipping GPU timing");
+            return;
+        }
+        tracer.set_light_samples(config.light_samples);
+        tracer.set_sampler(config.sampler);
+        tracer.load_scene(scene);
+
+        // Progressive passes up to the sample target, like headless rendering
+        std::vector<double> trace_times;
+        std::vector<double> render_times = time_runs(config, [&]() {
+            tracer.reset_accumulation_buffer();
+            const double trace_before = tracer.gpu_total_ms(GPUStage::Dispatch);
+            int accumulated = 0;
+            while (accumulated < config.samples) {
+                const int requested = config.samples - accumulated;
+                tracer.render(scene.camera, requested, config.max_depth);
+                accumulated = tracer.accumulated_samples();
+                tracer.wait_for_frames(1);
+            }
+            tracer.wait_for_frames(0);
+            tracer.collect_gpu_timers(true);
+            trace_times.push_back(tracer.gpu_total_ms(GPUStage::Dispatch) - trace_before);
+        });
+
+        trace_times.erase(trace_times.begin(), trace_times.begin() + config.warmup_runs);
+        result.gpu_measured = true;
+        result.gpu_render_ms = summarize(render_times);
+        result.gpu_trace_ms = summarize(trace_times);
+    }
+
+    void write_summary(std::ostream& out, const char* key, const Summary& s) {
+        out << "\"" << key << "\": {\"median\": " << s.median << ", \"p95\": " << s.p95
+            << ", \"min\": " << s.min << ", \"mean\": " << s.mean << "}";
+    }
+
+    std::string json_escape(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') out.push_back('\\');
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    void write_json(std::ostream& out, const BenchConfig& config, const std::vector<SceneResult>& results) {
+        out << std::fixed;
+        out.precision(4);
+        out << "{\n";
+        out << "  \"benchmark\": \"rt_bench\",\n";
+        out << "  \"threads\": " << Parallel::thread_count() << ",\n";
+        out << "  \"config\": {\"width\": " << config.width << ", \"height\": " << config.height
+            << ", \"samples\": " << config.samples << ", \"max_depth\": " << config.max_depth
+            << ", \"light_samples\": " << config.light_samples
+            << ", \"sampler\": \"" << Sampling::type_to_string(config.sampler) << "\""
+            << ", \"warmup_runs\": " << config.warmup_runs << ", \"measured_runs\": " << config.measured_runs << "},\n";
+        out << "  \"scenes\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SceneResult& r = results[i];
+            out << (i ? ",\n" : "\n") << "    {";
+            out << "\"name\": \"" << json_escape(r.name) << "\", \"scale\": " << r.scale
+                << ", \"primitives\": " << r.primitives << ",\n      ";
+            write_summary(out, r.generated ? "generate_ms" : "parse_ms", r.parse_ms);
+            out << ",\n      ";
+            write_summary(out, "bvh_build_ms", r.bvh_build_ms);
+            out << ",\n      \"cpu_trace\": {\"rays\": " << r.cpu_rays << ", \"hit_fraction\": " << r.cpu_hit_fraction << ", ";
+            write_summary(out, "mrays_per_sec", r.cpu_mrays_per_sec);
+            out << "},\n      ";
+            if (r.gpu_measured) {
+                out << "\"gpu_render\": {";
+                write_summary(out, "wall_ms", r.gpu_render_ms);
+                out << ", ";
+                write_summary(out, "trace_ms", r.gpu_trace_ms);
+                out << "}";
+            } else {
+                out << "\"gpu_render\": null";
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    std::vector<int> parse_int_list(const std::string& text) {
+        std::vector<int> values;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            const int value = std::stoi(item);
+            if (value <= 0) throw std::invalid_argument("List values must be positive: " + text);
+            values.push_back(value);
+        }
+        return values;
+    }
+
+    // "pattern:count[,pattern:count...]", e.g. "sphere_field:10k,mesh:1M"
+    std::vector<SceneGenerator::Options> parse_generate_list(const std::string& text) {
+        std::vector<SceneGenerator::Options> entries;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            const size_t colon = item.find(':');
+            SceneGenerator::Options options;
+            if (colon == std::string::npos ||
+                !SceneGenerator::parse_pattern(item.substr(0, colon), options.pattern) ||
+                !SceneGenerator::parse_count(item.substr(colon + 1), options.primitive_count)) {
+                throw std::invalid_argument("Invalid --generate entry (expected pattern:count): " + item);
+            }
+            entries.push_back(options);
+        }
+        return entries;
+    }
+
+    void print_usage(const char* program) {
+        std::cout << "Usage: " << program << " [options] [scene files...]\n";
+        std::cout << "Benchmarks scene parsing, BVH build, CPU tracing and GPU rendering; prints JSON.\n";
+        std::cout << "Options:\n";
+        std::cout << "  --examples <dir>     Scene directory used when no files are given (default: examples)\n";
+        std::cout << "  --scales <list>      Geometry copies per variant, comma separated (default: 1,4,16)\n";
+        std::cout << "  --generate <list>    Add procedural scenes: pattern:count, comma separated\n";
+        std::cout << "                       (sphere_field, mesh, instanced_grid; counts like 10k or 1M)\n";
+        std::cout << "  --warmup <int>       Unmeasured runs before timing (default: 2)\n";
+        std::cout << "  --runs <int>         Measured runs (default: 7)\n";
+        std::cout << "  -w, --width <int>    Trace/render width (default: 320)\n";
+        std::cout << "  -h, --height <int>   Trace/render height (default: 180)\n";
+        std::cout << "  -s, --samples <int>  GPU samples per pixel (default: 4)\n";
+        std::cout << "  -d, --depth <int>    GPU maximum ray depth (default: 8)\n";
+        std::cout << "  --light-samples <int> GPU light tree samples per shading point (default: 1)\n";
+        std::cout << "  --sampler <name>     Pixel jitter and GPU sampler: sobol, blue-noise or random (default: sobol)\n";
+        std::cout << "  --no-gpu             Skip the GPU render measurement\n";
+        std::cout << "  -o, --output <file>  Write JSON to a file instead of stdout\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else if (arg == "--examples" && i + 1 < argc) {
+                config.examples_dir = argv[++i];
+            } else if (arg == "--scales" && i + 1 < argc) {
+                config.scales = parse_int_list(argv[++i]);
+            } else if (arg == "--generate" && i + 1 < argc) {
+                const auto entries = parse_generate_list(argv[++i]);
+                config.generated.insert(config.generated.end(), entries.begin(), entries.end());
+            } else if (arg == "--warmup" && i + 1 < argc) {
+                config.warmup_runs = std::stoi(argv[++i]);
+                if (config.warmup_runs < 0) throw std::invalid_argument("Warmup runs must not be negative");
+            } else if (arg == "--runs" && i + 1 < argc) {
+                config.measured_runs = std::stoi(argv[++i]);
+                if (config.measured_runs <= 0) throw std::invalid_argument("Measured runs must be positive");
+            } else if ((arg == "-w" || arg == "--width") && i + 1 < argc) {
+                config.width = std::stoi(argv[++i]);
+                if (config.width <= 0) throw std::invalid_argument("Width must be positive");
+            } else if ((arg == "-h" || arg == "--height") && i + 1 < argc) {
+                config.height = std::stoi(argv[++i]);
+                if (config.height <= 0) throw std::invalid_argument("Height must be positive");
+            } else if ((arg == "-s" || arg == "--samples") && i + 1 < argc) {
+                config.samples = std::stoi(argv[++i]);
+                if (config.samples <= 0) throw std::invalid_argument("Samples must be positive");
+            } else if ((arg == "-d" || arg == "--depth") && i + 1 < argc) {
+                config.max_depth = std::stoi(argv[++i]);
+                if (config.max_depth <= 0) throw std::invalid_argument("Max depth must be positive");
+            } else if (arg == "--light-samples" && i + 1 < argc) {
+                config.light_samples = std::stoi(argv[++i]);
+                if (config.light_samples <= 0) throw std::invalid_argument("Light samples must be positive");
+            } else if (arg == "--sampler" && i + 1 < argc) {
+                if (!Sampling::parse_type(argv[++i], config.sampler)) {
+                    throw std::invalid_argument("Unknown sampler (expected sobol, blue-noise or random)");
+                }
+            } else if (arg == "--no-gpu") {
+                config.run_gpu = false;
+            } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+                config.output_file = argv[++i];
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw std::invalid_argument("Unknown option: " + arg);
+            } else {
+                config.scene_files.push_back(arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (config.scene_files.empty() && config.generated.empty()) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(config.examples_dir, ec)) {
+            if (entry.path().extension() == ".scene") {
+                config.scene_files.push_back(entry.path().string());
+            }
+        }
+        std::sort(config.scene_files.begin(), config.scene_files.end());
+        if (config.scene_files.empty()) {
+            std::cerr << "No .scene files found in " << config.examples_dir << std::endl;
+            return 1;
+        }
+    }
+
+    // Offscreen GL context shared by every GPU measurement
+    GLFWwindow* context_window = nullptr;
+    if (config.run_gpu) {
+        if (glfwInit()) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+            context_window = glfwCreateWindow(config.width, config.height, "rt_bench", nullptr, nullptr);
+        }
+        if (context_window) {
+            glfwMakeContextCurrent(context_window);
+        } else {
+            std::cerr << "Warning: no OpenGL 4.3 context available, skipping GPU measurements" << std::endl;
+            config.run_gpu = false;
+        }
+    }
+
+    // Per-run parse logging would swamp the results
+    ErrorHandling::Logger::set_level(ErrorHandling::LogLevel::WARNING);
+
+    std::vector<SceneResult> results;
+    for (const std::string& file : config.scene_files) {
+        const std::string name = std::filesystem::path(file).stem().string();
+
+        bool parsed = true;
+        std::vector<double> parse_times = time_runs(config, [&]() {
+            Scene parsed_scene;
+            parsed = Parser::parse_scene_file(file, parsed_scene) && parsed;
+        });
+        if (!parsed) {
+            std::cerr << "Warning: failed to parse " << file << ", skipping" << std::endl;
+            continue;
+        }
+        const Summary parse_summary = summarize(parse_times);
+
+        for (int scale : config.scales) {
+            std::cerr << "Benchmarking " << name << " x" << scale << "..." << std::endl;
+
+            Scene variant;
+            Parser::parse_scene_file(file, variant);
+            replicate_scene(variant, scale);
+
+            SceneResult result;
+            result.name = name;
+            result.scale = scale;
+            result.primitives = variant.objects.size();
+            result.parse_ms = parse_summary;  // Parsing is measured on the original file only
+
+            bench_cpu(config, variant, result);
+            if (config.run_gpu) {
+                bench_gpu(config, variant, result);
+            }
+            results.push_back(result);
+        }
+    }
+
+    for (SceneGenerator::Options options : config.generated) {
+        options.aspect_ratio = static_cast<float>(config.width) / config.height;
+        const std::string name = std::string(SceneGenerator::pattern_to_string(options.pattern)) + "_" +
+                                 std::to_string(options.primitive_count);
+        std::cerr << "Benchmarking " << name << "..." << std::endl;
+
+        SceneResult result;
+        result.name = name;
+        result.generated = true;
+        result.parse_ms = summarize(time_runs(config, [&]() {
+            Scene generated_scene;
+            SceneGenerator::generate(options, generated_scene);
+        }));
+
+        Scene scene;
+        if (!SceneGenerator::generate(options, scene)) {
+            std::cerr << "Warning: failed to generate " << name << ", skipping" << std::endl;
+            continue;
+        }
+        result.primitives = scene.objects.size();
+
+        bench_cpu(config, scene, result);
+        if (config.run_gpu) {
+            bench_gpu(config, scene, result);
+        }
+        results.push_back(result);
+    }
+
+    if (context_window) {
+        glfwDestroyWindow(context_window);
+        glfwTerminate();
+    }
+
+    if (config.output_file.empty()) {
+        write_json(std::cout, config, results);
+    } else {
+        std::ofstream out(config.output_file);
+        if (!out) {
+            std::cerr << "Failed to open " << config.output_file << std::endl;
+            return 1;
+        }
+        write_json(out, config, results);
+        std::cerr << "Results written to " << config.output_file << std::endl;
+    }
+    return 0;
+}
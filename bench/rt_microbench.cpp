@@ -0,0 +1,469 @@
+// rt_microbench: per-kernel timings for the CPU intersection code.
+// Each kernel runs over a fixed ray set (pinned seeds, so every run and every build sees the
+// same rays and primitives) and reports ns/ray and Mrays/s. Sphere, triangle and slab tests
+// run twice in the same binary, once on scalar Vec3 code ("vec3") and once on Vec3A, so the
+// two can be compared side by side. The Vec3A rows and BVH traversal are labelled with the
+// backend compiled in ("vec3a-sse", or "vec3a-scalar" with ENABLE_SIMD=OFF).
+#include "bvh.h"
+#include "geometry.h"
+#include "scene_generator.h"
+#include "error_handling.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr uint32_t RAY_SEED = 20240601;
+    constexpr uint32_t PRIMITIVE_SEED = 7;
+
+    struct MicrobenchConfig {
+        size_t ray_count = 1 << 16;
+        size_t bvh_primitives = 100000;
+        int warmup_runs = 3;
+        int measured_runs = 15;
+        std::string filter;         // Substring of kernel names to run; empty = all
+        std::string output_file;    // Optional JSON output
+    };
+
+    // One benchmarked kernel: body traces every ray once and returns the hit count
+    struct Kernel {
+        std::string name;
+        std::string variant;
+        std::function<size_t()> body;
+        size_t rays;
+    };
+
+    struct KernelResult {
+        std::string name;
+        std::string variant;
+        size_t rays = 0;
+        double hit_fraction = 0.0;
+        double median_ns_per_ray = 0.0;
+        double min_ns_per_ray = 0.0;
+        double mrays_per_sec = 0.0;
+    };
+
+    // Variant labels, named after the code a kernel actually executes
+    const std::string VEC3_VARIANT = "vec3";
+    const std::string VEC3A_VARIANT = std::string("vec3a-") + Vec3A::backend_name();
+
+    // Rays from a shell around each target point, aimed into a box twice the target's size,
+    // so a primitive of about `size` centered there sees a mix of hits and misses
+    std::vector<Ray> rays_towards(const std::vector<Vec3>& targets, float size, std::mt19937& rng) {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<Ray> rays;
+        rays.reserve(targets.size());
+        for (const Vec3& target : targets) {
+            Vec3 from;
+            do {
+                from = Vec3(unit(rng), unit(rng), unit(rng));
+            } while (from.length_squared() < 0.01f || from.length_squared() > 1.0f);
+            const Vec3 origin = target + from.normalize() * (size * 10.0f);
+            const Vec3 aim = target + Vec3(unit(rng), unit(rng), unit(rng)) * (size * 2.0f);
+            rays.emplace_back(origin, (aim - origin).normalize());
+        }
+        return rays;
+    }
+
+    std::vector<Vec3> random_points(size_t count, float extent, std::mt19937& rng) {
+        std::uniform_real_distribution<float> unit(-extent, extent);
+        std::vector<Vec3> points;
+        points.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            points.emplace_back(unit(rng), unit(rng), unit(rng));
+        }
+        return points;
+    }
+
+    // Vec3A counterparts of Sphere::hit and Triangle::hit. They follow the same math and fill
+    // the same HitRecord, converting to Vec3 only at that boundary.
+    struct RayA {
+        Vec3A origin;
+        Vec3A direction;
+    };
+
+    struct SphereA {
+        Vec3A center;
+        float radius;
+        int material_id;
+    };
+
+    struct TriangleA {
+        Vec3A v0, v1, v2;
+        Vec3A normal;
+        int material_id;
+    };
+
+    void set_face_normal(const RayA& ray, const Vec3A& outward_normal, HitRecord& rec) {
+        rec.front_face = ray.direction.dot(outward_normal) < 0;
+        rec.normal = (rec.front_face ? outward_normal : -outward_normal).to_vec3();
+    }
+
+    bool hit_sphere_vec3a(const SphereA& sphere, const RayA& ray, float t_min, float t_max, HitRecord& rec) {
+        const Vec3A oc = ray.origin - sphere.center;
+        const float a = ray.direction.dot(ray.direction);
+        const float half_b = oc.dot(ray.direction);
+        const float c = oc.dot(oc) - sphere.radius * sphere.radius;
+
+        const float discriminant = half_b * half_b - a * c;
+        if (discriminant < 0) return false;
+
+        const float sqrtd = std::sqrt(discriminant);
+        float root = (-half_b - sqrtd) / a;
+        if (root < t_min || t_max < root) {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || t_max < root) return false;
+        }
+
+        const Vec3A point = Vec3A::mul_add(ray.direction, Vec3A(root), ray.origin);
+        rec.t = root;
+        rec.point = point.to_vec3();
+        set_face_normal(ray, (point - sphere.center) / sphere.radius, rec);
+        rec.material_id = sphere.material_id;
+        return true;
+    }
+
+    bool hit_triangle_vec3a(const TriangleA& triangle, const RayA& ray, float t_min, float t_max, HitRecord& rec) {
+        const float EPSILON = 0.0000001f;
+        const Vec3A edge1 = triangle.v1 - triangle.v0;
+        const Vec3A edge2 = triangle.v2 - triangle.v0;
+        const Vec3A h = ray.direction.cross(edge2);
+        const float a = edge1.dot(h);
+        if (a > -EPSILON && a < EPSILON) return false;
+
+        const float f = 1.0f / a;
+        const Vec3A s = ray.origin - triangle.v0;
+        const float u = f * s.dot(h);
+        if (u < 0.0f || u > 1.0f) return false;
+
+        const Vec3A q = s.cross(edge1);
+        const float v = f * ray.direction.dot(q);
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        const float t = f * edge2.dot(q);
+        if (t <= t_min || t >= t_max) return false;
+
+        rec.t = t;
+        rec.point = Vec3A::mul_add(ray.direction, Vec3A(t), ray.origin).to_vec3();
+        set_face_normal(ray, triangle.normal, rec);
+        rec.material_id = triangle.material_id;
+        return true;
+    }
+
+    // Scalar slab test on Vec3, one axis at a time, for comparison with BVH::hit_box
+    struct SlabRay {
+        Vec3 inv_dir;
+        Vec3 origin_inv_dir;
+    };
+
+    bool hit_box_vec3(const Vec3& min_bounds, const Vec3& max_bounds, const SlabRay& ray, float t_min, float t_max) {
+        const float tx0 = min_bounds.x * ray.inv_dir.x - ray.origin_inv_dir.x;
+        const float tx1 = max_bounds.x * ray.inv_dir.x - ray.origin_inv_dir.x;
+        const float ty0 = min_bounds.y * ray.inv_dir.y - ray.origin_inv_dir.y;
+        const float ty1 = max_bounds.y * ray.inv_dir.y - ray.origin_inv_dir.y;
+        const float tz0 = min_bounds.z * ray.inv_dir.z - ray.origin_inv_dir.z;
+        const float tz1 = max_bounds.z * ray.inv_dir.z - ray.origin_inv_dir.z;
+
+        const float tmin = std::max({std::min(tx0, tx1), std::min(ty0, ty1), std::min(tz0, tz1), t_min});
+        const float tmax = std::min({std::max(tx0, tx1), std::max(ty0, ty1), std::max(tz0, tz1), t_max});
+        return tmin <= tmax;
+    }
+
+    std::vector<RayA> to_vec3a(const std::vector<Ray>& rays) {
+        std::vector<RayA> result;
+        result.reserve(rays.size());
+        for (const Ray& ray : rays) result.push_back(RayA{Vec3A(ray.origin), Vec3A(ray.direction)});
+        return result;
+    }
+
+    // Pairs ray i with primitive i, so the kernel cost is measured without any traversal.
+    // `hit` is called as hit(primitive, ray, rec) for whichever primitive and ray layout the variant uses.
+    template <typename Primitive, typename RayType, typename Hit>
+    Kernel primitive_kernel(const std::string& name, const std::string& variant,
+                            std::shared_ptr<std::vector<Primitive>> primitives,
+                            std::shared_ptr<std::vector<RayType>> rays, Hit hit) {
+        return Kernel{name, variant, [primitives, rays, hit]() {
+            size_t hits = 0;
+            HitRecord rec;
+            const std::vector<Primitive>& prims = *primitives;
+            for (size_t i = 0; i < rays->size(); ++i) {
+                if (hit(prims[i], (*rays)[i], rec)) hits++;
+            }
+            return hits;
+        }, rays->size()};
+    }
+
+    std::vector<Kernel> make_kernels(const MicrobenchConfig& config) {
+        std::vector<Kernel> kernels;
+        std::mt19937 primitive_rng(PRIMITIVE_SEED);
+        std::mt19937 ray_rng(RAY_SEED);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        const std::vector<Vec3> centers = random_points(config.ray_count, 50.0f, primitive_rng);
+
+        {
+            auto spheres = std::make_shared<std::vector<Sphere>>();
+            spheres->reserve(centers.size());
+            for (const Vec3& c : centers) spheres->emplace_back(c, 1.0f, 0);
+            auto rays = std::make_shared<std::vector<Ray>>(rays_towards(centers, 1.0f, ray_rng));
+            kernels.push_back(primitive_kernel("sphere_hit", VEC3_VARIANT, spheres, rays,
+                [](const Sphere& sphere, const Ray& ray, HitRecord& rec) {
+                    return sphere.hit(ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec);
+                }));
+
+            auto spheres_a = std::make_shared<std::vector<SphereA>>();
+            spheres_a->reserve(spheres->size());
+            for (const Sphere& s : *spheres) spheres_a->push_back(SphereA{Vec3A(s.center), s.radius, s.material_id});
+            auto rays_a = std::make_shared<std::vector<RayA>>(to_vec3a(*rays));
+            kernels.push_back(primitive_kernel("sphere_hit", VEC3A_VARIANT, spheres_a, rays_a,
+                [](const SphereA& sphere, const RayA& ray, HitRecord& rec) {
+                    return hit_sphere_vec3a(sphere, ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec);
+                }));
+        }
+        {
+            auto triangles = std::make_shared<std::vector<Triangle>>();
+            triangles->reserve(centers.size());
+            for (const Vec3& c : centers) {
+                triangles->emplace_back(c + Vec3(unit(primitive_rng), unit(primitive_rng), unit(primitive_rng)) * 1.5f,
+                                        c + Vec3(unit(primitive_rng), unit(primitive_rng), unit(primitive_rng)) * 1.5f,
+                                        c + Vec3(unit(primitive_rng), unit(primitive_rng), unit(primitive_rng)) * 1.5f, 0);
+            }
+            auto rays = std::make_shared<std::vector<Ray>>(rays_towards(centers, 1.0f, ray_rng));
+            kernels.push_back(primitive_kernel("triangle_hit", VEC3_VARIANT, triangles, rays,
+                [](const Triangle& triangle, const Ray& ray, HitRecord& rec) {
+                    return triangle.hit(ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec);
+                }));
+
+            auto triangles_a = std::make_shared<std::vector<TriangleA>>();
+            triangles_a->reserve(triangles->size());
+            for (const Triangle& t : *triangles) {
+                triangles_a->push_back(TriangleA{Vec3A(t.v0), Vec3A(t.v1), Vec3A(t.v2), Vec3A(t.normal), t.material_id});
+            }
+            auto rays_a = std::make_shared<std::vector<RayA>>(to_vec3a(*rays));
+            kernels.push_back(primitive_kernel("triangle_hit", VEC3A_VARIANT, triangles_a, rays_a,
+                [](const TriangleA& triangle, const RayA& ray, HitRecord& rec) {
+                    return hit_triangle_vec3a(triangle, ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec);
+                }));
+        }
+        {
+            auto cylinders = std::make_shared<std::vector<Cylinder>>();
+            cylinders->reserve(centers.size());
+            for (const Vec3& c : centers) {
+                const Vec3 axis(unit(primitive_rng), unit(primitive_rng), unit(primitive_rng));
+                const Vec3 safe_axis = axis.length_squared() > 1e-4f ? axis : Vec3(0, 1, 0);
+                cylinders->emplace_back(c - safe_axis.normalize(), safe_axis, 0.6f, 2.0f, 0);
+            }
+            auto rays = std::make_shared<std::vector<Ray>>(rays_towards(centers, 1.0f, ray_rng));
+            kernels.push_back(primitive_kernel("cylinder_hit", VEC3_VARIANT, cylinders, rays,
+                [](const Cylinder& cylinder, const Ray& ray, HitRecord& rec) {
+                    return cylinder.hit(ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec);
+                }));
+        }
+        {
+            // Unit boxes: same layout as the primitives above, tested through the slab test.
+            // The per-ray reciprocals are set up once per BVH query, so they are precomputed here too.
+            auto rays = std::make_shared<std::vector<TraversalRay>>();
+            for (const Ray& ray : rays_towards(centers, 1.0f, ray_rng)) rays->emplace_back(ray);
+            auto slab_rays = std::make_shared<std::vector<SlabRay>>();
+            slab_rays->reserve(rays->size());
+            for (const TraversalRay& ray : *rays) {
+                slab_rays->push_back(SlabRay{ray.inv_dir.to_vec3(), ray.origin_inv_dir.to_vec3()});
+            }
+            auto centers_shared = std::make_shared<std::vector<Vec3>>(centers);
+            kernels.push_back(Kernel{"bvh_hit_box", VEC3_VARIANT, [centers_shared, slab_rays]() {
+                size_t hits = 0;
+                const Vec3 half(1.0f, 1.0f, 1.0f);
+                for (size_t i = 0; i < slab_rays->size(); ++i) {
+                    if (hit_box_vec3((*centers_shared)[i] - half, (*centers_shared)[i] + half, (*slab_rays)[i],
+                                     Constants::RAY_T_MIN, Constants::RAY_T_MAX)) hits++;
+                }
+                return hits;
+            }, slab_rays->size()});
+
+            auto boxes = std::make_shared<std::vector<Vec3A>>();
+            boxes->reserve(centers.size());
+            for (const Vec3& c : centers) boxes->emplace_back(c);
+            kernels.push_back(Kernel{"bvh_hit_box", VEC3A_VARIANT, [boxes, rays]() {
+                size_t hits = 0;
+                const Vec3A half(1.0f, 1.0f, 1.0f);
+                for (size_t i = 0; i < rays->size(); ++i) {
+                    if (BVH::hit_box((*boxes)[i] - half, (*boxes)[i] + half, (*rays)[i],
+                                     Constants::RAY_T_MIN, Constants::RAY_T_MAX)) hits++;
+                }
+                return hits;
+            }, rays->size()});
+        }
+
+        // Full traversal over generated scenes, with primary rays from the scene camera
+        for (SceneGenerator::Pattern pattern : {SceneGenerator::Pattern::SPHERE_FIELD,
+                                                SceneGenerator::Pattern::TESSELLATED_MESH}) {
+            SceneGenerator::Options options;
+            options.pattern = pattern;
+            options.primitive_count = config.bvh_primitives;
+            options.seed = PRIMITIVE_SEED;
+
+            auto scene = std::make_shared<Scene>();
+            if (!SceneGenerator::generate(options, *scene)) continue;
+            scene->build_acceleration_structure();
+
+            const Camera& camera = scene->camera;
+            auto rays = std::make_shared<std::vector<Ray>>();
+            rays->reserve(config.ray_count);
+            std::uniform_real_distribution<float> uv(0.0f, 1.0f);
+            for (size_t i = 0; i < config.ray_count; ++i) {
+                const Vec3 direction = camera.lower_left_corner + camera.horizontal * uv(ray_rng) +
+                                       camera.vertical * uv(ray_rng) - camera.position;
+                rays->emplace_back(camera.position, direction.normalize());
+            }
+
+            const std::string name = std::string("bvh_hit/") + SceneGenerator::pattern_to_string(pattern) + "_" +
+                                     std::to_string(scene->objects.size());
+            kernels.push_back(Kernel{name, VEC3A_VARIANT, [scene, rays]() {
+                size_t hits = 0;
+                HitRecord rec;
+                for (const Ray& ray : *rays) {
+                    if (scene->bvh->hit(ray, Constants::RAY_T_MIN, Constants::RAY_T_MAX, rec)) hits++;
+                }
+                return hits;
+            }, rays->size()});
+        }
+
+        return kernels;
+    }
+
+    KernelResult run_kernel(const MicrobenchConfig& config, const Kernel& kernel) {
+        KernelResult result;
+        result.name = kernel.name;
+        result.variant = kernel.variant;
+        result.rays = kernel.rays;
+
+        std::vector<double> ns_per_ray;
+        size_t hits = 0;
+        for (int run = 0; run < config.warmup_runs + config.measured_runs; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            hits = kernel.body();
+            const auto end = std::chrono::steady_clock::now();
+            if (run >= config.warmup_runs) {
+                ns_per_ray.push_back(std::chrono::duration<double, std::nano>(end - start).count() / kernel.rays);
+            }
+        }
+
+        std::sort(ns_per_ray.begin(), ns_per_ray.end());
+        const size_t n = ns_per_ray.size();
+        result.median_ns_per_ray = n % 2 ? ns_per_ray[n / 2] : 0.5 * (ns_per_ray[n / 2 - 1] + ns_per_ray[n / 2]);
+        result.min_ns_per_ray = ns_per_ray.front();
+        result.mrays_per_sec = result.median_ns_per_ray > 0.0 ? 1000.0 / result.median_ns_per_ray : 0.0;
+        result.hit_fraction = kernel.rays ? static_cast<double>(hits) / kernel.rays : 0.0;
+        return result;
+    }
+
+    void print_table(const std::vector<KernelResult>& results) {
+        std::cout << std::left << std::setw(30) << "Kernel" << std::setw(14) << "Variant"
+                  << std::right << std::setw(10) << "Rays" << std::setw(8) << "Hit%"
+                  << std::setw(12) << "ns/ray" << std::setw(12) << "min ns" << std::setw(12) << "Mrays/s" << "\n";
+        for (const KernelResult& r : results) {
+            std::cout << std::left << std::setw(30) << r.name << std::setw(14) << r.variant
+                      << std::right << std::setw(10) << r.rays
+                      << std::setw(8) << std::fixed << std::setprecision(1) << r.hit_fraction * 100.0
+                      << std::setw(12) << std::setprecision(2) << r.median_ns_per_ray
+                      << std::setw(12) << r.min_ns_per_ray
+                      << std::setw(12) << r.mrays_per_sec << "\n";
+        }
+    }
+
+    bool write_json(const MicrobenchConfig& config, const std::vector<KernelResult>& results) {
+        std::ofstream out(config.output_file);
+        if (!out) {
+            std::cerr << "Failed to open " << config.output_file << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(4);
+        out << "{\n  \"benchmark\": \"rt_microbench\",\n";
+        out << "  \"config\": {\"rays\": " << config.ray_count << ", \"bvh_primitives\": " << config.bvh_primitives
+            << ", \"warmup_runs\": " << config.warmup_runs << ", \"measured_runs\": " << config.measured_runs
+            << ", \"ray_seed\": " << RAY_SEED << ", \"primitive_seed\": " << PRIMITIVE_SEED << "},\n";
+        out << "  \"kernels\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const KernelResult& r = results[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"variant\": \"" << r.variant
+                << "\", \"rays\": " << r.rays << ", \"hit_fraction\": " << r.hit_fraction
+                << ", \"median_ns_per_ray\": " << r.median_ns_per_ray << ", \"min_ns_per_ray\": " << r.min_ns_per_ray
+                << ", \"mrays_per_sec\": " << r.mrays_per_sec << "}";
+        }
+        out << "\n  ]\n}\n";
+        return true;
+    }
+
+    void print_usage(const char* program) {
+        std::cout << "Usage: " << program << " [options]\n";
+        std::cout << "Times the CPU intersection kernels and BVH traversal over fixed ray sets.\n";
+        std::cout << "Options:\n";
+        std::cout << "  --rays <int>         Rays per kernel run (default: 65536)\n";
+        std::cout << "  --bvh-size <count>   Primitives in the BVH traversal scenes (default: 100k)\n";
+        std::cout << "  --warmup <int>       Unmeasured runs per kernel (default: 3)\n";
+        std::cout << "  --runs <int>         Measured runs per kernel (default: 15)\n";
+        std::cout << "  --filter <text>      Only run kernels whose name contains text\n";
+        std::cout << "  -o, --output <file>  Also write results as JSON\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    MicrobenchConfig config;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                print_usage(argv[0]);
+                return 0;
+            } else if (arg == "--rays" && i + 1 < argc) {
+                const long rays = std::stol(argv[++i]);
+                if (rays <= 0) throw std::invalid_argument("Ray count must be positive");
+                config.ray_count = static_cast<size_t>(rays);
+            } else if (arg == "--bvh-size" && i + 1 < argc) {
+                const std::string count = argv[++i];
+                if (!SceneGenerator::parse_count(count, config.bvh_primitives)) {
+                    throw std::invalid_argument("Invalid BVH primitive count: " + count);
+                }
+            } else if (arg == "--warmup" && i + 1 < argc) {
+                config.warmup_runs = std::stoi(argv[++i]);
+                if (config.warmup_runs < 0) throw std::invalid_argument("Warmup runs must not be negative");
+            } else if (arg == "--runs" && i + 1 < argc) {
+                config.measured_runs = std::stoi(argv[++i]);
+                if (config.measured_runs <= 0) throw std::invalid_argument("Measured runs must be positive");
+            } else if (arg == "--filter" && i + 1 < argc) {
+                config.filter = argv[++i];
+            } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+                config.output_file = argv[++i];
+            } else {
+                throw std::invalid_argument("Unknown option: " + arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    ErrorHandling::Logger::set_level(ErrorHandling::LogLevel::WARNING);
+#ifdef ENABLE_RAY_STATS
+    std::cerr << "Warning: built with ENABLE_RAY_STATS; counter updates are included in the timings" << std::endl;
+#endif
+
+    std::vector<KernelResult> results;
+    for (const Kernel& kernel : make_kernels(config)) {
+        if (!config.filter.empty() && kernel.name.find(config.filter) == std::string::npos) continue;
+        results.push_back(run_kernel(config, kernel));
+    }
+
+    print_table(results);
+    if (!config.output_file.empty() && !write_json(config, results)) {
+        return 1;
+    }
+    return 0;
+}
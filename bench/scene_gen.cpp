@@ -0,0 +1,70 @@
+// scene_gen: writes procedural scenes of a requested size for scaling tests.
+// The same scenes are available in memory through SceneGenerator::generate (rt_bench --generate).
+#include "scene_generator.h"
+#include "error_handling.h"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    void print_usage(const char* program) {
+        std::cout << "Usage: " << program << " <pattern> <count> [options]\n";
+        std::cout << "Writes a procedural scene with about <count> primitives (k/M suffixes allowed).\n";
+        std::cout << "Patterns:\n";
+        std::cout << "  sphere_field         Spheres on a jittered grid with mixed materials (exact count)\n";
+        std::cout << "  mesh                 One tessellated torus written as an OBJ next to the scene\n";
+        std::cout << "  instanced_grid       A 128-triangle torus OBJ placed on a grid with load_obj offsets\n";
+        std::cout << "Options:\n";
+        std::cout << "  -o, --output <file>  Scene file to write (default: <pattern>_<count>.scene)\n";
+        std::cout << "  --seed <int>         Random seed (default: 1)\n";
+        std::cout << "  --aspect <float>     Camera aspect ratio (default: 1.7778)\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    SceneGenerator::Options options;
+    std::string output_file;
+    std::vector<std::string> positional;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h") {
+                print_usage(argv[0]);
+                return 0;
+            } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+                output_file = argv[++i];
+            } else if (arg == "--seed" && i + 1 < argc) {
+                options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+            } else if (arg == "--aspect" && i + 1 < argc) {
+                options.aspect_ratio = std::stof(argv[++i]);
+                if (options.aspect_ratio <= 0.0f) throw std::invalid_argument("Aspect ratio must be positive");
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw std::invalid_argument("Unknown option: " + arg);
+            } else {
+                positional.push_back(arg);
+            }
+        }
+
+        if (positional.size() != 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (!SceneGenerator::parse_pattern(positional[0], options.pattern)) {
+            throw std::invalid_argument("Unknown pattern: " + positional[0]);
+        }
+        if (!SceneGenerator::parse_count(positional[1], options.primitive_count)) {
+            throw std::invalid_argument("Invalid primitive count: " + positional[1]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (output_file.empty()) {
+        output_file = positional[0] + "_" + positional[1] + ".scene";
+    }
+
+    return SceneGenerator::write_scene_file(options, output_file) ? 0 : 1;
+}
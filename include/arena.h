@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator: allocations are carved sequentially out of large blocks and are only
+// released together, when the arena is destroyed. Not thread-safe; scenes and BVHs are
+// built from a single thread.
+class MemoryArena {
+private:
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* cursor_ = nullptr;
+    std::byte* block_end_ = nullptr;
+    size_t block_size_;
+    size_t bytes_used_ = 0;
+    size_t bytes_reserved_ = 0;
+
+    void* allocate_slow(size_t size, size_t alignment);
+    void add_block(size_t bytes);
+
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    explicit MemoryArena(size_t block_size = DEFAULT_BLOCK_SIZE) : block_size_(block_size) {}
+
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment) {
+        const size_t misalignment = reinterpret_cast<uintptr_t>(cursor_) & (alignment - 1);
+        const size_t padding = misalignment ? alignment - misalignment : 0;
+        if (cursor_ && static_cast<size_t>(block_end_ - cursor_) >= size + padding) {
+            std::byte* result = cursor_ + padding;
+            cursor_ = result + size;
+            bytes_used_ += size;
+            return result;
+        }
+        return allocate_slow(size, alignment);
+    }
+
+    // Makes sure the next `bytes` of allocations come from one contiguous block
+    void reserve(size_t bytes);
+
+    // Constructs a T in the arena. T's destructor is never run, so only trivially
+    // destructible types are accepted here; use ArenaAllocator with allocate_shared otherwise.
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    size_t bytes_used() const noexcept { return bytes_used_; }
+    size_t bytes_reserved() const noexcept { return bytes_reserved_; }
+    size_t block_count() const noexcept { return blocks_.size(); }
+};
+
+// Standard allocator over an arena, for std::allocate_shared: object and control block share
+// one bump allocation and deallocation is a no-op. The allocator does not own the arena (copies
+// are plain pointer copies), so objects allocated through it must not outlive the arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(MemoryArena* arena) noexcept : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) noexcept {}
+
+    MemoryArena* arena() const noexcept { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena_ != other.arena(); }
+
+private:
+    MemoryArena* arena_;
+};
@@ -1,34 +1,53 @@
 #pragma once
 #include "common.h"
 #include "geometry.h"
+#include "arena.h"
+#include "vec3a.h"
 #include <memory>
 #include <vector>
 
-struct BVHNode {
-    Vec3 min_bounds, max_bounds;
-    std::shared_ptr<BVHNode> left, right;
-    std::shared_ptr<Geometry> geometry;
-    
-    BVHNode() = default;
-    BVHNode(std::shared_ptr<Geometry> geom) : geometry(geom) {
-        if (geom) {
-            min_bounds = geom->get_min_bounds();
-            max_bounds = geom->get_max_bounds();
-        }
-    }
+// Nodes live in the owning BVH's arena, allocated depth-first so a node's left child
+// follows it in memory. Leaves point at primitives kept alive by BVH::primitives.
+// One node fills one 64-byte cache line.
+struct alignas(64) BVHNode {
+    Vec3A min_bounds, max_bounds;
+    BVHNode* left = nullptr;
+    BVHNode* right = nullptr;
+    const Geometry* geometry = nullptr;
+    int split_axis = 0;  // Children are sorted along this axis (left = lower); fits the padding
+};
+
+// Per-ray data for the slab test, computed once per BVH query instead of once per node.
+// Near-zero direction components use +-1e8 rather than infinity so the test never sees NaN.
+struct TraversalRay {
+    Vec3A inv_dir;
+    Vec3A origin_inv_dir;   // origin * inv_dir, so each slab is one multiply-subtract
+    int dir_is_neg[3];      // Sign bits, used to visit the nearer child first
+
+    explicit TraversalRay(const Ray& ray) noexcept;
 };
 
 class BVH {
 private:
-    std::shared_ptr<BVHNode> root;
+    MemoryArena node_arena;
+    std::vector<std::shared_ptr<Geometry>> primitives;  // Leaf order
+    BVHNode* root = nullptr;
     
-    std::shared_ptr<BVHNode> build_bvh(std::vector<std::shared_ptr<Geometry>>& objects, int start, int end);
-    bool hit_bvh(const std::shared_ptr<BVHNode>& node, const Ray& ray, float t_min, float t_max, HitRecord& rec) const;
-    bool hit_box(const Vec3& min_bounds, const Vec3& max_bounds, const Ray& ray) const;
+    BVHNode* build_bvh(std::vector<std::shared_ptr<Geometry>>& objects, int start, int end);
+    bool hit_bvh(const BVHNode* node, const Ray& ray, const TraversalRay& traversal,
+                 float t_min, float t_max, HitRecord& rec) const;
     
 public:
     BVH() = default;
     BVH(std::vector<std::shared_ptr<Geometry>>& objects);
     
+    BVH(const BVH&) = delete;
+    BVH& operator=(const BVH&) = delete;
+    
     bool hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const;
+    
+    // Ray/AABB slab test used for every node visit (public for the kernel microbenchmarks).
+    // Only boxes overlapping [t_min, t_max] along the ray count as hit.
+    static bool hit_box(const Vec3A& min_bounds, const Vec3A& max_bounds, const TraversalRay& ray,
+                        float t_min, float t_max);
 };
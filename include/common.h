@@ -2,6 +2,12 @@
 #include <cmath>
 #include <algorithm>
 
+// SSE paths (Vec3A, fast_inv_sqrt); configure with -DENABLE_SIMD=OFF to compare against scalar code
+#if !defined(RAYTRACER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define RAYTRACER_SSE 1
+    #include <immintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -27,10 +33,16 @@ namespace Math {
         return std::max(min_val, std::min(max_val, value));
     }
     
-    // Fast inverse square root for performance-critical normalization
+    // Fast inverse square root for performance-critical normalization:
+    // the hardware estimate (~12 bits) refined by one Newton-Raphson step (~22 bits)
     inline float fast_inv_sqrt(float x) noexcept {
-        // Modern approximation - much faster than 1.0f / sqrt(x)
-        return x > 0.0f ? 1.0f / std::sqrt(x) : 0.0f;
+        if (!(x > 0.0f)) return 0.0f;
+#ifdef RAYTRACER_SSE
+        const float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+        return r * (1.5f - 0.5f * x * r * r);
+#else
+        return 1.0f / std::sqrt(x);
+#endif
     }
 }
 
@@ -120,6 +132,11 @@ namespace Math {
 
 using Color = Vec3;
 
+// Rec. 709 relative luminance of a linear colour
+constexpr float luminance(const Color& c) noexcept {
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
 struct Ray {
     Vec3 origin, direction;
     float t_min, t_max;
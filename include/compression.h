@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// In-tree zlib-compatible compression used by the PNG and EXR writers (no external zlib dependency)
+namespace Compression {
+    uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) noexcept;
+    uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler = 1) noexcept;
+
+    // Raw DEFLATE (RFC 1951) of one segment: LZ77 with hash chains, fixed Huffman codes.
+    // Non-final segments end with an empty stored block (a sync flush) so they finish on a
+    // byte boundary and independently compressed segments can simply be concatenated.
+    void deflate_segment(const unsigned char* data, size_t size, bool final_segment,
+                         std::vector<unsigned char>& out);
+
+    // Complete zlib stream (RFC 1950): header, DEFLATE data, Adler-32 trailer
+    std::vector<unsigned char> zlib_compress(const unsigned char* data, size_t size);
+
+    // zlib stream whose DEFLATE data is produced in parallel, one segment per worker.
+    // Back-references never cross segment boundaries, so pick segments of at least a few KB.
+    std::vector<unsigned char> zlib_compress_parallel(const unsigned char* data, size_t size,
+                                                      size_t segment_size);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "common.h"
+#include "image.h"
+#include <vector>
+
+// Edge-aware à-trous wavelet filter after SVGF (Schied et al. 2017), guided by first-hit
+// G-buffers from the ray tracing kernel. The compute shader version runs between accumulation
+// and display (Shader::get_denoise_compute_shader); atrous() below is the same filter on the
+// CPU for headless output.
+namespace Denoise {
+    struct Settings {
+        int iterations = 5;            // Step sizes 1, 2, 4, ... 2^(iterations - 1)
+        float sigma_luminance = 4.0f;  // Luminance edge stop, in standard deviations of the noise
+        float sigma_normal = 128.0f;   // Exponent on the normal dot product
+        float sigma_depth = 1.0f;      // Depth edge stop, relative to the local depth gradient
+    };
+
+    // Per-pixel guides in Image row order (bottom-up), as read back by GPURayTracer::read_gbuffer
+    struct GBuffer {
+        int width = 0, height = 0;
+        std::vector<Vec3> normal;     // Mean first-hit normal
+        std::vector<float> depth;     // Mean first-hit distance, 0 where the primary rays missed
+        std::vector<Color> albedo;    // Mean first-hit albedo, 1 for misses and non-diffuse surfaces
+        std::vector<Color> emission;  // Mean emitter or background radiance seen directly, left unfiltered
+        std::vector<float> variance;  // Variance of each pixel's accumulated mean luminance
+    };
+
+    // Filters the linear image in place. Directly visible emission is subtracted first and the
+    // remaining illumination is filtered with the albedo divided out, then both are put back,
+    // so light sources, silhouettes against the sky and texture detail are not blurred.
+    void atrous(Image& image, const GBuffer& gbuffer, const Settings& settings = Settings());
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Dynamic resolution for interactive mode. While the camera moves, picks the render scale
+// (fraction of the window's width and height) and samples per frame so that measured GPU time
+// stays near a target; once the camera has been still for a few frames it returns to full
+// resolution and the requested samples so accumulation converges at full quality.
+//
+// GPU time is modelled as proportional to pixels * samples. Samples are dropped to one before
+// resolution is reduced, and resolution is restored before samples are added back.
+class FrameBudget {
+public:
+    struct Settings {
+        float target_ms = 16.6f;     // GPU time per frame to aim for
+        float min_scale = 0.25f;     // Smallest fraction of the window width/height rendered
+        float scale_step = 0.05f;    // Scales are multiples of this so timing noise does not reallocate
+        int settle_frames = 10;      // Still frames before returning to full quality
+        int cooldown_frames = 3;     // Frames after a change before timer queries reflect it
+    };
+
+    explicit FrameBudget(const Settings& settings) noexcept : settings_(settings) {}
+
+    // Feed the GPU time of the most recently measured frame (0 if none yet), whether the camera
+    // moved since the previous frame and the samples per frame asked for at full quality
+    void update(double gpu_ms, bool camera_moving, int requested_samples) noexcept;
+
+    float scale() const noexcept { return scale_; }
+    int samples() const noexcept { return samples_; }
+    const Settings& settings() const noexcept { return settings_; }
+
+private:
+    Settings settings_;
+    float scale_ = 1.0f;
+    int samples_ = 1;
+    int still_frames_ = 0;
+    int cooldown_ = 0;
+};
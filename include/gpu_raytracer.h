@@ -1,10 +1,16 @@
 #pragma once
 #include "common.h"
 #include "scene.h"
+#include "ray_stats.h"
+#include "sampler.h"
+#include "denoiser.h"
+#include <deque>
 #include <memory>
+#include <vector>
 
 // Forward declarations to avoid including OpenGL headers in header
 typedef unsigned int GLuint;
+typedef struct __GLsync* GLsync;
 
 // GPU-aligned structures (std140 layout compatible)
 struct alignas(16) GPUMaterial {
@@ -61,11 +67,10 @@ struct alignas(16) GPUCamera {
     float lens_radius;
 };
 
-struct GPULight {
-    int type;           // 0=point, 1=spot, 2=area
-    float padding1;
+// Every vec3 is followed by a scalar so the std430 layout has no hidden padding
+struct alignas(16) GPULight {
     Vec3 position;
-    float padding2;
+    int type;           // 0=point, 1=spot, 2=directional (area plane lights are uploaded as 2)
     Vec3 intensity;
     float radius;       // Soft shadow radius
     Vec3 direction;     // For spot lights
@@ -76,8 +81,9 @@ struct GPULight {
     float width;        // For area lights
     float height;       // For area lights
     int samples;        // For area lights
-    float padding3[2];
+    float _padding[2];
 };
+static_assert(sizeof(GPULight) == 96, "GPULight must match the shader's std430 Light layout");
 
 struct alignas(16) GPUCylinder {
     Vec3 base_center;    // Base center position
@@ -92,27 +98,160 @@ struct alignas(16) GPUCylinder {
         : base_center(base), radius(r), axis(ax), height(h), material_id(mat_id), _padding{0, 0, 0} {}
 };
 
+// Emissive primitive for next-event estimation, see GPURayTracer::load_scene. Emitters are
+// picked in proportion to their power (luminance * area); cdf is the running fraction of the
+// total up to and including this entry.
+struct alignas(16) GPUEmitter {
+    int primitive_type;  // 0=sphere, 1=triangle, 2=cylinder
+    int primitive_index; // Index into the matching primitive buffer
+    float cdf;
+    float _padding;
+};
+static_assert(sizeof(GPUEmitter) == 16, "GPUEmitter must match the shader's std430 Emitter layout");
+
+// GPU work measured with timer queries
+enum class GPUStage : int {
+    Dispatch = 0,   // Everything a render() call submits but the denoiser: pass setup, tiles, adaptive estimate
+    Display,        // Fullscreen quad blit in interactive mode
+    Readback,       // Accumulation texture download into a pixel buffer
+    Denoise,        // À-trous filter iterations
+    Count
+};
+
+// Pixels traced by a pass rendered while the camera moves (the shader's SPARSE_* values)
+enum class SparsePattern : int {
+    None = 0,           // Every pixel, every pass
+    Checkerboard = 1,   // Alternating halves of a checkerboard
+    Foveated = 2        // Checkerboard near the centre, one pixel per 2x2 quad further out
+};
+
+// When paths end besides the total depth (the shader's roulette_depth and lobe limits). Lobe
+// limits count one kind of scattering event per path; 0 leaves it bounded by the depth alone.
+struct PathTermination {
+    int roulette_depth = 3;        // Bounces traced before Russian roulette on the throughput starts
+    int diffuse_bounces = 0;       // Lambertian and other diffuse materials
+    int specular_bounces = 0;      // Metal reflections
+    int transmission_bounces = 0;  // Dielectric refractions and reflections
+};
+
 class GPURayTracer {
 private:
     GLuint compute_shader;
     GLuint shader_program;
     GLuint output_texture;
-    GLuint accumulation_texture;  // For temporal accumulation
+    GLuint accumulation_texture;  // For temporal accumulation; alpha holds the per-pixel sample count
+    GLuint moment_texture;        // Running mean of squared luminance, for adaptive sampling and denoising
+    GLuint adaptive_program;      // Per-tile error estimate run after each pass when adaptive sampling is on
+    GLuint gbuffer_textures[3];   // First-hit normal + depth, albedo and emission, allocated while G-buffers are written
+    GLuint denoise_textures[2];   // À-trous ping-pong images, allocated while the GPU denoiser is on
+    GLuint history_textures[3];   // Accumulation, moment and normal + depth as of the previous view, while reprojecting
+    GLuint denoise_program;
     GLuint material_buffer;
     GLuint sphere_buffer;
     GLuint triangle_buffer;       // Triangle buffer
     GLuint cylinder_buffer;       // Cylinder buffer
     GLuint camera_buffer;
     GLuint light_buffer;
+    GLuint light_tree_buffer;     // LightTree nodes over the leading point/spot lights
+    GLuint emitter_buffer;        // Emissive primitives sampled for next-event estimation
+    GLuint blue_noise_buffer;     // Blue-noise tile, uploaded the first time that sampler is used
+    GLuint ray_stats_buffer;      // Counter SSBO, only allocated with ENABLE_RAY_STATS
+    GLuint tile_state_buffer;     // One active flag per 8x8 tile
+    GLuint tile_counter_buffers[2]; // Active tile counts, alternated so the previous pass reads back without a stall
     
-    int window_width, window_height;
+    int window_width, window_height; // Allocated image size
+    int render_width, render_height; // Traced bottom-left part of the images, see set_render_size
+    int pass_width, pass_height;     // Render size of the latest pass, which reprojection reads history at
     int num_materials, num_spheres, num_triangles, num_cylinders, num_lights;
+    int num_tree_lights;          // Leading entries of the light buffer covered by the light tree
+    int light_samples;            // Tree lights sampled per shading point
+    float inv_emitter_power;      // 1 / total emitter power, 0 without emitters
+    Sampling::Type sampler_type;
+    unsigned int sample_index_base; // Samples accumulated since the last reset, indexes the sample sequence
+    bool blue_noise_uploaded;
+    float adaptive_threshold;     // Tile noise threshold, 0 disables adaptive sampling
+    int tile_counter_next;        // Counter buffer the current (or next) pass counts active tiles into
+    bool counting_tiles;          // A pass began counting into it and has not finished
+    int adaptive_passes;          // Estimate passes since the last reset
+    bool denoise_enabled;         // Run the à-trous filter on the GPU after every pass
+    bool gbuffer_output;          // Accumulate G-buffers for a CPU denoise (denoise_enabled implies them)
+    Denoise::Settings denoise_settings;
+    float temporal_blend;         // Minimum weight of a new pass over reprojected history, 0 disables reprojection
+    GPUCamera current_camera;     // Last camera uploaded by update_camera
+    bool camera_uploaded;
+    GPUCamera history_camera;     // View of the history snapshot, i.e. of the pass before the latest reprojecting one
+    int history_width, history_height; // Render size of that snapshot
+    bool pass_reprojects;         // The pass in progress reads the history snapshot
+    bool reuse_history;           // A reprojecting pass was abandoned, so the next one reprojects from the same snapshot
+    SparsePattern sparse_pattern; // Used for passes after the camera moved
+    unsigned int sparse_phase;    // Sparse passes so far, rotates the traced subset
+    bool sparse_pass;             // The latest pass was sparse
+    PathTermination path_termination;
+    
+    // Tiled dispatch: a pass covers tile_schedule in order, tiles_per_submit per render() call
+    struct ScreenTile {
+        int x, y, width, height;
+    };
+    int tile_size;                // Screen tile edge in pixels (a multiple of 8), 0 = whole image
+    int tiles_per_submit;
+    std::vector<ScreenTile> tile_schedule; // Centre-out order, rebuilt lazily after a resize
+    size_t next_tile;             // Next tile of the current pass, 0 between passes
+    
     Vec3 ambient_light;
     int frame_count;              // For temporal accumulation
     bool reset_accumulation;      // Reset flag for camera movement
     
+    // Asynchronous readback of the accumulation texture through double-buffered pixel pack buffers
+    static constexpr int READBACK_SLOTS = 2;
+    struct ReadbackSlot {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        int width = 0, height = 0;    // Render size at the time of the copy
+        int row_length = 0;       // Texels per downloaded row (the whole texture is copied)
+        size_t capacity = 0;      // Allocated buffer size in bytes
+    };
+    ReadbackSlot readback_slots[READBACK_SLOTS];
+    int readback_next;            // Slot the next begin_readback() fills
+    int readback_pending;         // Readbacks queued but not yet consumed
+    
+    void discard_pending_readbacks();
+    
+    // One fence per render() call so callers can bound how many frames are queued on the GPU
+    static constexpr size_t MAX_TRACKED_FRAMES = 4;
+    std::deque<GLsync> frame_fences;
+    
+    // GPU timings from GL_TIMESTAMP query pairs. Each stage has two slots used alternately,
+    // so a result is read back one use later without waiting on the GPU.
+    static constexpr int TIMER_SLOTS = 2;
+    static constexpr int STAGE_COUNT = static_cast<int>(GPUStage::Count);
+    struct TimerSlot {
+        GLuint queries[2] = {0, 0};   // Begin and end timestamps
+        bool pending = false;         // Issued, result not yet collected
+    };
+    struct StageTimer {
+        TimerSlot slots[TIMER_SLOTS];
+        int next = 0;
+        bool open = false;            // begin_gpu_timer issued without matching end
+        double last_ms = 0.0;
+        double average_ms = 0.0;      // Exponential moving average
+        double total_ms = 0.0;
+        int samples = 0;
+    };
+    StageTimer stage_timers[STAGE_COUNT];
+    
+    bool collect_timer_slot(GPUStage stage, TimerSlot& slot, bool wait);
+    
     bool compile_shader(const std::string& source, GLuint& shader);
     bool create_compute_program();
+    void create_adaptive_resources();
+    void create_frame_resources();
+    void release_frame_resources();
+    void run_denoiser();
+    void build_tile_schedule();
+    // Camera, history snapshot and uniforms shared by every tile of a pass
+    void begin_pass(const Camera& camera, int samples, int max_depth);
+    // Drop the rest of the current pass but keep the images, so the next pass can reproject
+    void abandon_pass();
     void setup_buffers(const Scene& scene);
     
 public:
@@ -121,17 +260,142 @@ public:
     
     bool initialize();
     void load_scene(const Scene& scene);
+    // Trace a pass of samples per pixel into the accumulation buffer. With tiling, each call
+    // dispatches the next batch of tiles instead and the pass ends with the call that covers
+    // the last one; samples and max_depth are taken from the call that started it.
     void render(const Camera& camera, int samples, int max_depth);
+    // Reallocate every image at width x height and trace all of it; restarts accumulation
     void resize(int width, int height);
     
-    // Reset accumulation buffer (call when camera moves)
+    // Dynamic resolution: trace only the bottom-left width x height pixels of the images
+    // (clamped to the allocated size) without reallocating anything. With temporal reprojection
+    // on, the next pass resamples the accumulated history from the previous render size;
+    // otherwise accumulation restarts. A pass in progress is abandoned.
+    void set_render_size(int width, int height);
+    
+    // Tiled dispatch for very large or slow frames: passes are split into tile_size^2 pixel
+    // screen tiles (rounded up to a multiple of 8), dispatched from the centre outwards,
+    // tiles_per_submit per render() call with a flush after each batch. No single submission
+    // then runs long enough to trip a driver watchdog, and the output texture shows the pass
+    // filling in. Moving the camera mid-pass starts a new pass that reprojects from the last
+    // completed one (with temporal reprojection on; otherwise accumulation restarts). The
+    // adaptive estimate and the denoiser run after every batch, so each call's output is whole.
+    // tile_size 0 dispatches the whole image in one call.
+    void set_tiling(int tile_size, int tiles_per_submit);
+    int get_tile_size() const { return tile_size; }
+    // True between passes, i.e. when the latest render() call finished one
+    bool pass_complete() const { return next_tile == 0; }
+    // Samples per pixel requested by the passes begun since the last reset
+    int accumulated_samples() const { return static_cast<int>(sample_index_base); }
+    
+    // Block until at most max_in_flight rendered frames are still executing on the GPU
+    void wait_for_frames(int max_in_flight);
+    
+    // Russian roulette and per-lobe bounce limits; restarts accumulation
+    void set_path_termination(const PathTermination& termination);
+    const PathTermination& get_path_termination() const { return path_termination; }
+    
+    // Lights drawn from the light tree per shading point. Scenes with no more point/spot
+    // lights than this evaluate all of them exactly.
+    void set_light_samples(int samples) { light_samples = std::max(1, samples); }
+    int get_light_samples() const { return light_samples; }
+    
+    // Sample generator for pixel, lens, BSDF and light decisions (default: Owen-scrambled Sobol)
+    void set_sampler(Sampling::Type type) { sampler_type = type; reset_accumulation_buffer(); }
+    Sampling::Type get_sampler() const { return sampler_type; }
+    
+    // Adaptive sampling: after each pass, 8x8 tiles whose worst pixel has a tone-mapped standard
+    // error below threshold (and at least ADAPTIVE_MIN_SAMPLES samples) stop being traced until
+    // the next reset. 0 disables it and every pixel is traced each pass.
+    static constexpr int ADAPTIVE_MIN_SAMPLES = 16;
+    void set_adaptive_threshold(float threshold) { adaptive_threshold = std::max(0.0f, threshold); reset_accumulation_buffer(); }
+    float get_adaptive_threshold() const { return adaptive_threshold; }
+    
+    // Tiles still being traced as of the pass before the most recent one (that pass's count is
+    // read back, so this only waits if that pass is still running). -1 until two passes have
+    // run since the last reset or with adaptive sampling off.
+    int active_tiles();
+    int total_tiles() const { return ((render_width + 7) / 8) * ((render_height + 7) / 8); }
+    
+    // Edge-aware à-trous denoising of the displayed image (interactive mode). Turning it on
+    // restarts accumulation so the G-buffers cover every sample.
+    void set_denoise(bool enabled);
+    bool get_denoise() const { return denoise_enabled; }
+    void set_denoise_settings(const Denoise::Settings& settings) { denoise_settings = settings; }
+    const Denoise::Settings& get_denoise_settings() const { return denoise_settings; }
+    
+    // Accumulate G-buffers without filtering on the GPU, for Denoise::atrous on a readback
+    void set_gbuffer_output(bool enabled);
+    
+    // Copy the accumulated G-buffers and per-pixel variance (blocks until queued passes
+    // finish). Returns false unless G-buffers are being written.
+    bool read_gbuffer(Denoise::GBuffer& gbuffer);
+    
+    // Temporal reprojection: after the camera moves or the render size changes, each pixel
+    // reuses the accumulated history of the surface it saw in the previous view (rejected on depth or normal mismatch) instead
+    // of restarting. History is capped so a new pass weighs at least blend, so it fades out like
+    // an exponential moving average while moving and accumulates normally once the camera stops.
+    // 0 disables it and any camera motion restarts accumulation.
+    void set_temporal_reprojection(float blend);
+    float get_temporal_reprojection() const { return temporal_blend; }
+    
+    // Trace only part of the pixels on passes where the camera moved, rotating the subset each
+    // pass; untraced pixels keep reprojected history where there is some and are otherwise
+    // filled from neighbours by the display pass. Passes with a still camera trace every pixel.
+    static constexpr float FOVEA_RADIUS = 0.25f;  // In image heights from the centre
+    void set_sparse_pattern(SparsePattern pattern) { sparse_pattern = pattern; }
+    SparsePattern get_sparse_pattern() const { return sparse_pattern; }
+    bool last_pass_sparse() const { return sparse_pass; }
+    
+    // Call when the camera moves: restarts accumulation unless reprojection keeps the history
+    void camera_changed() { if (temporal_blend <= 0.0f) reset_accumulation_buffer(); }
+    
+    // Reset accumulation buffer (call when the view changes in a way reprojection cannot follow)
     void reset_accumulation_buffer() { 
         reset_accumulation = true; 
         frame_count = 0; 
+        sample_index_base = 0;
+        adaptive_passes = 0;
+        next_tile = 0;
     }
     
     GLuint get_output_texture() const { return output_texture; }
+    // Render size; readbacks and the traced part of the output texture have this size
+    int get_width() const { return render_width; }
+    int get_height() const { return render_height; }
+    int get_texture_width() const { return window_width; }
+    int get_texture_height() const { return window_height; }
+    
+    // Queue a copy of the linear RGBA32F accumulation buffer into a pixel buffer object.
+    // The copy runs asynchronously on the GPU and overlaps with subsequent frames.
+    void begin_readback();
+    
+    // Copy the oldest queued readback into image (queuing one first if none is pending).
+    // Image rows are bottom-up like the texture. With wait = false this returns false instead
+    // of blocking when the GPU has not finished the copy yet.
+    bool read_accumulation(Image& image, bool wait = true);
+    
+    // Copy the accumulation buffer as of every pass submitted so far, for screenshots and
+    // final saves: queued older readbacks are dropped and a fresh one is waited on
+    bool read_latest_accumulation(Image& image);
     
     // Update camera without full scene reload
     void update_camera(const Camera& camera);
+    
+    // Bracket GPU work for a stage with timestamp queries. If the stage's next slot is
+    // still waiting on the GPU the measurement is skipped rather than stalling.
+    void begin_gpu_timer(GPUStage stage);
+    void end_gpu_timer(GPUStage stage);
+    
+    // Gather finished timer results (and feed them to the profiler); wait = true drains all
+    void collect_gpu_timers(bool wait = false);
+    
+    double gpu_time_ms(GPUStage stage) const { return stage_timers[static_cast<int>(stage)].average_ms; }
+    double gpu_last_ms(GPUStage stage) const { return stage_timers[static_cast<int>(stage)].last_ms; }
+    double gpu_total_ms(GPUStage stage) const { return stage_timers[static_cast<int>(stage)].total_ms; }
+    int gpu_timer_samples(GPUStage stage) const { return stage_timers[static_cast<int>(stage)].samples; }
+    
+    // Copy the GPU ray counters accumulated since the last reset (blocks until queued passes
+    // finish). Returns false when the build has no ENABLE_RAY_STATS.
+    bool read_ray_stats(RayStats::Snapshot& stats, bool reset = true);
 };
@@ -26,12 +26,29 @@ public:
         return Color(0, 0, 0);
     }
     
-    void save_ppm(const std::string& filename) const;
+    // Binary writers: pixels are converted into one contiguous buffer and written with a single call.
+    // Image rows are indexed bottom-up (y = 0 is the bottom row, matching the camera's lower-left
+    // origin); each writer emits rows in the order its format expects.
+    bool save_ppm(const std::string& filename, bool apply_tone_map = true) const;   // 8-bit binary P6
+    bool save_pfm(const std::string& filename, bool apply_tone_map = false) const;  // 32-bit float RGB PFM
+    bool save_png(const std::string& filename, bool apply_tone_map = true) const;   // 8-bit RGB PNG
+    bool save_exr(const std::string& filename) const;  // Tiled half-float OpenEXR, ZIP compressed, linear
+    
+    // Picks the writer from the file extension; HDR formats (pfm, exr) are always written linear
+    bool save(const std::string& filename, bool apply_tone_map = true) const;
+    static bool is_supported_extension(const std::string& extension);
     
     int get_width() const { return width; }
     int get_height() const { return height; }
     
+    // Contiguous bottom-up row storage for bulk transfers
+    Color* data() noexcept { return pixels.data(); }
+    const Color* data() const noexcept { return pixels.data(); }
+    
     // Tone mapping and gamma correction
     static Color tone_map(const Color& hdr_color);
     static int clamp_to_byte(float value);
+    
+private:
+    static bool write_file(const std::string& filename, const std::vector<unsigned char>& data);
 };
@@ -13,6 +13,7 @@
 #define GLFW_KEY_LEFT_SHIFT 340
 #define GLFW_KEY_ESCAPE 256
 #define GLFW_KEY_F1 290
+#define GLFW_KEY_N 78
 #define GLFW_KEY_UP 265
 #define GLFW_KEY_DOWN 264
 #define GLFW_KEY_LEFT 263
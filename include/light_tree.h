@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+#include "light.h"
+#include <memory>
+#include <vector>
+
+// Binary hierarchy over point and spot lights, used by the compute shader to pick a few
+// lights per shading point in proportion to their estimated contribution instead of
+// shadow-testing every light. Built on the CPU and uploaded next to the light buffer.
+class LightTree {
+public:
+    // std430 layout, mirrored by the shader's LightNode. Nodes are stored depth-first with
+    // the root at index 0; leaves have light_index >= 0 and no children.
+    struct alignas(16) Node {
+        Vec3 bounds_min;
+        float energy;        // Summed luminance of the lights below this node
+        Vec3 bounds_max;
+        int light_index;     // Index into the light array for leaves, -1 for inner nodes
+        int left;
+        int right;
+        int _padding[2];
+    };
+    static_assert(sizeof(Node) == 48, "LightTree::Node must match the shader's std430 LightNode layout");
+
+    // Point and spot lights (GPU types 0 and 1) with non-zero intensity become leaves; area
+    // plane lights, uploaded as directional (type 2), are skipped and the shader evaluates them
+    // directly. Leaf indices refer to positions in lights.
+    void build(const std::vector<std::shared_ptr<Light>>& lights);
+
+    const std::vector<Node>& nodes() const noexcept { return nodes_; }
+    size_t light_count() const noexcept { return nodes_.empty() ? 0 : (nodes_.size() + 1) / 2; }
+
+private:
+    struct Entry {
+        Vec3 position;
+        float energy;
+        int light_index;
+    };
+
+    std::vector<Node> nodes_;
+
+    int build_recursive(std::vector<Entry>& entries, int start, int end);
+};
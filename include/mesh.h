@@ -0,0 +1,50 @@
+#pragma once
+#include "common.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Immutable triangle mesh parsed from an OBJ file.
+// Every load_obj reference to the same file shares one Mesh; only the
+// material binding (see MeshInstance) differs between references.
+struct Mesh {
+    std::vector<Vec3> vertices;
+    std::vector<std::array<int, 3>> triangles;  // Indices into vertices
+    Vec3 min_bounds{1000000.0f, 1000000.0f, 1000000.0f};
+    Vec3 max_bounds{-1000000.0f, -1000000.0f, -1000000.0f};
+};
+
+// A placement of a shared mesh in the scene with its own material and translation
+struct MeshInstance {
+    std::shared_ptr<const Mesh> mesh;
+    int material_id;
+    Vec3 offset;
+};
+
+// Parse-time mesh cache keyed by canonical path and file content hash.
+// A file is only re-parsed when it has not been seen before or its contents changed.
+class MeshCache {
+private:
+    struct Entry {
+        uint64_t content_hash;
+        std::shared_ptr<const Mesh> mesh;
+    };
+
+    std::unordered_map<std::string, Entry> entries_;
+    size_t hit_count_ = 0;
+
+public:
+    // Returns the cached mesh for this path if its content hash still matches, nullptr otherwise
+    std::shared_ptr<const Mesh> find(const std::string& canonical_path, uint64_t content_hash);
+    void insert(const std::string& canonical_path, uint64_t content_hash, std::shared_ptr<const Mesh> mesh);
+    void clear() { entries_.clear(); hit_count_ = 0; }
+
+    size_t size() const noexcept { return entries_.size(); }
+    size_t hit_count() const noexcept { return hit_count_; }
+
+    static std::string canonical_path(const std::string& filename);
+    static uint64_t hash_contents(const std::string& data) noexcept;  // 64-bit FNV-1a
+};
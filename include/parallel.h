@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Minimal fork-join helpers for CPU-side work (image encoding, scene processing)
+namespace Parallel {
+    inline int thread_count() noexcept {
+        const unsigned int hw = std::thread::hardware_concurrency();
+        return hw > 0 ? static_cast<int>(hw) : 1;
+    }
+
+    // Runs body(i) for every i in [0, count) across worker threads.
+    // Work items are claimed dynamically so uneven items balance out.
+    inline void parallel_for(int count, const std::function<void(int)>& body, int max_threads = 0) {
+        if (count <= 0) return;
+
+        int workers = std::min(count, max_threads > 0 ? max_threads : thread_count());
+        if (workers <= 1) {
+            for (int i = 0; i < count; ++i) body(i);
+            return;
+        }
+
+        std::atomic<int> next_index{0};
+        auto worker = [&]() {
+            for (int i = next_index.fetch_add(1); i < count; i = next_index.fetch_add(1)) {
+                body(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(workers - 1);
+        for (int t = 0; t < workers - 1; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker();  // The calling thread participates too
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "scene.h"
+#include "mesh.h"
 #include <string>
 #include <vector>
 #include <sstream>
@@ -22,7 +23,8 @@ public:
     
 private:
     static bool parse_obj_file(const std::string& filename, Scene& scene);
-    static bool parse_obj_file_with_material(const std::string& filename, Scene& scene, int material_id, bool setup_camera = false);
+    static bool parse_obj_file_with_material(const std::string& filename, Scene& scene, int material_id,
+                                             MeshCache& mesh_cache, const Vec3& offset, bool setup_camera = false);
     static bool parse_scene_description_file(const std::string& filename, Scene& scene);
     static Vec3 parse_vec3(const std::string& line);
     static Color parse_color(const std::string& line);
@@ -30,11 +32,13 @@ private:
     // Helper functions for OBJ parsing
     static std::string strip_comments(const std::string& line);
     static std::vector<int> parse_face_indices(std::istringstream& iss);
+    static std::shared_ptr<const Mesh> load_obj_mesh(const std::string& filename, MeshCache& mesh_cache);
+    static std::shared_ptr<const Mesh> parse_obj_mesh(const std::string& contents);
     static void triangulate_face(const std::vector<int>& face_indices, 
-                                const std::vector<Vec3>& vertices,
-                                Scene& scene, 
-                                int material_id, 
+                                Mesh& mesh, 
                                 FaceStatistics& stats);
+    static void add_mesh_to_scene(const std::shared_ptr<const Mesh>& mesh, Scene& scene, int material_id,
+                                  const Vec3& offset);
     static void update_bounds(const Vec3& vertex, Vec3& min_bounds, Vec3& max_bounds);
     static void setup_camera_from_bounds(Scene& scene, const Vec3& min_bounds, const Vec3& max_bounds);
 };
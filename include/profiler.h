@@ -1,56 +1,207 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+    #define PROFILER_HAS_TSC 1
+#endif
+
+// Thread-safe scope profiler.
+// Scope names are interned once per call site into small integer IDs. Each thread records
+// into its own fixed-size slot array (single writer, relaxed atomics, no locks or allocation
+// on the hot path); per-thread data is only merged when results are printed.
+// With the timeline enabled, every scope is also kept as an individual event and can be
+// exported as Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev).
+// GPU timings (from GL timestamp queries) go to a separate track recorded in nanoseconds.
 class PerformanceProfiler {
+public:
+    using ScopeId = uint32_t;
+    static constexpr ScopeId MAX_SCOPES = 256;
+    static constexpr ScopeId INVALID_SCOPE = MAX_SCOPES;
+
 private:
-    struct ProfileData {
-        double total_time = 0.0;
-        size_t call_count = 0;
-        double min_time = std::numeric_limits<double>::max();
-        double max_time = 0.0;
+    // Aggregate for one scope on one thread, in raw clock ticks.
+    // Only the owning thread writes; print_results may read concurrently.
+    struct ScopeSlot {
+        std::atomic<uint64_t> call_count{0};
+        std::atomic<uint64_t> total_ticks{0};
+        std::atomic<uint64_t> min_ticks{UINT64_MAX};
+        std::atomic<uint64_t> max_ticks{0};
+    };
+
+    struct TraceEvent {
+        uint64_t start_ticks;
+        uint64_t end_ticks;
+        ScopeId id;
+        uint32_t thread_index;  // Trace "tid"; a pooled buffer holds events of several threads
+    };
+    static constexpr size_t EVENTS_PER_CHUNK = 4096;
+    using EventChunk = std::array<TraceEvent, EVENTS_PER_CHUNK>;
+
+    struct ThreadBuffer {
+        std::array<ScopeSlot, MAX_SCOPES> slots;
+        // Timeline events. Only the owning thread appends; chunks are added under the
+        // registry mutex and event_count is published last, so a writer of the trace can
+        // read everything below event_count while recording continues.
+        std::vector<std::unique_ptr<EventChunk>> event_chunks;
+        std::atomic<size_t> event_count{0};
+        uint32_t thread_index = 0;  // Trace "tid" of the thread holding the buffer, never reused
+        bool gpu_track = false;     // Times are GPU nanoseconds rather than CPU ticks
+        // Open start_timer() calls, innermost last
+        std::array<uint64_t, 64> open_starts{};
+        std::array<ScopeId, 64> open_ids{};
+        int open_depth = 0;
+    };
+
+    // Returns the buffer to the pool when its thread exits, so short-lived worker threads
+    // reuse buffers (and keep their data) instead of growing the list; each new thread
+    // still gets its own trace tid
+    struct ThreadBufferLease {
+        ThreadBuffer* buffer = nullptr;
+        ~ThreadBufferLease();
     };
-    
-    std::unordered_map<std::string, ProfileData> profiles_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> scope_names_;
+    std::unordered_map<std::string, ScopeId> scope_ids_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::vector<ThreadBuffer*> free_buffers_;
+    uint32_t next_thread_index_ = 0;  // Next trace tid, under mutex_
+    std::atomic<bool> timeline_enabled_{false};
+
+    // GPU track, written only from the thread that owns the GL context
+    ThreadBuffer* gpu_buffer_ = nullptr;
+    uint64_t gpu_sync_ns_ = 0;     // GL_TIMESTAMP and CPU ticks sampled at the same moment
+    uint64_t gpu_sync_ticks_ = 0;
+
+    std::chrono::steady_clock::time_point calibration_time_;
+    uint64_t calibration_ticks_;
+
     static PerformanceProfiler instance_;
-    
+
+    PerformanceProfiler();
+
+    ThreadBuffer* acquire_buffer();
+    void release_buffer(ThreadBuffer* buffer);
+    double ticks_per_ms() const;
+    static void append_event(ThreadBuffer& buffer, ScopeId id, uint64_t start_ticks, uint64_t end_ticks);
+
+    static ThreadBuffer& thread_buffer() {
+        thread_local ThreadBufferLease lease;
+        if (!lease.buffer) {
+            lease.buffer = instance_.acquire_buffer();
+        }
+        return *lease.buffer;
+    }
+
 public:
     static PerformanceProfiler& get_instance() { return instance_; }
-    
-    void start_timer(const std::string& name);
-    void end_timer(const std::string& name);
+
+    PerformanceProfiler(const PerformanceProfiler&) = delete;
+    PerformanceProfiler& operator=(const PerformanceProfiler&) = delete;
+
+    // Maps a scope name to its ID, registering it on first use. Takes a lock, so call it
+    // once per call site (PROFILE_SCOPE caches the result in a function-local static).
+    ScopeId intern(const std::string& name);
+
+    // Raw timestamp: the TSC where available, otherwise steady_clock nanoseconds
+    static uint64_t now_ticks() noexcept {
+#ifdef PROFILER_HAS_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    static void record(ScopeId id, uint64_t start_ticks, uint64_t end_ticks) noexcept {
+        record_into(thread_buffer(), id, start_ticks, end_ticks);
+    }
+
+    static void record_into(ThreadBuffer& buffer, ScopeId id, uint64_t start_ticks, uint64_t end_ticks) noexcept {
+        if (id >= MAX_SCOPES) return;
+        const uint64_t elapsed = end_ticks - start_ticks;
+        ScopeSlot& slot = buffer.slots[id];
+        // Single writer: plain load/store pairs instead of read-modify-write instructions
+        slot.call_count.store(slot.call_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        slot.total_ticks.store(slot.total_ticks.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        if (elapsed < slot.min_ticks.load(std::memory_order_relaxed)) {
+            slot.min_ticks.store(elapsed, std::memory_order_relaxed);
+        }
+        if (elapsed > slot.max_ticks.load(std::memory_order_relaxed)) {
+            slot.max_ticks.store(elapsed, std::memory_order_relaxed);
+        }
+        if (instance_.timeline_enabled_.load(std::memory_order_relaxed)) {
+            append_event(buffer, id, start_ticks, end_ticks);
+        }
+    }
+
+    // GPU track. sync_gpu_clock pairs a GL_TIMESTAMP value with the current CPU time so GPU
+    // spans line up with CPU scopes in the trace; record_gpu takes GL_TIMESTAMP nanoseconds.
+    // Both must be called from the GL context thread.
+    void sync_gpu_clock(uint64_t gpu_timestamp_ns);
+    void record_gpu(ScopeId id, uint64_t start_ns, uint64_t end_ns) noexcept {
+        if (gpu_buffer_) record_into(*gpu_buffer_, id, start_ns, end_ns);
+    }
+
+    // Manual timing for spans that do not map onto a C++ scope; calls must nest per thread
+    void start_timer(ScopeId id);
+    void end_timer(ScopeId id);
+
+    // Merges every thread's slots and logs per-scope totals
     void print_results() const;
+    // Clears recorded timings and events (scope IDs stay valid); intended for when no scopes are open
     void reset();
-    
+
+    // Timeline mode: keep every scope as a complete event in addition to the aggregates
+    void set_timeline_enabled(bool enabled) { timeline_enabled_.store(enabled, std::memory_order_relaxed); }
+    bool is_timeline_enabled() const { return timeline_enabled_.load(std::memory_order_relaxed); }
+
+    // Writes the recorded timeline as Chrome Trace Event JSON (one "X" event per scope,
+    // one tid per profiler thread buffer; nesting follows from the timestamps)
+    bool write_chrome_trace(const std::string& filename) const;
+
     // RAII timer class for automatic profiling
     class ScopedTimer {
     private:
-        std::string name_;
-        std::chrono::high_resolution_clock::time_point start_time_;
-        
+        ScopeId id_;
+        uint64_t start_ticks_;
+
     public:
-        explicit ScopedTimer(const std::string& name) 
-            : name_(name), start_time_(std::chrono::high_resolution_clock::now()) {}
-            
+        explicit ScopedTimer(ScopeId id) noexcept
+            : id_(id), start_ticks_(PerformanceProfiler::now_ticks()) {}
+
         ~ScopedTimer() {
-            auto end_time = std::chrono::high_resolution_clock::now();
-            double duration = std::chrono::duration<double, std::milli>(end_time - start_time_).count();
-            
-            auto& profiler = PerformanceProfiler::get_instance();
-            auto& data = profiler.profiles_[name_];
-            data.total_time += duration;
-            data.call_count++;
-            data.min_time = std::min(data.min_time, duration);
-            data.max_time = std::max(data.max_time, duration);
+            PerformanceProfiler::record(id_, start_ticks_, PerformanceProfiler::now_ticks());
         }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
     };
 };
 
-// Macro for easy profiling
+// Macro for easy profiling. The name is interned once per call site.
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
 #ifdef ENABLE_PROFILING
-    #define PROFILE_SCOPE(name) PerformanceProfiler::ScopedTimer _timer(name)
-    #define PROFILE_FUNCTION() PerformanceProfiler::ScopedTimer _timer(__FUNCTION__)
+    #define PROFILE_SCOPE(name) \
+        static const PerformanceProfiler::ScopeId PROFILE_CONCAT(_profile_id_, __LINE__) = \
+            PerformanceProfiler::get_instance().intern(name); \
+        PerformanceProfiler::ScopedTimer PROFILE_CONCAT(_profile_timer_, __LINE__)(PROFILE_CONCAT(_profile_id_, __LINE__))
+    #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
 #else
     #define PROFILE_SCOPE(name)
     #define PROFILE_FUNCTION()
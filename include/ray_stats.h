@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Optional traversal counters, compiled in with ENABLE_RAY_STATS.
+// CPU code counts through RAY_STAT() into per-thread blocks (single writer, no locking);
+// the GPU kernel keeps the same counters in an SSBO (see GPURayTracer::read_ray_stats).
+namespace RayStats {
+    // Indices are shared with the compute shader's RAY_STAT_* defines
+    enum Counter : int {
+        RayCasts = 0,       // Closest-hit / occlusion queries of any kind
+        PrimaryRays,
+        SecondaryRays,
+        ShadowRays,
+        BVHNodeVisits,
+        SphereTests,
+        TriangleTests,
+        CylinderTests,
+        PlaneTests,
+        COUNTER_COUNT
+    };
+
+    // Bin i counts paths that ended after i bounces; the last bin also takes longer paths
+    constexpr int PATH_LENGTH_BINS = 16;
+
+    struct Snapshot {
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+        std::array<uint64_t, PATH_LENGTH_BINS> path_lengths{};
+
+        uint64_t operator[](Counter counter) const { return counters[counter]; }
+        Snapshot& operator+=(const Snapshot& other);
+    };
+
+    // Per-thread counter block; counts from exited threads are kept
+    struct ThreadCounters {
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+        std::array<std::atomic<uint64_t>, PATH_LENGTH_BINS> path_lengths{};
+    };
+
+    ThreadCounters& thread_counters();
+
+    inline void count(Counter counter, uint64_t amount = 1) noexcept {
+        auto& value = thread_counters().counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    inline void count_path_length(int bounces) noexcept {
+        const int bin = bounces < 0 ? 0 : (bounces >= PATH_LENGTH_BINS ? PATH_LENGTH_BINS - 1 : bounces);
+        auto& value = thread_counters().path_lengths[bin];
+        value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Sum of every thread's CPU counters
+    Snapshot collect_cpu();
+    void reset_cpu();
+
+    // Logs counters, Mrays/s (from RayCasts over seconds) and the path length histogram
+    void log_report(const std::string& label, const Snapshot& stats, double seconds);
+}
+
+#ifdef ENABLE_RAY_STATS
+    #define RAY_STAT(counter) RayStats::count(RayStats::counter)
+    #define RAY_STAT_PATH_LENGTH(bounces) RayStats::count_path_length(bounces)
+#else
+    #define RAY_STAT(counter)
+    #define RAY_STAT_PATH_LENGTH(bounces)
+#endif
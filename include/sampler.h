@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sample generators shared by the compute shader and host code. The shader carries a GLSL
+// copy of the same hashes and dimension mapping, so Sampler reproduces what the GPU draws.
+namespace Sampling {
+    enum class Type {
+        RANDOM = 0,       // Independent xorshift numbers per dimension (the original sampler)
+        SOBOL = 1,        // Owen-scrambled Sobol (hash-based, Burley 2020), reshuffled per pixel
+        BLUE_NOISE = 2    // Kronecker (R2) sequence, Cranley-Patterson rotated per pixel by a blue-noise tile
+    };
+
+    constexpr int BLUE_NOISE_SIZE = 64;  // The tile is BLUE_NOISE_SIZE^2 and wraps over the screen
+
+    const char* type_to_string(Type type) noexcept;
+    bool parse_type(const std::string& name, Type& type);
+
+    uint32_t pcg_hash(uint32_t seed) noexcept;
+    uint32_t hash_combine(uint32_t seed, uint32_t value) noexcept;
+    uint32_t reverse_bits(uint32_t x) noexcept;
+    // Owen scrambling of a 32-bit fixed-point value: each bit is flipped by a hash of the bits above it
+    uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept;
+    // Second Sobol dimension in 32-bit fixed point; the first is reverse_bits(index)
+    uint32_t sobol_dim1(uint32_t index) noexcept;
+    // Top 24 bits as a float in [0, 1)
+    float to_unit_float(uint32_t x) noexcept;
+
+    // Blue-noise threshold map from void-and-cluster, as ranks (r + 0.5) / size^2 in row-major
+    // order. Deterministic for a given size and seed.
+    std::vector<float> generate_blue_noise(int size, uint32_t seed = 1);
+    // The BLUE_NOISE_SIZE tile uploaded to the GPU, generated on first use
+    const std::vector<float>& blue_noise_tile();
+}
+
+// Host-side sampler with the shader's per-pixel seeding and dimension mapping: sample i of
+// pixel (x, y) yields the same values for the same dimension on both sides.
+class Sampler {
+public:
+    explicit Sampler(Sampling::Type type) noexcept : type_(type) {}
+
+    void start_pixel_sample(uint32_t x, uint32_t y, uint32_t sample_index) noexcept;
+
+    // A 2D sample occupies dimensions d and d + 1
+    float get_1d(uint32_t dimension) const noexcept;
+    void get_2d(uint32_t dimension, float& u, float& v) const noexcept;
+
+    Sampling::Type type() const noexcept { return type_; }
+
+private:
+    Sampling::Type type_;
+    uint32_t pixel_x_ = 0;
+    uint32_t pixel_y_ = 0;
+    uint32_t pixel_seed_ = 0;
+    uint32_t sample_index_ = 0;
+
+    float blue_noise_mask(uint32_t dimension) const noexcept;
+};
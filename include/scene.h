@@ -5,6 +5,9 @@
 #include "light.h"
 #include "camera.h"
 #include "bvh.h"
+#include "mesh.h"
+#include "ray_stats.h"
+#include "arena.h"
 #include <vector>
 #include <memory>
 
@@ -13,16 +16,32 @@ public:
     std::vector<std::shared_ptr<Geometry>> objects;
     std::vector<std::shared_ptr<Material>> materials;
     std::vector<std::shared_ptr<Light>> lights;  // Added lights collection
+    std::vector<MeshInstance> mesh_instances;     // Shared OBJ meshes and their material bindings
     std::unique_ptr<BVH> bvh;
     Camera camera;
     Color background_color;
     Color ambient_light;  // Added ambient lighting
+    // Primitive storage, owned by the scene. Declared last so move assignment replaces the
+    // primitives and BVH before the arena they live in; the destructor releases them first.
+    std::unique_ptr<MemoryArena> arena = std::make_unique<MemoryArena>();
     
     Scene() : camera(Vec3(0, 0, 0), Vec3(0, 0, -1), Vec3(0, 1, 0), 45.0f, 16.0f/9.0f),
               background_color(Color(0.5f, 0.7f, 1.0f)), ambient_light(Color(0.1f, 0.1f, 0.1f)) {}
+    ~Scene() {
+        bvh.reset();
+        objects.clear();
+    }
+    Scene(Scene&&) = default;
+    Scene& operator=(Scene&&) = default;
     
     void add_object(std::shared_ptr<Geometry> obj) {
-        objects.push_back(obj);
+        objects.push_back(std::move(obj));
+    }
+    
+    // Allocates a primitive (and its shared_ptr control block) from the scene arena
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_object(Args&&... args) {
+        return std::allocate_shared<T>(ArenaAllocator<T>(arena.get()), std::forward<Args>(args)...);
     }
     
     void add_material(std::shared_ptr<Material> mat) {
@@ -33,6 +52,10 @@ public:
         lights.push_back(light);
     }
     
+    void add_mesh_instance(std::shared_ptr<const Mesh> mesh, int material_id, const Vec3& offset = Vec3(0, 0, 0)) {
+        mesh_instances.push_back(MeshInstance{std::move(mesh), material_id, offset});
+    }
+    
     void build_acceleration_structure() {
         if (!objects.empty()) {
             bvh = std::make_unique<BVH>(objects);
@@ -45,6 +68,7 @@ public:
         }
         
         // Fallback: brute force
+        RAY_STAT(RayCasts);
         HitRecord temp_rec;
         bool hit_anything = false;
         float closest_so_far = t_max;
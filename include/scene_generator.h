@@ -0,0 +1,35 @@
+#pragma once
+#include "scene.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Procedural scenes for scaling tests (build and trace time against primitive count).
+// Every pattern is deterministic for a given seed, and write_scene_file produces files
+// that parse back into the same scene generate() builds in memory.
+namespace SceneGenerator {
+    enum class Pattern {
+        SPHERE_FIELD,       // Non-overlapping spheres on a jittered grid, mixed materials
+        TESSELLATED_MESH,   // One finely tessellated, displaced torus
+        INSTANCED_GRID      // A small torus mesh placed on a grid, one material per copy
+    };
+
+    struct Options {
+        Pattern pattern = Pattern::SPHERE_FIELD;
+        size_t primitive_count = 10000;  // Sphere fields match exactly; meshes get the nearest tessellation
+        uint32_t seed = 1;
+        float aspect_ratio = 16.0f / 9.0f;
+    };
+
+    const char* pattern_to_string(Pattern pattern) noexcept;
+    bool parse_pattern(const std::string& name, Pattern& pattern);
+    // Accepts plain integers and k/M suffixes ("250k", "10M")
+    bool parse_count(const std::string& text, size_t& count);
+
+    // Replaces the contents of scene with the generated one (acceleration structure not built)
+    bool generate(const Options& options, Scene& scene);
+
+    // Writes a .scene file; mesh patterns also write their OBJ next to it (same stem, .obj),
+    // referenced by load_obj with the path as given here, so parse from the same working directory
+    bool write_scene_file(const Options& options, const std::string& scene_path);
+}
@@ -14,6 +14,8 @@ public:
     
     // Built-in shaders as strings to avoid file dependencies
     static const char* get_raytracing_compute_shader();
+    static const char* get_adaptive_sampling_compute_shader();
+    static const char* get_denoise_compute_shader();
     static const char* get_display_vertex_shader();
     static const char* get_display_fragment_shader();
 };
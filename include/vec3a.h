@@ -0,0 +1,145 @@
+#pragma once
+#include "common.h"
+
+// 16-byte aligned 3-vector for the CPU hot paths (BVH node bounds and slab tests).
+// Backed by one __m128 where SSE is available (the fourth lane is kept at zero by every
+// constructor and operation that feeds dot/length), with a plain scalar fallback otherwise.
+// Unlike Vec3, division does not guard against zero. Vec3 stays the type for parsing,
+// scene data and I/O; convert at the boundary with Vec3A(const Vec3&) / to_vec3().
+struct alignas(16) Vec3A {
+#ifdef RAYTRACER_SSE
+    __m128 v;
+
+    Vec3A() noexcept : v(_mm_setzero_ps()) {}
+    explicit Vec3A(__m128 m) noexcept : v(m) {}
+    Vec3A(float x, float y, float z) noexcept : v(_mm_setr_ps(x, y, z, 0.0f)) {}
+    explicit Vec3A(float s) noexcept : v(_mm_setr_ps(s, s, s, 0.0f)) {}
+    explicit Vec3A(const Vec3& a) noexcept : v(_mm_setr_ps(a.x, a.y, a.z, 0.0f)) {}
+
+    float x() const noexcept { return _mm_cvtss_f32(v); }
+    float y() const noexcept { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+    float z() const noexcept { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))); }
+    Vec3 to_vec3() const noexcept {
+        alignas(16) float f[4];
+        _mm_store_ps(f, v);
+        return Vec3(f[0], f[1], f[2]);
+    }
+
+    Vec3A operator+(const Vec3A& b) const noexcept { return Vec3A(_mm_add_ps(v, b.v)); }
+    Vec3A operator-(const Vec3A& b) const noexcept { return Vec3A(_mm_sub_ps(v, b.v)); }
+    Vec3A operator*(const Vec3A& b) const noexcept { return Vec3A(_mm_mul_ps(v, b.v)); }
+    Vec3A operator*(float t) const noexcept { return Vec3A(_mm_mul_ps(v, _mm_set1_ps(t))); }
+    Vec3A operator/(float t) const noexcept { return *this * (1.0f / t); }
+    Vec3A operator-() const noexcept { return Vec3A(_mm_sub_ps(_mm_setzero_ps(), v)); }
+
+    float dot(const Vec3A& b) const noexcept {
+        // Shuffle/add rather than dpps, which is slower on most cores for a single dot
+        const __m128 m = _mm_mul_ps(v, b.v);
+        const __m128 yz = _mm_add_ss(_mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)),
+                                     _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+        return _mm_cvtss_f32(_mm_add_ss(m, yz));
+    }
+
+    Vec3A cross(const Vec3A& b) const noexcept {
+        // (a * b.yzx - a.yzx * b).yzx: three shuffles instead of four
+        const __m128 a_yzx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 c = _mm_sub_ps(_mm_mul_ps(v, b_yzx), _mm_mul_ps(a_yzx, b.v));
+        return Vec3A(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+    }
+
+    // Componentwise 1/v (exact division; the w lane stays zero)
+    Vec3A reciprocal() const noexcept {
+        return Vec3A(_mm_div_ps(_mm_setr_ps(1.0f, 1.0f, 1.0f, 0.0f),
+                                _mm_or_ps(v, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f))));
+    }
+
+    static Vec3A min(const Vec3A& a, const Vec3A& b) noexcept { return Vec3A(_mm_min_ps(a.v, b.v)); }
+    static Vec3A max(const Vec3A& a, const Vec3A& b) noexcept { return Vec3A(_mm_max_ps(a.v, b.v)); }
+
+    // a * b + c, fused where the target has FMA
+    static Vec3A mul_add(const Vec3A& a, const Vec3A& b, const Vec3A& c) noexcept {
+    #ifdef __FMA__
+        return Vec3A(_mm_fmadd_ps(a.v, b.v, c.v));
+    #else
+        return Vec3A(_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v));
+    #endif
+    }
+
+    // a * b - c, fused where the target has FMA
+    static Vec3A mul_sub(const Vec3A& a, const Vec3A& b, const Vec3A& c) noexcept {
+    #ifdef __FMA__
+        return Vec3A(_mm_fmsub_ps(a.v, b.v, c.v));
+    #else
+        return Vec3A(_mm_sub_ps(_mm_mul_ps(a.v, b.v), c.v));
+    #endif
+    }
+
+    // Largest / smallest of x, y, z
+    float max_component() const noexcept {
+        const __m128 m = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)));
+        return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))));
+    }
+    float min_component() const noexcept {
+        const __m128 m = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)));
+        return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2))));
+    }
+#else
+    float vx, vy, vz, vw;
+
+    Vec3A() noexcept : vx(0), vy(0), vz(0), vw(0) {}
+    Vec3A(float x, float y, float z) noexcept : vx(x), vy(y), vz(z), vw(0) {}
+    explicit Vec3A(float s) noexcept : vx(s), vy(s), vz(s), vw(0) {}
+    explicit Vec3A(const Vec3& a) noexcept : vx(a.x), vy(a.y), vz(a.z), vw(0) {}
+
+    float x() const noexcept { return vx; }
+    float y() const noexcept { return vy; }
+    float z() const noexcept { return vz; }
+    Vec3 to_vec3() const noexcept { return Vec3(vx, vy, vz); }
+
+    Vec3A operator+(const Vec3A& b) const noexcept { return Vec3A(vx + b.vx, vy + b.vy, vz + b.vz); }
+    Vec3A operator-(const Vec3A& b) const noexcept { return Vec3A(vx - b.vx, vy - b.vy, vz - b.vz); }
+    Vec3A operator*(const Vec3A& b) const noexcept { return Vec3A(vx * b.vx, vy * b.vy, vz * b.vz); }
+    Vec3A operator*(float t) const noexcept { return Vec3A(vx * t, vy * t, vz * t); }
+    Vec3A operator/(float t) const noexcept { return *this * (1.0f / t); }
+    Vec3A operator-() const noexcept { return Vec3A(-vx, -vy, -vz); }
+
+    float dot(const Vec3A& b) const noexcept { return vx * b.vx + vy * b.vy + vz * b.vz; }
+    Vec3A cross(const Vec3A& b) const noexcept {
+        return Vec3A(vy * b.vz - vz * b.vy, vz * b.vx - vx * b.vz, vx * b.vy - vy * b.vx);
+    }
+    Vec3A reciprocal() const noexcept { return Vec3A(1.0f / vx, 1.0f / vy, 1.0f / vz); }
+
+    static Vec3A min(const Vec3A& a, const Vec3A& b) noexcept {
+        return Vec3A(std::min(a.vx, b.vx), std::min(a.vy, b.vy), std::min(a.vz, b.vz));
+    }
+    static Vec3A max(const Vec3A& a, const Vec3A& b) noexcept {
+        return Vec3A(std::max(a.vx, b.vx), std::max(a.vy, b.vy), std::max(a.vz, b.vz));
+    }
+    static Vec3A mul_add(const Vec3A& a, const Vec3A& b, const Vec3A& c) noexcept { return a * b + c; }
+    static Vec3A mul_sub(const Vec3A& a, const Vec3A& b, const Vec3A& c) noexcept { return a * b - c; }
+
+    float max_component() const noexcept { return std::max({vx, vy, vz}); }
+    float min_component() const noexcept { return std::min({vx, vy, vz}); }
+#endif
+
+    Vec3A& operator+=(const Vec3A& b) noexcept { return *this = *this + b; }
+    Vec3A& operator-=(const Vec3A& b) noexcept { return *this = *this - b; }
+    Vec3A& operator*=(float t) noexcept { return *this = *this * t; }
+
+    float length_squared() const noexcept { return dot(*this); }
+    float length() const noexcept { return std::sqrt(length_squared()); }
+
+    // Uses the approximate reciprocal square root; zero-length vectors stay zero
+    Vec3A normalize() const noexcept { return *this * Math::fast_inv_sqrt(length_squared()); }
+
+    static const char* backend_name() noexcept {
+#ifdef RAYTRACER_SSE
+        return "sse";
+#else
+        return "scalar";
+#endif
+    }
+};
+
+inline Vec3A operator*(float t, const Vec3A& v) noexcept { return v * t; }
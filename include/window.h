@@ -2,6 +2,7 @@
 #include "common.h"
 #include "scene.h"
 #include "gpu_raytracer.h"
+#include "frame_budget.h"
 #include <string>
 #include <functional>
 #include <memory>
@@ -18,9 +19,18 @@ private:
     
     std::unique_ptr<GPURayTracer> gpu_raytracer;
     
+    // Dynamic resolution: the ray tracer traces a fraction of the window size chosen by
+    // frame_budget into its window-sized images and the display pass upscales that part
+    std::unique_ptr<FrameBudget> frame_budget;
+    bool camera_moving = false;       // Camera changed since the last rendered frame
+    int frame_samples = 0;            // Samples per pixel of the last rendered frame
+    
+    void apply_render_scale(float scale);
+    
     // Mouse capture state
     bool mouse_captured = false;
     bool show_detailed_stats = false; // Toggle for detailed performance stats
+    double mrays_per_second = -1.0;   // From GPU ray counters; negative when unavailable
     
     // Callbacks
     std::function<void(int, int, int, int)> key_callback;
@@ -55,9 +65,23 @@ public:
     // Mouse control
     void toggle_mouse_capture();
     void update_fps_display(float fps, float frame_time);
+    // Read and reset the GPU ray counters covering the last interval_seconds (ENABLE_RAY_STATS builds)
+    double update_ray_stats(double interval_seconds);
     void toggle_detailed_stats() { show_detailed_stats = !show_detailed_stats; }
     void capture_frame(const std::string& filename);  // Capture current frame to file
     void reset_accumulation() { if (gpu_raytracer) gpu_raytracer->reset_accumulation_buffer(); }  // Reset temporal accumulation
+    void camera_changed() { camera_moving = true; if (gpu_raytracer) gpu_raytracer->camera_changed(); }  // Reproject or reset accumulation
+    void set_temporal_reprojection(float blend) { if (gpu_raytracer) gpu_raytracer->set_temporal_reprojection(blend); }
+    void set_sparse_pattern(SparsePattern pattern) { if (gpu_raytracer) gpu_raytracer->set_sparse_pattern(pattern); }
+    void set_tiling(int tile_size, int tiles_per_submit) { if (gpu_raytracer) gpu_raytracer->set_tiling(tile_size, tiles_per_submit); }
+    void set_path_termination(const PathTermination& termination) { if (gpu_raytracer) gpu_raytracer->set_path_termination(termination); }
+    void set_light_samples(int samples) { if (gpu_raytracer) gpu_raytracer->set_light_samples(samples); }
+    void set_sampler(Sampling::Type type) { if (gpu_raytracer) gpu_raytracer->set_sampler(type); }
+    void set_adaptive_threshold(float threshold) { if (gpu_raytracer) gpu_raytracer->set_adaptive_threshold(threshold); }
+    void set_denoise(bool enabled) { if (gpu_raytracer) gpu_raytracer->set_denoise(enabled); }
+    bool get_denoise() const { return gpu_raytracer && gpu_raytracer->get_denoise(); }
+    // Target GPU milliseconds per frame while the camera moves; 0 renders at full size always
+    void set_frame_budget(float target_ms);
     
     // Callbacks
     void set_key_callback(std::function<void(int, int, int, int)> callback);
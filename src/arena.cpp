@@ -0,0 +1,34 @@
+#include "arena.h"
+#include <algorithm>
+
+void MemoryArena::add_block(size_t bytes) {
+    blocks_.push_back(std::unique_ptr<std::byte[]>(new std::byte[bytes]));  // Left uninitialized
+    bytes_reserved_ += bytes;
+    cursor_ = blocks_.back().get();
+    block_end_ = cursor_ + bytes;
+}
+
+void MemoryArena::reserve(size_t bytes) {
+    if (!cursor_ || static_cast<size_t>(block_end_ - cursor_) < bytes) {
+        add_block(std::max(bytes, block_size_));
+    }
+}
+
+void* MemoryArena::allocate_slow(size_t size, size_t alignment) {
+    // Oversized requests get a block of their own; the current block keeps serving small ones
+    const size_t needed = size + alignment - 1;
+    const bool dedicated = needed > block_size_ / 4;
+    const size_t block_bytes = dedicated ? needed : block_size_;
+
+    if (dedicated) {
+        blocks_.push_back(std::unique_ptr<std::byte[]>(new std::byte[block_bytes]));  // Left uninitialized
+        bytes_reserved_ += block_bytes;
+        std::byte* block = blocks_.back().get();
+        const size_t misalignment = reinterpret_cast<uintptr_t>(block) & (alignment - 1);
+        bytes_used_ += size;
+        return block + (misalignment ? alignment - misalignment : 0);
+    }
+
+    add_block(block_bytes);
+    return allocate(size, alignment);
+}
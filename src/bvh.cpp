@@ -1,61 +1,62 @@
 #include "bvh.h"
 #include "common.h"
+#include "profiler.h"
+#include "ray_stats.h"
 #include <algorithm>
 #include <random>
 #include <cmath>
 
 BVH::BVH(std::vector<std::shared_ptr<Geometry>>& objects) {
+    PROFILE_SCOPE("BVH build");
+    
     if (objects.empty()) {
         root = nullptr;
         return;
     }
     
+    // A binary tree over N leaves has 2N - 1 nodes: keep them in one block
+    node_arena.reserve((2 * objects.size() - 1) * sizeof(BVHNode) + alignof(BVHNode));
     root = build_bvh(objects, 0, static_cast<int>(objects.size()));
+    primitives = objects;  // Sorted into leaf order by the build
 }
 
-std::shared_ptr<BVHNode> BVH::build_bvh(std::vector<std::shared_ptr<Geometry>>& objects, int start, int end) {
-    auto node = std::make_shared<BVHNode>();
-    
+BVHNode* BVH::build_bvh(std::vector<std::shared_ptr<Geometry>>& objects, int start, int end) {
     // Input validation
     if (start >= end || start < 0 || end > static_cast<int>(objects.size())) {
         return nullptr;
     }
     
+    BVHNode* node = node_arena.create<BVHNode>();
+    
     // Base case: single object
     if (end - start == 1) {
-        node->geometry = objects[start];
-        node->min_bounds = node->geometry->get_min_bounds();
-        node->max_bounds = node->geometry->get_max_bounds();
+        node->geometry = objects[start].get();
+        node->min_bounds = Vec3A(node->geometry->get_min_bounds());
+        node->max_bounds = Vec3A(node->geometry->get_max_bounds());
         return node;
     }
     
-    // Calculate bounding box for all objects - use more efficient computation
-    Vec3 min_bounds(std::numeric_limits<float>::max());
-    Vec3 max_bounds(std::numeric_limits<float>::lowest());
+    // Calculate bounding box for all objects
+    Vec3A min_bounds(std::numeric_limits<float>::max());
+    Vec3A max_bounds(std::numeric_limits<float>::lowest());
     
     for (int i = start; i < end; ++i) {
-        const Vec3 obj_min = objects[i]->get_min_bounds();
-        const Vec3 obj_max = objects[i]->get_max_bounds();
-        
-        min_bounds.x = std::min(min_bounds.x, obj_min.x);
-        min_bounds.y = std::min(min_bounds.y, obj_min.y);
-        min_bounds.z = std::min(min_bounds.z, obj_min.z);
-        
-        max_bounds.x = std::max(max_bounds.x, obj_max.x);
-        max_bounds.y = std::max(max_bounds.y, obj_max.y);
-        max_bounds.z = std::max(max_bounds.z, obj_max.z);
+        min_bounds = Vec3A::min(min_bounds, Vec3A(objects[i]->get_min_bounds()));
+        max_bounds = Vec3A::max(max_bounds, Vec3A(objects[i]->get_max_bounds()));
     }
     
     node->min_bounds = min_bounds;
     node->max_bounds = max_bounds;
     
     // Find the longest axis
-    Vec3 extent = max_bounds - min_bounds;
+    Vec3 extent = (max_bounds - min_bounds).to_vec3();
     int axis = 0;
     if (extent.y > extent.x) axis = 1;
     float max_extent = (axis == 0) ? extent.x : extent.y;
     if (extent.z > max_extent) axis = 2;
     
+    node->split_axis = axis;
+    
     // Sort objects along the chosen axis
     std::sort(objects.begin() + start, objects.begin() + end,
         [axis](const std::shared_ptr<Geometry>& a, const std::shared_ptr<Geometry>& b) {
@@ -74,13 +75,32 @@ std::shared_ptr<BVHNode> BVH::build_bvh(std::vector<std::shared_ptr<Geometry>>&
     return node;
 }
 
+TraversalRay::TraversalRay(const Ray& ray) noexcept {
+    // Avoid division by zero
+    const float epsilon = 1e-8f;
+    
+    float inv_dir_x = std::abs(ray.direction.x) > epsilon ? (1.0f / ray.direction.x) : (ray.direction.x >= 0 ? 1e8f : -1e8f);
+    float inv_dir_y = std::abs(ray.direction.y) > epsilon ? (1.0f / ray.direction.y) : (ray.direction.y >= 0 ? 1e8f : -1e8f);
+    float inv_dir_z = std::abs(ray.direction.z) > epsilon ? (1.0f / ray.direction.z) : (ray.direction.z >= 0 ? 1e8f : -1e8f);
+    
+    inv_dir = Vec3A(inv_dir_x, inv_dir_y, inv_dir_z);
+    origin_inv_dir = Vec3A(ray.origin) * inv_dir;
+    dir_is_neg[0] = inv_dir_x < 0.0f;
+    dir_is_neg[1] = inv_dir_y < 0.0f;
+    dir_is_neg[2] = inv_dir_z < 0.0f;
+}
+
 bool BVH::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(RayCasts);
     if (!root) return false;
-    return hit_bvh(root, ray, t_min, t_max, rec);
+    const TraversalRay traversal(ray);
+    return hit_bvh(root, ray, traversal, t_min, t_max, rec);
 }
 
-bool BVH::hit_bvh(const std::shared_ptr<BVHNode>& node, const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
-    if (!hit_box(node->min_bounds, node->max_bounds, ray)) {
+bool BVH::hit_bvh(const BVHNode* node, const Ray& ray, const TraversalRay& traversal,
+                  float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(BVHNodeVisits);
+    if (!hit_box(node->min_bounds, node->max_bounds, traversal, t_min, t_max)) {
         return false;
     }
     
@@ -89,47 +109,28 @@ bool BVH::hit_bvh(const std::shared_ptr<BVHNode>& node, const Ray& ray, float t_
         return node->geometry->hit(ray, t_min, t_max, rec);
     }
     
-    // Internal node
-    HitRecord left_rec, right_rec;
-    bool hit_left = node->left && hit_bvh(node->left, ray, t_min, t_max, left_rec);
-    bool hit_right = node->right && hit_bvh(node->right, ray, t_min, t_max, right_rec);
-    
-    if (hit_left && hit_right) {
-        rec = (left_rec.t < right_rec.t) ? left_rec : right_rec;
-        return true;
-    } else if (hit_left) {
-        rec = left_rec;
-        return true;
-    } else if (hit_right) {
-        rec = right_rec;
-        return true;
+    // Internal node: visit the child nearer along the split axis first, then let its hit
+    // shorten the interval so the far child is culled by the slab test where possible
+    const BVHNode* near_child = node->left;
+    const BVHNode* far_child = node->right;
+    if (traversal.dir_is_neg[node->split_axis]) std::swap(near_child, far_child);
+    
+    bool hit_anything = near_child && hit_bvh(near_child, ray, traversal, t_min, t_max, rec);
+    if (far_child && hit_bvh(far_child, ray, traversal, t_min, hit_anything ? rec.t : t_max, rec)) {
+        hit_anything = true;
     }
     
-    return false;
+    return hit_anything;
 }
 
-bool BVH::hit_box(const Vec3& min_bounds, const Vec3& max_bounds, const Ray& ray) const {
-    // Avoid division by zero
-    const float epsilon = 1e-8f;
-    
-    float inv_dir_x = std::abs(ray.direction.x) > epsilon ? (1.0f / ray.direction.x) : (ray.direction.x >= 0 ? 1e8f : -1e8f);
-    float inv_dir_y = std::abs(ray.direction.y) > epsilon ? (1.0f / ray.direction.y) : (ray.direction.y >= 0 ? 1e8f : -1e8f);
-    float inv_dir_z = std::abs(ray.direction.z) > epsilon ? (1.0f / ray.direction.z) : (ray.direction.z >= 0 ? 1e8f : -1e8f);
-    
-    float t1 = (min_bounds.x - ray.origin.x) * inv_dir_x;
-    float t2 = (max_bounds.x - ray.origin.x) * inv_dir_x;
-    if (inv_dir_x < 0.0f) std::swap(t1, t2);
-    
-    float t3 = (min_bounds.y - ray.origin.y) * inv_dir_y;
-    float t4 = (max_bounds.y - ray.origin.y) * inv_dir_y;
-    if (inv_dir_y < 0.0f) std::swap(t3, t4);
-    
-    float t5 = (min_bounds.z - ray.origin.z) * inv_dir_z;
-    float t6 = (max_bounds.z - ray.origin.z) * inv_dir_z;
-    if (inv_dir_z < 0.0f) std::swap(t5, t6);
-    
-    float tmin = std::max({t1, t3, t5});
-    float tmax = std::min({t2, t4, t6});
-    
-    return tmax >= 0.0f && tmin <= tmax;
+bool BVH::hit_box(const Vec3A& min_bounds, const Vec3A& max_bounds, const TraversalRay& ray,
+                  float t_min, float t_max) {
+    // All three slabs at once with one fused multiply-subtract each; min/max order the
+    // entry and exit distances per axis, so no branches on the direction signs are needed
+    const Vec3A t0 = Vec3A::mul_sub(min_bounds, ray.inv_dir, ray.origin_inv_dir);
+    const Vec3A t1 = Vec3A::mul_sub(max_bounds, ray.inv_dir, ray.origin_inv_dir);
+    
+    float tmin = std::max(Vec3A::min(t0, t1).max_component(), t_min);
+    float tmax = std::min(Vec3A::max(t0, t1).min_component(), t_max);
+    return tmin <= tmax;
 }
@@ -0,0 +1,263 @@
+#include "compression.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <array>
+#include <algorithm>
+
+namespace {
+    constexpr int WINDOW_SIZE = 32768;
+    constexpr int WINDOW_MASK = WINDOW_SIZE - 1;
+    constexpr int HASH_BITS = 15;
+    constexpr int HASH_SIZE = 1 << HASH_BITS;
+    constexpr int MIN_MATCH = 3;
+    constexpr int MAX_MATCH = 258;
+    constexpr int MAX_CHAIN = 48;  // Hash chain depth: trades ratio for speed
+
+    constexpr uint16_t LENGTH_BASE[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    constexpr uint8_t LENGTH_EXTRA[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    constexpr uint16_t DISTANCE_BASE[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    constexpr uint8_t DISTANCE_EXTRA[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    class BitWriter {
+    private:
+        std::vector<unsigned char>& out_;
+        uint64_t bit_buffer_ = 0;
+        int bit_count_ = 0;
+
+    public:
+        explicit BitWriter(std::vector<unsigned char>& out) : out_(out) {}
+
+        // DEFLATE packs bits LSB-first
+        void write(uint32_t bits, int count) {
+            bit_buffer_ |= static_cast<uint64_t>(bits) << bit_count_;
+            bit_count_ += count;
+            while (bit_count_ >= 8) {
+                out_.push_back(static_cast<unsigned char>(bit_buffer_ & 0xFF));
+                bit_buffer_ >>= 8;
+                bit_count_ -= 8;
+            }
+        }
+
+        // Huffman codes are defined MSB-first, so they are bit-reversed before packing
+        void write_code(uint32_t code, int length) {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; ++i) {
+                reversed = (reversed << 1) | ((code >> i) & 1u);
+            }
+            write(reversed, length);
+        }
+
+        void align_to_byte() {
+            if (bit_count_ > 0) {
+                out_.push_back(static_cast<unsigned char>(bit_buffer_ & 0xFF));
+                bit_buffer_ = 0;
+                bit_count_ = 0;
+            }
+        }
+    };
+
+    // Fixed literal/length Huffman code (RFC 1951 section 3.2.6)
+    void write_literal_length(BitWriter& writer, int symbol) {
+        if (symbol <= 143) {
+            writer.write_code(0x30 + symbol, 8);
+        } else if (symbol <= 255) {
+            writer.write_code(0x190 + (symbol - 144), 9);
+        } else if (symbol <= 279) {
+            writer.write_code(symbol - 256, 7);
+        } else {
+            writer.write_code(0xC0 + (symbol - 280), 8);
+        }
+    }
+
+    void write_match(BitWriter& writer, int length, int distance) {
+        int length_code = 28;
+        while (LENGTH_BASE[length_code] > length) --length_code;
+        write_literal_length(writer, 257 + length_code);
+        writer.write(length - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+
+        int distance_code = 29;
+        while (DISTANCE_BASE[distance_code] > distance) --distance_code;
+        writer.write_code(distance_code, 5);
+        writer.write(distance - DISTANCE_BASE[distance_code], DISTANCE_EXTRA[distance_code]);
+    }
+
+    inline uint32_t hash3(const unsigned char* p) noexcept {
+        const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void write_u32_be(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    // CMF = deflate with 32K window, FLG = fastest level with a valid check value
+    constexpr unsigned char ZLIB_HEADER[2] = {0x78, 0x01};
+}
+
+namespace Compression {
+    uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc) noexcept {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler) noexcept {
+        constexpr uint32_t MOD_ADLER = 65521;
+        constexpr size_t NMAX = 5552;  // Largest block before the sums can overflow 32 bits
+
+        uint32_t a = adler & 0xFFFF;
+        uint32_t b = adler >> 16;
+        while (size > 0) {
+            const size_t block = std::min(size, NMAX);
+            for (size_t i = 0; i < block; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= MOD_ADLER;
+            b %= MOD_ADLER;
+            data += block;
+            size -= block;
+        }
+        return (b << 16) | a;
+    }
+
+    void deflate_segment(const unsigned char* data, size_t size, bool final_segment,
+                         std::vector<unsigned char>& out) {
+        BitWriter writer(out);
+        writer.write(final_segment ? 1 : 0, 1);  // BFINAL
+        writer.write(1, 2);                      // BTYPE = fixed Huffman
+
+        std::vector<int32_t> head(HASH_SIZE, -1);
+        std::vector<int32_t> prev(WINDOW_SIZE, -1);
+
+        auto insert = [&](size_t pos) -> int32_t {
+            const uint32_t h = hash3(data + pos);
+            const int32_t chain_start = head[h];
+            prev[pos & WINDOW_MASK] = chain_start;
+            head[h] = static_cast<int32_t>(pos);
+            return chain_start;
+        };
+
+        size_t pos = 0;
+        while (pos < size) {
+            int best_length = 0;
+            int best_distance = 0;
+
+            if (pos + MIN_MATCH <= size) {
+                const int max_length = static_cast<int>(std::min<size_t>(MAX_MATCH, size - pos));
+                int32_t candidate = insert(pos);
+                int chain = MAX_CHAIN;
+
+                while (candidate >= 0 && pos - candidate <= WINDOW_SIZE && chain-- > 0) {
+                    const unsigned char* a = data + candidate;
+                    const unsigned char* b = data + pos;
+                    // Cheap reject: a longer match must also agree at the current best length
+                    if (a[best_length] == b[best_length] || best_length == 0) {
+                        int length = 0;
+                        while (length < max_length && a[length] == b[length]) ++length;
+                        if (length > best_length) {
+                            best_length = length;
+                            best_distance = static_cast<int>(pos - candidate);
+                            if (length == max_length) break;
+                        }
+                    }
+
+                    const int32_t next = prev[candidate & WINDOW_MASK];
+                    if (next >= candidate) break;  // Slot was recycled by a newer position
+                    candidate = next;
+                }
+            }
+
+            if (best_length >= MIN_MATCH) {
+                write_match(writer, best_length, best_distance);
+                for (size_t p = pos + 1; p < pos + best_length && p + MIN_MATCH <= size; ++p) {
+                    insert(p);
+                }
+                pos += best_length;
+            } else {
+                write_literal_length(writer, data[pos]);
+                ++pos;
+            }
+        }
+
+        write_literal_length(writer, 256);  // End of block
+
+        if (!final_segment) {
+            // Empty stored block: realigns to a byte boundary so the next segment can follow directly
+            writer.write(0, 1);
+            writer.write(0, 2);
+            writer.align_to_byte();
+            out.push_back(0x00);
+            out.push_back(0x00);
+            out.push_back(0xFF);
+            out.push_back(0xFF);
+        } else {
+            writer.align_to_byte();
+        }
+    }
+
+    std::vector<unsigned char> zlib_compress(const unsigned char* data, size_t size) {
+        std::vector<unsigned char> out(ZLIB_HEADER, ZLIB_HEADER + 2);
+        out.reserve(size / 2 + 64);
+        deflate_segment(data, size, true, out);
+        write_u32_be(out, adler32(data, size));
+        return out;
+    }
+
+    std::vector<unsigned char> zlib_compress_parallel(const unsigned char* data, size_t size,
+                                                      size_t segment_size) {
+        if (segment_size == 0 || size <= segment_size) {
+            return zlib_compress(data, size);
+        }
+
+        const int segment_count = static_cast<int>((size + segment_size - 1) / segment_size);
+        std::vector<std::vector<unsigned char>> segments(segment_count);
+
+        Parallel::parallel_for(segment_count, [&](int i) {
+            PROFILE_SCOPE("Deflate segment");
+            const size_t begin = static_cast<size_t>(i) * segment_size;
+            const size_t length = std::min(segment_size, size - begin);
+            segments[i].reserve(length / 2 + 64);
+            deflate_segment(data + begin, length, i == segment_count - 1, segments[i]);
+        });
+
+        std::vector<unsigned char> out(ZLIB_HEADER, ZLIB_HEADER + 2);
+        size_t total = 0;
+        for (const auto& segment : segments) total += segment.size();
+        out.reserve(total + 6);
+        for (const auto& segment : segments) {
+            out.insert(out.end(), segment.begin(), segment.end());
+        }
+        write_u32_be(out, adler32(data, size));
+        return out;
+    }
+}
@@ -0,0 +1,122 @@
+#include "denoiser.h"
+#include "parallel.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Denoise {
+    namespace {
+        // Illumination (rgb) and the variance of its luminance, like the shader's filter textures
+        struct Sample {
+            Color illumination;
+            float variance;
+        };
+
+        Color demodulation_albedo(const GBuffer& gbuffer, int index) {
+            const Color& albedo = gbuffer.albedo[index];
+            return Color(std::max(albedo.x, 0.01f), std::max(albedo.y, 0.01f), std::max(albedo.z, 0.01f));
+        }
+    }
+
+    void atrous(Image& image, const GBuffer& gbuffer, const Settings& settings) {
+        PROFILE_SCOPE("A-trous denoise");
+
+        const int width = image.get_width();
+        const int height = image.get_height();
+        if (gbuffer.width != width || gbuffer.height != height || settings.iterations <= 0) {
+            return;
+        }
+
+        const int pixel_count = width * height;
+        std::vector<Sample> current(pixel_count);
+        std::vector<Sample> next(pixel_count);
+        std::vector<Vec3> normals(pixel_count);
+        for (int i = 0; i < pixel_count; ++i) {
+            const Color albedo = demodulation_albedo(gbuffer, i);
+            const float albedo_luminance = luminance(albedo);
+            const Color& emission = gbuffer.emission[i];
+            const Color& color = image.data()[i];
+            current[i].illumination = Color(std::max(color.x - emission.x, 0.0f) / albedo.x,
+                                            std::max(color.y - emission.y, 0.0f) / albedo.y,
+                                            std::max(color.z - emission.z, 0.0f) / albedo.z);
+            current[i].variance = gbuffer.variance[i] / (albedo_luminance * albedo_luminance);
+            normals[i] = gbuffer.normal[i].normalize();
+        }
+
+        const float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+        auto inside = [&](int x, int y) { return x >= 0 && x < width && y >= 0 && y < height; };
+
+        for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+            const int step = 1 << iteration;
+            Parallel::parallel_for(height, [&](int y) {
+                for (int x = 0; x < width; ++x) {
+                    const int index = y * width + x;
+                    const Sample& center = current[index];
+                    const float depth = gbuffer.depth[index];
+                    if (depth <= 0.0f) {
+                        next[index] = center;
+                        continue;
+                    }
+
+                    // Smallest one-sided difference per axis, so silhouettes do not inflate it
+                    auto depth_at = [&](int sx, int sy) {
+                        return inside(sx, sy) ? gbuffer.depth[sy * width + sx] : depth;
+                    };
+                    const float gradient_x = std::min(std::abs(depth_at(x + 1, y) - depth), std::abs(depth - depth_at(x - 1, y)));
+                    const float gradient_y = std::min(std::abs(depth_at(x, y + 1) - depth), std::abs(depth - depth_at(x, y - 1)));
+                    const float depth_gradient = std::max(gradient_x, gradient_y);
+
+                    // 3x3 Gaussian of the variance steers the luminance edge stop
+                    float variance = 0.0f;
+                    for (int dy = -1; dy <= 1; ++dy) {
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            const int sx = std::clamp(x + dx, 0, width - 1);
+                            const int sy = std::clamp(y + dy, 0, height - 1);
+                            const float weight = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                            variance += weight * current[sy * width + sx].variance;
+                        }
+                    }
+
+                    const float center_luminance = luminance(center.illumination);
+                    const float luminance_scale = settings.sigma_luminance * std::sqrt(std::max(variance, 0.0f)) + 1e-4f;
+                    const Vec3& normal = normals[index];
+
+                    const float center_weight = kernel[0] * kernel[0];
+                    Color sum = center.illumination * center_weight;
+                    float sum_variance = center_weight * center_weight * center.variance;
+                    float sum_weight = center_weight;
+                    for (int dy = -2; dy <= 2; ++dy) {
+                        for (int dx = -2; dx <= 2; ++dx) {
+                            const int sx = x + dx * step;
+                            const int sy = y + dy * step;
+                            if ((dx == 0 && dy == 0) || !inside(sx, sy)) continue;
+                            const int sample_index = sy * width + sx;
+                            const float sample_depth = gbuffer.depth[sample_index];
+                            if (sample_depth <= 0.0f) continue;
+
+                            const Sample& sample = current[sample_index];
+                            const float distance = static_cast<float>(step) * std::sqrt(static_cast<float>(dx * dx + dy * dy));
+                            const float w_normal = std::pow(std::max(normal.dot(normals[sample_index]), 0.0f), settings.sigma_normal);
+                            const float w_depth = std::exp(-std::abs(depth - sample_depth) /
+                                                           (settings.sigma_depth * depth_gradient * distance + 1e-3f));
+                            const float w_luminance = std::exp(-std::abs(center_luminance - luminance(sample.illumination)) /
+                                                               luminance_scale);
+                            const float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)] * w_normal * w_depth * w_luminance;
+
+                            sum += sample.illumination * weight;
+                            sum_variance += weight * weight * sample.variance;
+                            sum_weight += weight;
+                        }
+                    }
+                    next[index].illumination = sum / sum_weight;
+                    next[index].variance = sum_variance / (sum_weight * sum_weight);
+                }
+            });
+            current.swap(next);
+        }
+
+        for (int i = 0; i < pixel_count; ++i) {
+            image.data()[i] = current[i].illumination * demodulation_albedo(gbuffer, i) + gbuffer.emission[i];
+        }
+    }
+}
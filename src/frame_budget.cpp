@@ -0,0 +1,45 @@
+#include "frame_budget.h"
+#include <algorithm>
+#include <cmath>
+
+void FrameBudget::update(double gpu_ms, bool camera_moving, int requested_samples) noexcept {
+    requested_samples = std::max(1, requested_samples);
+    const float previous_scale = scale_;
+    const int previous_samples = samples_;
+
+    // Timings from the settled frames already describe full quality, so react at once
+    if (camera_moving && still_frames_ >= settings_.settle_frames) {
+        cooldown_ = 0;
+    }
+    still_frames_ = camera_moving ? 0 : still_frames_ + 1;
+    if (still_frames_ >= settings_.settle_frames) {
+        scale_ = 1.0f;
+        samples_ = requested_samples;
+    } else if (cooldown_ > 0) {
+        cooldown_--;
+        return;
+    } else if (gpu_ms > 0.0) {
+        // Leave settings alone inside a band around the target so they do not oscillate
+        const double ratio = settings_.target_ms / gpu_ms;
+        if (ratio > 0.85 && ratio < 1.25 && samples_ <= requested_samples) {
+            return;
+        }
+
+        // Cost relative to one sample at full resolution; growth is limited per step since
+        // the linear model underestimates fixed per-frame overheads at small scales
+        const double cost = static_cast<double>(scale_) * scale_ * samples_ * std::min(ratio, 2.0);
+        if (cost >= 1.0) {
+            scale_ = 1.0f;
+            samples_ = std::clamp(static_cast<int>(cost), 1, requested_samples);
+        } else {
+            const float step = std::max(settings_.scale_step, 0.01f);
+            const float scale = std::floor(static_cast<float>(std::sqrt(cost)) / step) * step;
+            scale_ = std::clamp(scale, std::min(settings_.min_scale, 1.0f), 1.0f);
+            samples_ = 1;
+        }
+    }
+
+    if (scale_ != previous_scale || samples_ != previous_samples) {
+        cooldown_ = settings_.cooldown_frames;
+    }
+}
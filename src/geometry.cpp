@@ -1,9 +1,12 @@
 #include "geometry.h"
 #include "common.h"
+#include "ray_stats.h"
 #include <algorithm>
 #include <cmath>
 
 bool Sphere::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(SphereTests);
+    
     Vec3 oc = ray.origin - center;
     float a = ray.direction.dot(ray.direction);
     float half_b = oc.dot(ray.direction);
@@ -31,6 +34,8 @@ bool Sphere::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const
 }
 
 bool Triangle::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(TriangleTests);
+    
     // Möller–Trumbore intersection algorithm
     const float EPSILON = 0.0000001f;
     Vec3 edge1 = v1 - v0;
@@ -87,6 +92,8 @@ Vec3 Triangle::get_max_bounds() const {
 }
 
 bool Plane::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(PlaneTests);
+    
     float denom = normal.dot(ray.direction);
     if (std::abs(denom) < 1e-6f) {
         return false; // Ray is parallel to plane
@@ -106,12 +113,16 @@ bool Plane::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const
 }
 
 bool Cylinder::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) const {
+    RAY_STAT(CylinderTests);
+    
     // Transform ray to cylinder coordinate system
     Vec3 oc = ray.origin - base_center;
     
     // Project ray direction and oc onto plane perpendicular to cylinder axis
-    Vec3 ray_perp = ray.direction - (ray.direction.dot(axis) * axis);
-    Vec3 oc_perp = oc - (oc.dot(axis) * axis);
+    float direction_along_axis = ray.direction.dot(axis);
+    float oc_along_axis = oc.dot(axis);
+    Vec3 ray_perp = ray.direction - (direction_along_axis * axis);
+    Vec3 oc_perp = oc - (oc_along_axis * axis);
     
     // Quadratic equation coefficients for intersection with infinite cylinder
     float a = ray_perp.dot(ray_perp);
@@ -128,17 +139,15 @@ bool Cylinder::hit(const Ray& ray, float t_min, float t_max, HitRecord& rec) con
     // Check both intersection points
     for (float t : {t1, t2}) {
         if (t >= t_min && t <= t_max) {
-            Vec3 hit_point = ray.at(t);
-            Vec3 hit_local = hit_point - base_center;
-            float height_along_axis = hit_local.dot(axis);
+            float height_along_axis = oc_along_axis + t * direction_along_axis;
             
             // Check if intersection is within cylinder height
             if (height_along_axis >= 0 && height_along_axis <= height) {
                 rec.t = t;
-                rec.point = hit_point;
+                rec.point = ray.at(t);
                 
                 // Calculate surface normal (perpendicular to axis, pointing outward)
-                Vec3 radial_component = hit_local - (height_along_axis * axis);
+                Vec3 radial_component = oc_perp + ray_perp * t;
                 Vec3 outward_normal = radial_component.normalize();
                 rec.set_face_normal(ray, outward_normal);
                 rec.material_id = material_id;
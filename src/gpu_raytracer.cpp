@@ -1,28 +1,65 @@
 #include "gpu_raytracer.h"
 #include "shader.h"
+#include "image.h"
 #include "error_handling.h"
+#include "profiler.h"
+#include "light_tree.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
 GPURayTracer::GPURayTracer(int width, int height) 
-    : window_width(width), window_height(height), num_materials(0), num_spheres(0), num_triangles(0), num_cylinders(0), num_lights(0),
-      compute_shader(0), shader_program(0), output_texture(0), accumulation_texture(0),
-      material_buffer(0), sphere_buffer(0), triangle_buffer(0), cylinder_buffer(0), camera_buffer(0), light_buffer(0),
-      ambient_light(0.1f, 0.1f, 0.1f), frame_count(0), reset_accumulation(true) {
+    : window_width(width), window_height(height), render_width(width), render_height(height),
+      pass_width(width), pass_height(height), num_materials(0), num_spheres(0), num_triangles(0), num_cylinders(0), num_lights(0), num_tree_lights(0), light_samples(1), inv_emitter_power(0.0f),
+      sampler_type(Sampling::Type::SOBOL), sample_index_base(0), blue_noise_uploaded(false),
+      adaptive_threshold(0.0f), tile_counter_next(0), counting_tiles(false), adaptive_passes(0), denoise_enabled(false), gbuffer_output(false),
+      temporal_blend(0.0f), current_camera(), camera_uploaded(false), history_camera(),
+      history_width(width), history_height(height), pass_reprojects(false), reuse_history(false),
+      sparse_pattern(SparsePattern::None), sparse_phase(0), sparse_pass(false),
+      tile_size(0), tiles_per_submit(1), next_tile(0),
+      compute_shader(0), shader_program(0), output_texture(0), accumulation_texture(0), moment_texture(0), adaptive_program(0),
+      gbuffer_textures{0, 0, 0}, denoise_textures{0, 0}, history_textures{0, 0, 0}, denoise_program(0),
+      material_buffer(0), sphere_buffer(0), triangle_buffer(0), cylinder_buffer(0), camera_buffer(0), light_buffer(0), light_tree_buffer(0), emitter_buffer(0), blue_noise_buffer(0), ray_stats_buffer(0),
+      tile_state_buffer(0), tile_counter_buffers{0, 0},
+      ambient_light(0.1f, 0.1f, 0.1f), frame_count(0), reset_accumulation(true),
+      readback_next(0), readback_pending(0) {
 }
 
 GPURayTracer::~GPURayTracer() {
     if (output_texture) glDeleteTextures(1, &output_texture);
     if (accumulation_texture) glDeleteTextures(1, &accumulation_texture);
+    if (moment_texture) glDeleteTextures(1, &moment_texture);
+    release_frame_resources();
     if (material_buffer) glDeleteBuffers(1, &material_buffer);
     if (sphere_buffer) glDeleteBuffers(1, &sphere_buffer);
     if (triangle_buffer) glDeleteBuffers(1, &triangle_buffer);
     if (cylinder_buffer) glDeleteBuffers(1, &cylinder_buffer);
     if (camera_buffer) glDeleteBuffers(1, &camera_buffer);
     if (light_buffer) glDeleteBuffers(1, &light_buffer);
+    if (light_tree_buffer) glDeleteBuffers(1, &light_tree_buffer);
+    if (emitter_buffer) glDeleteBuffers(1, &emitter_buffer);
+    if (blue_noise_buffer) glDeleteBuffers(1, &blue_noise_buffer);
+    if (ray_stats_buffer) glDeleteBuffers(1, &ray_stats_buffer);
+    if (tile_state_buffer) glDeleteBuffers(1, &tile_state_buffer);
+    if (tile_counter_buffers[0]) glDeleteBuffers(2, tile_counter_buffers);
     if (shader_program) glDeleteProgram(shader_program);
+    if (adaptive_program) glDeleteProgram(adaptive_program);
+    if (denoise_program) glDeleteProgram(denoise_program);
+    
+    discard_pending_readbacks();
+    for (auto& slot : readback_slots) {
+        if (slot.buffer) glDeleteBuffers(1, &slot.buffer);
+    }
+    for (GLsync fence : frame_fences) {
+        glDeleteSync(fence);
+    }
+    for (auto& timer : stage_timers) {
+        for (auto& slot : timer.slots) {
+            if (slot.queries[0]) glDeleteQueries(2, slot.queries);
+        }
+    }
 }
 
 bool GPURayTracer::initialize() {
@@ -46,6 +83,9 @@ bool GPURayTracer::initialize() {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, window_width, window_height, 0, GL_RGBA, GL_FLOAT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // The display pass samples past the border when upscaling
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindImageTexture(0, output_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
     
     // Create accumulation texture for temporal denoising
@@ -56,6 +96,23 @@ bool GPURayTracer::initialize() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindImageTexture(1, accumulation_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
     
+    if (!Shader::create_compute_shader(Shader::get_adaptive_sampling_compute_shader(), adaptive_program)) {
+        ErrorHandling::Logger::error("Failed to create adaptive sampling compute shader");
+        return false;
+    }
+    glGenBuffers(1, &tile_state_buffer);
+    glGenBuffers(2, tile_counter_buffers);
+    for (GLuint buffer : tile_counter_buffers) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    }
+    create_adaptive_resources();
+    
+    if (!Shader::create_compute_shader(Shader::get_denoise_compute_shader(), denoise_program)) {
+        ErrorHandling::Logger::error("Failed to create denoise compute shader");
+        return false;
+    }
+    
     // Generate buffer objects
     glGenBuffers(1, &material_buffer);
     glGenBuffers(1, &sphere_buffer);
@@ -63,12 +120,45 @@ bool GPURayTracer::initialize() {
     glGenBuffers(1, &cylinder_buffer);
     glGenBuffers(1, &camera_buffer);
     glGenBuffers(1, &light_buffer);
+    glGenBuffers(1, &light_tree_buffer);
+    glGenBuffers(1, &emitter_buffer);
+    glGenBuffers(1, &blue_noise_buffer);
+    for (auto& slot : readback_slots) {
+        glGenBuffers(1, &slot.buffer);
+    }
+    for (auto& timer : stage_timers) {
+        for (auto& slot : timer.slots) {
+            glGenQueries(2, slot.queries);
+        }
+    }
+    
+#ifdef ENABLE_RAY_STATS
+    // Two uints (low, high) per counter and per path length bin, zeroed
+    const std::vector<GLuint> zero_stats(2 * (RayStats::COUNTER_COUNT + RayStats::PATH_LENGTH_BINS), 0u);
+    glGenBuffers(1, &ray_stats_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ray_stats_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, zero_stats.size() * sizeof(GLuint), zero_stats.data(), GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, ray_stats_buffer);
+#endif
+    
+#ifdef ENABLE_PROFILING
+    GLint64 gpu_timestamp = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_timestamp);
+    PerformanceProfiler::get_instance().sync_gpu_clock(static_cast<uint64_t>(gpu_timestamp));
+#endif
     
     return true;
 }
 
 bool GPURayTracer::create_compute_program() {
+#ifdef ENABLE_RAY_STATS
+    // Enable the shader's counters by defining RAY_STATS right after the #version line
+    std::string source = Shader::get_raytracing_compute_shader();
+    source.insert(source.find('\n', source.find("#version")) + 1, "#define RAY_STATS\n");
+    const char* compute_source = source.c_str();
+#else
     const char* compute_source = Shader::get_raytracing_compute_shader();
+#endif
     
     compute_shader = glCreateShader(GL_COMPUTE_SHADER);
     glShaderSource(compute_shader, 1, &compute_source, nullptr);
@@ -107,7 +197,111 @@ bool GPURayTracer::create_compute_program() {
     return true;
 }
 
+void GPURayTracer::create_adaptive_resources() {
+    if (moment_texture) {
+        glDeleteTextures(1, &moment_texture);
+    }
+    
+    glGenTextures(1, &moment_texture);
+    glBindTexture(GL_TEXTURE_2D, moment_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, window_width, window_height, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindImageTexture(2, moment_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    
+    // Every tile starts active; the first pass after a reset ignores the flags anyway. Sized
+    // for the whole image, so any render size fits.
+    const std::vector<GLuint> active(static_cast<size_t>((window_width + 7) / 8) * ((window_height + 7) / 8), 1u);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_state_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, active.size() * sizeof(GLuint), active.data(), GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, tile_state_buffer);
+}
+
+void GPURayTracer::create_frame_resources() {
+    auto create_image = [this](GLuint& texture, GLenum internal_format = GL_RGBA32F, GLenum format = GL_RGBA) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, window_width, window_height, 0, format, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    };
+    
+    if ((gbuffer_output || denoise_enabled || temporal_blend > 0.0f) && !gbuffer_textures[0]) {
+        for (int i = 0; i < 3; ++i) {
+            create_image(gbuffer_textures[i]);
+            glBindImageTexture(3 + i, gbuffer_textures[i], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        }
+    }
+    if (denoise_enabled && !denoise_textures[0]) {
+        create_image(denoise_textures[0]);
+        create_image(denoise_textures[1]);
+    }
+    if (temporal_blend > 0.0f && !history_textures[0]) {
+        create_image(history_textures[0]);
+        create_image(history_textures[1], GL_R32F, GL_RED);
+        create_image(history_textures[2]);
+    }
+}
+
+void GPURayTracer::release_frame_resources() {
+    if (gbuffer_textures[0]) glDeleteTextures(3, gbuffer_textures);
+    if (denoise_textures[0]) glDeleteTextures(2, denoise_textures);
+    if (history_textures[0]) glDeleteTextures(3, history_textures);
+    gbuffer_textures[0] = gbuffer_textures[1] = gbuffer_textures[2] = 0;
+    denoise_textures[0] = denoise_textures[1] = 0;
+    history_textures[0] = history_textures[1] = history_textures[2] = 0;
+}
+
+void GPURayTracer::set_denoise(bool enabled) {
+    if (enabled != denoise_enabled) {
+        denoise_enabled = enabled;
+        reset_accumulation_buffer();
+    }
+}
+
+void GPURayTracer::set_gbuffer_output(bool enabled) {
+    if (enabled != gbuffer_output) {
+        gbuffer_output = enabled;
+        reset_accumulation_buffer();
+    }
+}
+
+void GPURayTracer::set_temporal_reprojection(float blend) {
+    blend = std::clamp(blend, 0.0f, 1.0f);
+    if (blend != temporal_blend) {
+        temporal_blend = blend;
+        reset_accumulation_buffer();
+    }
+}
+
+void GPURayTracer::run_denoiser() {
+    PROFILE_SCOPE("Denoise pass");
+    
+    glUseProgram(denoise_program);
+    glUniform1f(glGetUniformLocation(denoise_program, "sigma_luminance"), denoise_settings.sigma_luminance);
+    glUniform1f(glGetUniformLocation(denoise_program, "sigma_normal"), denoise_settings.sigma_normal);
+    glUniform1f(glGetUniformLocation(denoise_program, "sigma_depth"), denoise_settings.sigma_depth);
+    glUniform2i(glGetUniformLocation(denoise_program, "render_size"), render_width, render_height);
+    
+    // Iteration i reads what i - 1 wrote; the first reads the accumulation buffer and the last
+    // writes the tone-mapped result to the output texture
+    const int iterations = std::max(1, denoise_settings.iterations);
+    begin_gpu_timer(GPUStage::Denoise);
+    for (int i = 0; i < iterations; ++i) {
+        glBindImageTexture(6, denoise_textures[(i + 1) % 2], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(7, denoise_textures[i % 2], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glUniform1i(glGetUniformLocation(denoise_program, "step_size"), 1 << i);
+        glUniform1i(glGetUniformLocation(denoise_program, "first_iteration"), i == 0 ? 1 : 0);
+        glUniform1i(glGetUniformLocation(denoise_program, "last_iteration"), i == iterations - 1 ? 1 : 0);
+        glDispatchCompute((render_width + 7) / 8, (render_height + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    end_gpu_timer(GPUStage::Denoise);
+}
+
 void GPURayTracer::load_scene(const Scene& scene) {
+    PROFILE_SCOPE("GPU scene upload");
+    
     // Convert materials to GPU format
     std::vector<GPUMaterial> gpu_materials;
     for (const auto& mat : scene.materials) {
@@ -140,12 +334,26 @@ void GPURayTracer::load_scene(const Scene& scene) {
     int sphere_count = 0;
     int cylinder_count = 0;
     
+    // Emissive primitives are collected for next-event estimation; cdf holds running power until normalized
+    std::vector<GPUEmitter> gpu_emitters;
+    float emitter_power = 0.0f;
+    auto add_emitter = [&](int primitive_type, int primitive_index, int material_id, float area) {
+        auto mat = scene.get_material(material_id);
+        if (!mat || mat->type != MaterialType::EMISSIVE) return;
+        const float power = luminance(mat->emission) * area;
+        if (!(power > 0.0f)) return;
+        emitter_power += power;
+        gpu_emitters.push_back(GPUEmitter{primitive_type, primitive_index, emitter_power, 0.0f});
+    };
+    
     for (const auto& obj : scene.objects) {
         if (auto sphere = std::dynamic_pointer_cast<Sphere>(obj)) {
             GPUSphere gpu_sphere;
             gpu_sphere.center = sphere->center;
             gpu_sphere.radius = sphere->radius;
             gpu_sphere.material_id = sphere->material_id;
+            add_emitter(0, static_cast<int>(gpu_spheres.size()), sphere->material_id,
+                        4.0f * static_cast<float>(M_PI) * sphere->radius * sphere->radius);
             gpu_spheres.push_back(gpu_sphere);
             sphere_count++;
         } else if (auto triangle = std::dynamic_pointer_cast<Triangle>(obj)) {
@@ -154,6 +362,8 @@ void GPURayTracer::load_scene(const Scene& scene) {
             gpu_triangle.v1 = triangle->v1;
             gpu_triangle.v2 = triangle->v2;
             gpu_triangle.material_id = triangle->material_id;
+            add_emitter(1, static_cast<int>(gpu_triangles.size()), triangle->material_id,
+                        0.5f * (triangle->v1 - triangle->v0).cross(triangle->v2 - triangle->v0).length());
             gpu_triangles.push_back(gpu_triangle);
             triangle_count++;
         } else if (auto cylinder = std::dynamic_pointer_cast<Cylinder>(obj)) {
@@ -163,6 +373,9 @@ void GPURayTracer::load_scene(const Scene& scene) {
             gpu_cylinder.radius = cylinder->radius;
             gpu_cylinder.height = cylinder->height;
             gpu_cylinder.material_id = cylinder->material_id;
+            // The GPU cylinder is an open tube, so only the side counts towards its area
+            add_emitter(2, static_cast<int>(gpu_cylinders.size()), cylinder->material_id,
+                        2.0f * static_cast<float>(M_PI) * cylinder->radius * cylinder->height);
             gpu_cylinders.push_back(gpu_cylinder);
             cylinder_count++;
         }
@@ -174,14 +387,39 @@ void GPURayTracer::load_scene(const Scene& scene) {
                                 std::to_string(triangle_count) + " triangles, " +
                                 std::to_string(cylinder_count) + " cylinders");
     
+    for (auto& emitter : gpu_emitters) {
+        emitter.cdf /= emitter_power;
+    }
+    if (!gpu_emitters.empty()) {
+        gpu_emitters.back().cdf = 1.0f;  // Guard the last bucket against rounding
+        ErrorHandling::Logger::info("Emitters: " + std::to_string(gpu_emitters.size()) + " emissive primitives");
+    }
+    inv_emitter_power = gpu_emitters.empty() ? 0.0f : 1.0f / emitter_power;
+    
     num_materials = gpu_materials.size();
     num_spheres = gpu_spheres.size();
     num_triangles = gpu_triangles.size();
     num_cylinders = gpu_cylinders.size();
     
+    // Point and spot lights go first: the shader samples that range through the light tree
+    // and evaluates the rest (area lights) one by one
+    std::vector<std::shared_ptr<Light>> ordered_lights(scene.lights.begin(), scene.lights.end());
+    auto tree_end = std::stable_partition(ordered_lights.begin(), ordered_lights.end(),
+        [](const std::shared_ptr<Light>& light) {
+            return light->type == LightType::POINT || light->type == LightType::SPOT;
+        });
+    num_tree_lights = static_cast<int>(tree_end - ordered_lights.begin());
+    
+    LightTree light_tree;
+    light_tree.build(ordered_lights);
+    if (!light_tree.nodes().empty()) {
+        ErrorHandling::Logger::info("Light tree: " + std::to_string(light_tree.light_count()) + " lights, " +
+                                    std::to_string(light_tree.nodes().size()) + " nodes");
+    }
+    
     // Convert lights to GPU format
     std::vector<GPULight> gpu_lights;
-    for (const auto& light : scene.lights) {
+    for (const auto& light : ordered_lights) {
         GPULight gpu_light = {};
         
         if (auto point_light = std::dynamic_pointer_cast<PointLight>(light)) {
@@ -198,9 +436,11 @@ void GPURayTracer::load_scene(const Scene& scene) {
             gpu_light.inner_angle = cos(spot_light->inner_angle * M_PI / 180.0f); // Convert to cosine
             gpu_light.outer_angle = cos(spot_light->outer_angle * M_PI / 180.0f); // Convert to cosine
         } else if (auto area_light = std::dynamic_pointer_cast<AreaPlaneLight>(light)) {
-            gpu_light.type = 2; // Area
+            // The shader has no area light; type 2 shades it as directional along its normal
+            gpu_light.type = 2; // Directional
             gpu_light.position = area_light->position;
             gpu_light.intensity = area_light->intensity;
+            gpu_light.direction = area_light->normal;
             gpu_light.u_axis = area_light->u_axis;
             gpu_light.v_axis = area_light->v_axis;
             gpu_light.width = area_light->width;
@@ -243,6 +483,18 @@ void GPURayTracer::load_scene(const Scene& scene) {
                  gpu_lights.data(), GL_STATIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, light_buffer);
     
+    // Upload the light tree
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, light_tree_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, light_tree.nodes().size() * sizeof(LightTree::Node),
+                 light_tree.nodes().data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, light_tree_buffer);
+    
+    // Upload emitters
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, emitter_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpu_emitters.size() * sizeof(GPUEmitter),
+                 gpu_emitters.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, emitter_buffer);
+    
     // Store ambient light
     ambient_light = scene.ambient_light;
     
@@ -250,55 +502,370 @@ void GPURayTracer::load_scene(const Scene& scene) {
     reset_accumulation_buffer();
 }
 
+namespace {
+    GPUCamera to_gpu_camera(const Camera& camera) {
+        GPUCamera gpu_camera;
+        gpu_camera.position = camera.position;
+        gpu_camera.lower_left_corner = camera.lower_left_corner;
+        gpu_camera.horizontal = camera.horizontal;
+        gpu_camera.vertical = camera.vertical;
+        gpu_camera.u = camera.u;
+        gpu_camera.v = camera.v;
+        gpu_camera.w = camera.w;
+        gpu_camera.lens_radius = camera.lens_radius;
+        return gpu_camera;
+    }
+    
+    // Same primary rays (the lens basis follows from these)
+    bool same_view(const GPUCamera& a, const GPUCamera& b) {
+        return a.position == b.position && a.lower_left_corner == b.lower_left_corner &&
+               a.horizontal == b.horizontal && a.vertical == b.vertical;
+    }
+}
+
 void GPURayTracer::update_camera(const Camera& camera) {
-    GPUCamera gpu_camera;
-    gpu_camera.position = camera.position;
-    gpu_camera.lower_left_corner = camera.lower_left_corner;
-    gpu_camera.horizontal = camera.horizontal;
-    gpu_camera.vertical = camera.vertical;
-    gpu_camera.u = camera.u;
-    gpu_camera.v = camera.v;
-    gpu_camera.w = camera.w;
-    gpu_camera.lens_radius = camera.lens_radius;
+    const GPUCamera gpu_camera = to_gpu_camera(camera);
     
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, camera_buffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUCamera), &gpu_camera, GL_DYNAMIC_DRAW);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, camera_buffer);
+    current_camera = gpu_camera;
+    camera_uploaded = true;
+}
+
+void GPURayTracer::set_tiling(int size, int per_submit) {
+    size = size > 0 ? (size + 7) / 8 * 8 : 0;
+    per_submit = std::max(1, per_submit);
+    if (size != tile_size || per_submit != tiles_per_submit) {
+        tile_size = size;
+        tiles_per_submit = per_submit;
+        tile_schedule.clear();
+        // A partly covered pass would mix tile layouts
+        reset_accumulation_buffer();
+    }
+}
+
+void GPURayTracer::build_tile_schedule() {
+    tile_schedule.clear();
+    const int width = tile_size > 0 ? tile_size : render_width;
+    const int height = tile_size > 0 ? tile_size : render_height;
+    for (int y = 0; y < render_height; y += height) {
+        for (int x = 0; x < render_width; x += width) {
+            tile_schedule.push_back({x, y, std::min(width, render_width - x), std::min(height, render_height - y)});
+        }
+    }
+    
+    // Centre-out, so the region the viewer looks at converges first
+    auto distance = [this](const ScreenTile& tile) {
+        const float dx = tile.x + 0.5f * tile.width - 0.5f * render_width;
+        const float dy = tile.y + 0.5f * tile.height - 0.5f * render_height;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(tile_schedule.begin(), tile_schedule.end(),
+                     [&](const ScreenTile& a, const ScreenTile& b) { return distance(a) < distance(b); });
 }
 
 void GPURayTracer::render(const Camera& camera, int samples, int max_depth) {
+    PROFILE_SCOPE("Render pass");
+    
+    // Results from earlier frames are usually ready by now
+    collect_gpu_timers();
+    
+    // Every tile of a pass must see the same view. With reprojection on, a move is not a reset
+    // by itself: the unfinished pass is dropped and the new one reprojects from the last
+    // completed pass.
+    if (next_tile > 0 && !same_view(current_camera, to_gpu_camera(camera))) {
+        if (temporal_blend > 0.0f) {
+            abandon_pass();
+        } else {
+            reset_accumulation_buffer();
+        }
+    }
+    if (tile_schedule.empty()) {
+        build_tile_schedule();
+    }
+    
+    // Timed from the pass setup on, so the budget sees all of this call's work
+    begin_gpu_timer(GPUStage::Dispatch);
+    if (next_tile == 0) {
+        begin_pass(camera, samples, max_depth);
+    }
+    
+    glUseProgram(shader_program);
+    const size_t first_tile = next_tile;
+    const size_t end_tile = tile_size > 0 ? std::min(next_tile + static_cast<size_t>(tiles_per_submit), tile_schedule.size())
+                                          : tile_schedule.size();
+    for (; next_tile < end_tile; ++next_tile) {
+        const ScreenTile& tile = tile_schedule[next_tile];
+        glUniform2i(glGetUniformLocation(shader_program, "tile_offset"), tile.x, tile.y);
+        glDispatchCompute((tile.width + 7) / 8, (tile.height + 7) / 8, 1);
+    }
+    
+    // Wait for completion
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    
+    if (adaptive_threshold > 0.0f) {
+        // Re-estimate the error of the 8x8 tiles just traced and count the ones that stay
+        // active. A tile's pixels are final for the pass once its batch ran, so the pass total
+        // and flags match an estimate over the whole image at the end of the pass.
+        glUseProgram(adaptive_program);
+        glUniform1f(glGetUniformLocation(adaptive_program, "error_threshold"), adaptive_threshold);
+        glUniform1f(glGetUniformLocation(adaptive_program, "min_samples"), static_cast<float>(ADAPTIVE_MIN_SAMPLES));
+        glUniform2i(glGetUniformLocation(adaptive_program, "render_size"), render_width, render_height);
+        for (size_t i = first_tile; i < end_tile; ++i) {
+            const ScreenTile& tile = tile_schedule[i];
+            glUniform2i(glGetUniformLocation(adaptive_program, "tile_offset"), tile.x, tile.y);
+            glDispatchCompute((tile.width + 7) / 8, (tile.height + 7) / 8, 1);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+    
+    const bool pass_finished = next_tile == tile_schedule.size();
+    if (pass_finished) {
+        next_tile = 0;
+        if (adaptive_threshold > 0.0f) {
+            tile_counter_next ^= 1;
+            counting_tiles = false;
+            adaptive_passes++;
+        }
+        pass_reprojects = false;
+    }
+    end_gpu_timer(GPUStage::Dispatch);
+    
+    // Every call, so frames in the middle of a tiled pass are filtered like the last one
+    if (denoise_enabled) {
+        run_denoiser();
+    }
+    
+    frame_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    if (frame_fences.size() > MAX_TRACKED_FRAMES) {
+        glDeleteSync(frame_fences.front());
+        frame_fences.pop_front();
+    }
+    
+    // Hand each batch of tiles to the GPU as its own submission
+    if (tile_size > 0) {
+        glFlush();
+    }
+}
+
+void GPURayTracer::begin_pass(const Camera& camera, int samples, int max_depth) {
+    // Reprojection needs the view the accumulated history was rendered from. An abandoned
+    // reprojecting pass left the live images partly in its own view, so the snapshot it read
+    // (the last completed pass) is reprojected again instead.
+    const bool from_snapshot = reuse_history && !reset_accumulation;
+    reuse_history = false;
+    const GPUCamera previous_camera = from_snapshot ? history_camera : current_camera;
+    const int previous_width = from_snapshot ? history_width : pass_width;
+    const int previous_height = from_snapshot ? history_height : pass_height;
+    const bool had_camera = camera_uploaded;
     update_camera(camera);
+    const bool camera_moved = had_camera && !same_view(previous_camera, current_camera);
+    // After a render size change the history is resampled onto the new pixel grid the same way
+    const bool resized = render_width != previous_width || render_height != previous_height;
+    const bool reproject = temporal_blend > 0.0f && (camera_moved || resized || from_snapshot) &&
+                           !reset_accumulation && frame_count > 0;
+    // Skipped pixels are filled from reprojected history or start empty; without either they
+    // would keep samples of the previous view, so such passes trace every pixel
+    const bool fresh_start = reset_accumulation || frame_count == 0;
+    sparse_pass = camera_moved && sparse_pattern != SparsePattern::None && (reproject || fresh_start);
     
     glUseProgram(shader_program);
     
+    // G-buffers, filter and history images are allocated on first use and after a resize
+    const bool write_gbuffer = gbuffer_output || denoise_enabled || temporal_blend > 0.0f;
+    if (write_gbuffer) {
+        create_frame_resources();
+    }
+    
+    if (reproject) {
+        // Snapshot the previous view's results; the pass reads them as textures and rewrites
+        // the live images for the new view
+        if (!from_snapshot) {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+            const GLuint sources[3] = {accumulation_texture, moment_texture, gbuffer_textures[0]};
+            for (int i = 0; i < 3; ++i) {
+                glCopyImageSubData(sources[i], GL_TEXTURE_2D, 0, 0, 0, 0,
+                                   history_textures[i], GL_TEXTURE_2D, 0, 0, 0, 0,
+                                   previous_width, previous_height, 1);
+            }
+            history_camera = previous_camera;
+            history_width = previous_width;
+            history_height = previous_height;
+        }
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE1 + i);
+            glBindTexture(GL_TEXTURE_2D, history_textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+    pass_reprojects = reproject;
+    
+    if (adaptive_threshold > 0.0f) {
+        // Batches add their active tiles to this pass's counter
+        const GLuint zero = 0;
+        const GLuint counter = tile_counter_buffers[tile_counter_next];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, counter);
+        counting_tiles = true;
+    }
+    
+    if (sampler_type == Sampling::Type::BLUE_NOISE && !blue_noise_uploaded) {
+        const std::vector<float>& tile = Sampling::blue_noise_tile();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, blue_noise_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, tile.size() * sizeof(float), tile.data(), GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, blue_noise_buffer);
+        blue_noise_uploaded = true;
+    }
+    
     // Increment frame count for temporal accumulation
     frame_count++;
     
     // Set uniforms
     glUniform1i(glGetUniformLocation(shader_program, "max_depth"), max_depth);
     glUniform1i(glGetUniformLocation(shader_program, "samples_per_pixel"), samples);
+    glUniform1i(glGetUniformLocation(shader_program, "roulette_depth"), path_termination.roulette_depth);
+    glUniform1i(glGetUniformLocation(shader_program, "max_diffuse_bounces"), path_termination.diffuse_bounces);
+    glUniform1i(glGetUniformLocation(shader_program, "max_specular_bounces"), path_termination.specular_bounces);
+    glUniform1i(glGetUniformLocation(shader_program, "max_transmission_bounces"), path_termination.transmission_bounces);
     glUniform1f(glGetUniformLocation(shader_program, "time"), 
                 static_cast<float>(glfwGetTime()));
     glUniform1i(glGetUniformLocation(shader_program, "frame_count"), frame_count);
+    glUniform2i(glGetUniformLocation(shader_program, "render_size"), render_width, render_height);
     glUniform1i(glGetUniformLocation(shader_program, "reset_accumulation"), reset_accumulation ? 1 : 0);
     glUniform3f(glGetUniformLocation(shader_program, "ambient_light"), 
                 ambient_light.x, ambient_light.y, ambient_light.z);
+    glUniform1i(glGetUniformLocation(shader_program, "num_tree_lights"), num_tree_lights);
+    glUniform1i(glGetUniformLocation(shader_program, "light_samples"), light_samples);
+    glUniform1f(glGetUniformLocation(shader_program, "inv_emitter_power"), inv_emitter_power);
+    glUniform1i(glGetUniformLocation(shader_program, "sampler_type"), static_cast<int>(sampler_type));
+    glUniform1ui(glGetUniformLocation(shader_program, "sample_index_base"), sample_index_base);
+    glUniform1i(glGetUniformLocation(shader_program, "adaptive_sampling"), adaptive_threshold > 0.0f ? 1 : 0);
+    glUniform1i(glGetUniformLocation(shader_program, "write_gbuffer"), write_gbuffer ? 1 : 0);
+    glUniform1i(glGetUniformLocation(shader_program, "reproject"), reproject ? 1 : 0);
+    glUniform1i(glGetUniformLocation(shader_program, "sparse_pattern"),
+                static_cast<int>(sparse_pass ? sparse_pattern : SparsePattern::None));
+    glUniform1ui(glGetUniformLocation(shader_program, "sparse_phase"), sparse_phase);
+    glUniform1f(glGetUniformLocation(shader_program, "fovea_radius"), FOVEA_RADIUS);
+    if (sparse_pass) {
+        sparse_phase++;
+    }
+    glUniform1i(glGetUniformLocation(shader_program, "history_color"), 1);
+    glUniform1i(glGetUniformLocation(shader_program, "history_moment"), 2);
+    glUniform1i(glGetUniformLocation(shader_program, "history_normal_depth"), 3);
+    if (reproject) {
+        // A pass of n samples over history capped at n * (1 / blend - 1) weighs at least blend
+        const float history_limit = static_cast<float>(samples) * (1.0f / temporal_blend - 1.0f);
+        glUniform1f(glGetUniformLocation(shader_program, "history_limit"), history_limit);
+        glUniform2i(glGetUniformLocation(shader_program, "history_size"), history_width, history_height);
+        glUniform3fv(glGetUniformLocation(shader_program, "prev_camera_position"), 1, &previous_camera.position.x);
+        glUniform3fv(glGetUniformLocation(shader_program, "prev_lower_left_corner"), 1, &previous_camera.lower_left_corner.x);
+        glUniform3fv(glGetUniformLocation(shader_program, "prev_horizontal"), 1, &previous_camera.horizontal.x);
+        glUniform3fv(glGetUniformLocation(shader_program, "prev_vertical"), 1, &previous_camera.vertical.x);
+    }
+    sample_index_base += static_cast<unsigned int>(samples);
+    pass_width = render_width;
+    pass_height = render_height;
     
     // Clear reset flag after first use
     if (reset_accumulation) {
         reset_accumulation = false;
     }
+}
+
+void GPURayTracer::wait_for_frames(int max_in_flight) {
+    PROFILE_SCOPE("Frame wait");
     
-    // Dispatch compute shader
-    glDispatchCompute((window_width + 7) / 8, (window_height + 7) / 8, 1);
+    constexpr GLuint64 WAIT_TIMEOUT_NS = 100000000;  // 100 ms per poll
+    while (static_cast<int>(frame_fences.size()) > std::max(0, max_in_flight)) {
+        GLsync fence = frame_fences.front();
+        frame_fences.pop_front();
+        
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+        while (status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, 0, WAIT_TIMEOUT_NS);
+        }
+        glDeleteSync(fence);
+    }
+}
+
+bool GPURayTracer::read_gbuffer(Denoise::GBuffer& gbuffer) {
+    PROFILE_SCOPE("G-buffer readback");
     
-    // Wait for completion
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    if (!gbuffer_textures[0]) {
+        return false;
+    }
+    
+    // Whole textures are downloaded; only the render size part is kept
+    const size_t texel_count = static_cast<size_t>(window_width) * window_height;
+    std::vector<float> normal_depth(texel_count * 4), albedo(texel_count * 4), emission(texel_count * 4);
+    std::vector<float> accumulation(texel_count * 4);
+    std::vector<float> moment(texel_count);
+    
+    // Direct synchronous copies; this runs once per headless image
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, gbuffer_textures[0]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, normal_depth.data());
+    glBindTexture(GL_TEXTURE_2D, gbuffer_textures[1]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, albedo.data());
+    glBindTexture(GL_TEXTURE_2D, gbuffer_textures[2]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, emission.data());
+    glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, accumulation.data());
+    glBindTexture(GL_TEXTURE_2D, moment_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, moment.data());
+    
+    const size_t pixel_count = static_cast<size_t>(render_width) * render_height;
+    gbuffer.width = render_width;
+    gbuffer.height = render_height;
+    gbuffer.normal.resize(pixel_count);
+    gbuffer.depth.resize(pixel_count);
+    gbuffer.albedo.resize(pixel_count);
+    gbuffer.emission.resize(pixel_count);
+    gbuffer.variance.resize(pixel_count);
+    for (size_t i = 0; i < pixel_count; ++i) {
+        const size_t t = (i / render_width) * window_width + i % render_width;
+        const float* nd = &normal_depth[t * 4];
+        const float* acc = &accumulation[t * 4];
+        gbuffer.normal[i] = Vec3(nd[0], nd[1], nd[2]);
+        gbuffer.depth[i] = nd[3];
+        gbuffer.albedo[i] = Color(albedo[t * 4], albedo[t * 4 + 1], albedo[t * 4 + 2]);
+        gbuffer.emission[i] = Color(emission[t * 4], emission[t * 4 + 1], emission[t * 4 + 2]);
+        // Variance of the accumulated mean, as in the denoise shader
+        const float mean = luminance(Color(acc[0], acc[1], acc[2]));
+        gbuffer.variance[i] = std::max(moment[t] - mean * mean, 0.0f) / std::max(acc[3] - 1.0f, 1.0f);
+    }
+    return true;
+}
+
+int GPURayTracer::active_tiles() {
+    if (adaptive_threshold <= 0.0f || adaptive_passes < (counting_tiles ? 1 : 2)) {
+        return -1;
+    }
+    
+    // Between passes the latest pass wrote the other buffer, so this one belongs to the pass
+    // before it. While a pass is counting into this one, the other holds the latest pass.
+    GLuint count = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_counter_buffers[counting_tiles ? tile_counter_next ^ 1 : tile_counter_next]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+    return static_cast<int>(count);
+}
+
+void GPURayTracer::set_path_termination(const PathTermination& termination) {
+    path_termination.roulette_depth = std::max(0, termination.roulette_depth);
+    path_termination.diffuse_bounces = std::max(0, termination.diffuse_bounces);
+    path_termination.specular_bounces = std::max(0, termination.specular_bounces);
+    path_termination.transmission_bounces = std::max(0, termination.transmission_bounces);
+    reset_accumulation_buffer();
 }
 
 void GPURayTracer::resize(int width, int height) {
-    window_width = width;
-    window_height = height;
+    window_width = render_width = pass_width = width;
+    window_height = render_height = pass_height = height;
+    tile_schedule.clear();
     
     // Recreate output texture
     if (output_texture) {
@@ -310,6 +877,9 @@ void GPURayTracer::resize(int width, int height) {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // The display pass samples past the border when upscaling
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindImageTexture(0, output_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
     
     // Recreate accumulation texture
@@ -324,6 +894,250 @@ void GPURayTracer::resize(int width, int height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindImageTexture(1, accumulation_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
     
+    // Moment image and tile flags follow the new tile grid; G-buffers are recreated by render()
+    create_adaptive_resources();
+    release_frame_resources();
+    
+    // Queued readbacks refer to the old size
+    discard_pending_readbacks();
+    
     // Reset accumulation when resizing
     reset_accumulation_buffer();
 }
+
+void GPURayTracer::abandon_pass() {
+    if (next_tile > 0) {
+        reuse_history = pass_reprojects;
+        pass_reprojects = false;
+        next_tile = 0;
+    }
+}
+
+void GPURayTracer::set_render_size(int width, int height) {
+    width = std::clamp(width, 1, window_width);
+    height = std::clamp(height, 1, window_height);
+    if (width == render_width && height == render_height) {
+        return;
+    }
+    render_width = width;
+    render_height = height;
+    
+    // Tiles follow the render size; the next pass reprojects from the old one
+    tile_schedule.clear();
+    abandon_pass();
+    if (temporal_blend <= 0.0f) {
+        reset_accumulation_buffer();
+    }
+}
+
+void GPURayTracer::begin_readback() {
+    // Reuse the oldest slot if every slot is still in flight
+    if (readback_pending == READBACK_SLOTS) {
+        const int oldest = (readback_next - readback_pending + READBACK_SLOTS) % READBACK_SLOTS;
+        glDeleteSync(readback_slots[oldest].fence);
+        readback_slots[oldest].fence = nullptr;
+        readback_pending--;
+    }
+    
+    ReadbackSlot& slot = readback_slots[readback_next];
+    const size_t size = static_cast<size_t>(window_width) * window_height * 4 * sizeof(float);
+    
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.capacity != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+    
+    // Make imageStore writes from the compute pass visible to the texture download
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+    
+    // With a pack buffer bound the download is queued on the GPU and returns immediately
+    glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    begin_gpu_timer(GPUStage::Readback);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    end_gpu_timer(GPUStage::Readback);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = render_width;
+    slot.height = render_height;
+    slot.row_length = window_width;
+    
+    readback_next = (readback_next + 1) % READBACK_SLOTS;
+    readback_pending++;
+}
+
+bool GPURayTracer::read_accumulation(Image& image, bool wait) {
+    PROFILE_SCOPE("Accumulation readback");
+    
+    if (readback_pending == 0) {
+        begin_readback();
+    }
+    
+    const int oldest = (readback_next - readback_pending + READBACK_SLOTS) % READBACK_SLOTS;
+    ReadbackSlot& slot = readback_slots[oldest];
+    
+    // Flush on the first wait so the fence is guaranteed to be submitted
+    constexpr GLuint64 WAIT_TIMEOUT_NS = 100000000;  // 100 ms per poll
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(slot.fence, 0, WAIT_TIMEOUT_NS);
+    }
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    readback_pending--;
+    
+    if (status == GL_WAIT_FAILED) {
+        ErrorHandling::Logger::error("Waiting for accumulation readback failed");
+        return false;
+    }
+    if (image.get_width() != slot.width || image.get_height() != slot.height) {
+        ErrorHandling::Logger::error("Readback size " + std::to_string(slot.width) + "x" + std::to_string(slot.height) +
+                                     " does not match image size " + std::to_string(image.get_width()) + "x" +
+                                     std::to_string(image.get_height()));
+        return false;
+    }
+    
+    // Rows are row_length texels apart; the render size part starts at the first texel
+    const size_t mapped_size = (static_cast<size_t>(slot.row_length) * (slot.height - 1) + slot.width) * 4 * sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const float* rgba = static_cast<const float*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, mapped_size, GL_MAP_READ_BIT));
+    if (!rgba) {
+        ErrorHandling::Logger::error("Failed to map accumulation readback buffer");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return false;
+    }
+    
+    Color* dst = image.data();
+    for (int y = 0; y < slot.height; ++y) {
+        const float* row = rgba + static_cast<size_t>(y) * slot.row_length * 4;
+        for (int x = 0; x < slot.width; ++x) {
+            *dst++ = Color(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]);
+        }
+    }
+    
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+bool GPURayTracer::read_latest_accumulation(Image& image) {
+    discard_pending_readbacks();
+    begin_readback();
+    return read_accumulation(image, true);
+}
+
+void GPURayTracer::discard_pending_readbacks() {
+    for (auto& slot : readback_slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+    }
+    readback_pending = 0;
+}
+
+void GPURayTracer::begin_gpu_timer(GPUStage stage) {
+    StageTimer& timer = stage_timers[static_cast<int>(stage)];
+    TimerSlot& slot = timer.slots[timer.next];
+    timer.open = false;
+    if (!slot.queries[0]) return;
+    
+    // Never block on an old result: drop this measurement if the slot is still in flight
+    if (slot.pending && !collect_timer_slot(stage, slot, false)) {
+        return;
+    }
+    
+    glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+    timer.open = true;
+}
+
+void GPURayTracer::end_gpu_timer(GPUStage stage) {
+    StageTimer& timer = stage_timers[static_cast<int>(stage)];
+    if (!timer.open) return;
+    
+    TimerSlot& slot = timer.slots[timer.next];
+    glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+    slot.pending = true;
+    timer.open = false;
+    timer.next = (timer.next + 1) % TIMER_SLOTS;
+}
+
+void GPURayTracer::collect_gpu_timers(bool wait) {
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        StageTimer& timer = stage_timers[stage];
+        // Oldest slot first so the moving average sees results in submission order
+        for (int i = 0; i < TIMER_SLOTS; ++i) {
+            TimerSlot& slot = timer.slots[(timer.next + i) % TIMER_SLOTS];
+            if (slot.pending && !collect_timer_slot(static_cast<GPUStage>(stage), slot, wait)) {
+                break;
+            }
+        }
+    }
+}
+
+bool GPURayTracer::collect_timer_slot(GPUStage stage, TimerSlot& slot, bool wait) {
+    if (!wait) {
+        // The end query completes last, so its availability covers both timestamps
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+    }
+    
+    GLuint64 begin_ns = 0, end_ns = 0;
+    glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin_ns);
+    glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end_ns);
+    slot.pending = false;
+    
+    StageTimer& timer = stage_timers[static_cast<int>(stage)];
+    const double elapsed_ms = static_cast<double>(end_ns - begin_ns) * 1e-6;
+    timer.last_ms = elapsed_ms;
+    timer.average_ms = timer.samples == 0 ? elapsed_ms : timer.average_ms * 0.9 + elapsed_ms * 0.1;
+    timer.total_ms += elapsed_ms;
+    timer.samples++;
+    
+#ifdef ENABLE_PROFILING
+    static const PerformanceProfiler::ScopeId stage_ids[STAGE_COUNT] = {
+        PerformanceProfiler::get_instance().intern("GPU dispatch"),
+        PerformanceProfiler::get_instance().intern("GPU display"),
+        PerformanceProfiler::get_instance().intern("GPU readback"),
+        PerformanceProfiler::get_instance().intern("GPU denoise"),
+    };
+    PerformanceProfiler::get_instance().record_gpu(stage_ids[static_cast<int>(stage)], begin_ns, end_ns);
+#endif
+    return true;
+}
+
+bool GPURayTracer::read_ray_stats(RayStats::Snapshot& stats, bool reset) {
+#ifdef ENABLE_RAY_STATS
+    constexpr int VALUE_COUNT = RayStats::COUNTER_COUNT + RayStats::PATH_LENGTH_BINS;
+    GLuint words[2 * VALUE_COUNT];
+    
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ray_stats_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(words), words);
+    if (reset) {
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    
+    for (int i = 0; i < VALUE_COUNT; ++i) {
+        const uint64_t value = (static_cast<uint64_t>(words[2 * i + 1]) << 32) | words[2 * i];
+        if (i < RayStats::COUNTER_COUNT) {
+            stats.counters[i] = value;
+        } else {
+            stats.path_lengths[i - RayStats::COUNTER_COUNT] = value;
+        }
+    }
+    return true;
+#else
+    (void)stats;
+    (void)reset;
+    return false;
+#endif
+}
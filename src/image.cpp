@@ -1,40 +1,414 @@
 #include "image.h"
+#include "compression.h"
+#include "parallel.h"
 #include "error_handling.h"
-#include <fstream>
+#include "profiler.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 
-void Image::save_ppm(const std::string& filename) const {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        ErrorHandling::Logger::error("Failed to open file for writing: " + filename);
-        return;
+namespace {
+    template <typename T>
+    void append_le(std::vector<unsigned char>& out, T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        // OpenEXR is little-endian on disk; every supported target is little-endian too
+        out.insert(out.end(), bytes, bytes + sizeof(T));
     }
     
-    file << "P3\n" << width << " " << height << "\n255\n";
+    void append_be32(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
     
-    for (int j = height - 1; j >= 0; --j) {
-        for (int i = 0; i < width; ++i) {
-            const Color pixel = get_pixel(i, j);
-            const Color mapped = Image::tone_map(pixel);
-            
-            const int r = Image::clamp_to_byte(mapped.x);
-            const int g = Image::clamp_to_byte(mapped.y);
-            const int b = Image::clamp_to_byte(mapped.z);
+    void append_png_chunk(std::vector<unsigned char>& out, const char type[4], const unsigned char* data, size_t size) {
+        append_be32(out, static_cast<uint32_t>(size));
+        const size_t type_offset = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0) {
+            out.insert(out.end(), data, data + size);
+        }
+        append_be32(out, Compression::crc32(out.data() + type_offset, size + 4));
+    }
+    
+    inline unsigned char paeth_predictor(int a, int b, int c) {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+        if (pb <= pc) return static_cast<unsigned char>(b);
+        return static_cast<unsigned char>(c);
+    }
+    
+    // Evaluates all five PNG filters on one row in a single pass and keeps the one with the
+    // smallest sum of absolute residuals (the heuristic recommended by the PNG specification)
+    void filter_png_row(const unsigned char* row, const unsigned char* prev_row, size_t stride,
+                        int bytes_per_pixel, unsigned char* out, std::vector<unsigned char>& scratch) {
+        constexpr int FILTER_COUNT = 5;
+        scratch.resize(stride * FILTER_COUNT);
+        unsigned char* residuals[FILTER_COUNT];
+        for (int f = 0; f < FILTER_COUNT; ++f) {
+            residuals[f] = scratch.data() + stride * f;
+        }
+        
+        unsigned long cost[FILTER_COUNT] = {0, 0, 0, 0, 0};
+        auto magnitude = [](unsigned char r) -> unsigned long { return r < 128 ? r : 256 - r; };
+        
+        const size_t bpp = static_cast<size_t>(bytes_per_pixel);
+        for (size_t i = 0; i < stride; ++i) {
+            const int x = row[i];
+            const int left = i >= bpp ? row[i - bpp] : 0;
+            const int up = prev_row ? prev_row[i] : 0;
+            const int up_left = (prev_row && i >= bpp) ? prev_row[i - bpp] : 0;
             
-            file << r << " " << g << " " << b << "\n";
+            const unsigned char r0 = static_cast<unsigned char>(x);
+            const unsigned char r1 = static_cast<unsigned char>(x - left);
+            const unsigned char r2 = static_cast<unsigned char>(x - up);
+            const unsigned char r3 = static_cast<unsigned char>(x - (left + up) / 2);
+            const unsigned char r4 = static_cast<unsigned char>(x - paeth_predictor(left, up, up_left));
             
-            if (file.fail()) {
-                ErrorHandling::Logger::error("Failed to write pixel data to file: " + filename);
-                return;
+            residuals[0][i] = r0; cost[0] += magnitude(r0);
+            residuals[1][i] = r1; cost[1] += magnitude(r1);
+            residuals[2][i] = r2; cost[2] += magnitude(r2);
+            residuals[3][i] = r3; cost[3] += magnitude(r3);
+            residuals[4][i] = r4; cost[4] += magnitude(r4);
+        }
+        
+        int best = 0;
+        for (int f = 1; f < FILTER_COUNT; ++f) {
+            if (cost[f] < cost[best]) best = f;
+        }
+        out[0] = static_cast<unsigned char>(best);
+        std::memcpy(out + 1, residuals[best], stride);
+    }
+    
+    // IEEE 754 binary32 -> binary16 with round-to-nearest-even
+    uint16_t float_to_half(float value) {
+        uint32_t x;
+        std::memcpy(&x, &value, sizeof(x));
+        
+        const uint32_t sign = (x >> 16) & 0x8000u;
+        const uint32_t exponent_bits = (x >> 23) & 0xFFu;
+        uint32_t mantissa = x & 0x7FFFFFu;
+        
+        if (exponent_bits == 0xFFu) {
+            return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));  // Inf / NaN
+        }
+        
+        const int exponent = static_cast<int>(exponent_bits) - 127 + 15;
+        if (exponent >= 31) {
+            return static_cast<uint16_t>(sign | 0x7C00u);  // Overflow to infinity
+        }
+        
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return static_cast<uint16_t>(sign);  // Underflow to signed zero
+            }
+            // Subnormal half: shift in the implicit leading one
+            mantissa |= 0x800000u;
+            const int shift = 14 - exponent;
+            uint32_t half_mantissa = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half_mantissa & 1u))) {
+                half_mantissa++;
+            }
+            return static_cast<uint16_t>(sign | half_mantissa);
+        }
+        
+        uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+        const uint32_t remainder = mantissa & 0x1FFFu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+            half++;  // A carry into the exponent is the correct rounding result
+        }
+        return static_cast<uint16_t>(half);
+    }
+    
+    void append_exr_attribute(std::vector<unsigned char>& out, const char* name, const char* type,
+                              const std::vector<unsigned char>& value) {
+        out.insert(out.end(), name, name + std::strlen(name) + 1);
+        out.insert(out.end(), type, type + std::strlen(type) + 1);
+        append_le<int32_t>(out, static_cast<int32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+    
+    // OpenEXR ZIP compression: split even/odd bytes, delta-encode, then zlib.
+    // Falls back to the raw bytes when compression does not help, as the format allows.
+    std::vector<unsigned char> exr_zip_compress(const std::vector<unsigned char>& raw) {
+        const size_t size = raw.size();
+        std::vector<unsigned char> reordered(size);
+        
+        size_t first = 0;
+        size_t second = (size + 1) / 2;
+        for (size_t i = 0; i < size; ++i) {
+            reordered[(i & 1) ? second++ : first++] = raw[i];
+        }
+        
+        int previous = size > 0 ? reordered[0] : 0;
+        for (size_t i = 1; i < size; ++i) {
+            const int current = reordered[i];
+            reordered[i] = static_cast<unsigned char>(current - previous + (128 + 256));
+            previous = current;
+        }
+        
+        std::vector<unsigned char> compressed = Compression::zlib_compress(reordered.data(), size);
+        return compressed.size() < size ? compressed : raw;
+    }
+}
+
+bool Image::save_ppm(const std::string& filename, bool apply_tone_map) const {
+    const std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    
+    std::vector<unsigned char> data(header.size() + static_cast<size_t>(width) * height * 3);
+    std::memcpy(data.data(), header.data(), header.size());
+    unsigned char* out = data.data() + header.size();
+    
+    // PPM scanlines run top to bottom
+    for (int j = height - 1; j >= 0; --j) {
+        const Color* row = &pixels[static_cast<size_t>(j) * width];
+        for (int i = 0; i < width; ++i) {
+            const Color mapped = apply_tone_map ? Image::tone_map(row[i]) : row[i];
+            *out++ = static_cast<unsigned char>(Image::clamp_to_byte(mapped.x));
+            *out++ = static_cast<unsigned char>(Image::clamp_to_byte(mapped.y));
+            *out++ = static_cast<unsigned char>(Image::clamp_to_byte(mapped.z));
+        }
+    }
+    
+    return write_file(filename, data);
+}
+
+bool Image::save_pfm(const std::string& filename, bool apply_tone_map) const {
+    // A negative scale marks little-endian float data
+    const uint16_t endian_probe = 1;
+    const bool little_endian = *reinterpret_cast<const unsigned char*>(&endian_probe) == 1;
+    const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n" +
+                               (little_endian ? "-1.0" : "1.0") + "\n";
+    
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    std::vector<unsigned char> data(header.size() + pixel_count * 3 * sizeof(float));
+    std::memcpy(data.data(), header.data(), header.size());
+    
+    // PFM scanlines run bottom to top, which matches our row order directly
+    unsigned char* out = data.data() + header.size();
+    for (size_t p = 0; p < pixel_count; ++p) {
+        const Color value = apply_tone_map ? Image::tone_map(pixels[p]) : pixels[p];
+        const float rgb[3] = {value.x, value.y, value.z};
+        std::memcpy(out, rgb, sizeof(rgb));
+        out += sizeof(rgb);
+    }
+    
+    return write_file(filename, data);
+}
+
+bool Image::save_png(const std::string& filename, bool apply_tone_map) const {
+    constexpr int BYTES_PER_PIXEL = 3;
+    const size_t stride = static_cast<size_t>(width) * BYTES_PER_PIXEL;
+    const size_t filtered_stride = stride + 1;  // Leading filter-type byte per row
+    
+    // Row bands are the unit of parallel work for tone mapping, filtering and compression
+    const int band_count = std::max(1, std::min(height, Parallel::thread_count() * 2));
+    const int rows_per_band = (height + band_count - 1) / band_count;
+    
+    // Tone map into 8-bit rows, top row first as PNG expects
+    std::vector<unsigned char> rgb(stride * height);
+    Parallel::parallel_for(band_count, [&](int band) {
+        const int row_end = std::min(height, (band + 1) * rows_per_band);
+        for (int row = band * rows_per_band; row < row_end; ++row) {
+            const Color* src = &pixels[static_cast<size_t>(height - 1 - row) * width];
+            unsigned char* dst = &rgb[row * stride];
+            for (int i = 0; i < width; ++i) {
+                const Color mapped = apply_tone_map ? Image::tone_map(src[i]) : src[i];
+                dst[i * 3 + 0] = static_cast<unsigned char>(Image::clamp_to_byte(mapped.x));
+                dst[i * 3 + 1] = static_cast<unsigned char>(Image::clamp_to_byte(mapped.y));
+                dst[i * 3 + 2] = static_cast<unsigned char>(Image::clamp_to_byte(mapped.z));
+            }
+        }
+    });
+    
+    // Filtering only reads the unfiltered previous row, so bands are independent
+    std::vector<unsigned char> filtered(filtered_stride * height);
+    Parallel::parallel_for(band_count, [&](int band) {
+        PROFILE_SCOPE("PNG filter band");
+        std::vector<unsigned char> scratch;
+        const int row_end = std::min(height, (band + 1) * rows_per_band);
+        for (int row = band * rows_per_band; row < row_end; ++row) {
+            const unsigned char* prev_row = row > 0 ? &rgb[(row - 1) * stride] : nullptr;
+            filter_png_row(&rgb[row * stride], prev_row, stride, BYTES_PER_PIXEL,
+                           &filtered[row * filtered_stride], scratch);
+        }
+    });
+    
+    const std::vector<unsigned char> idat = Compression::zlib_compress_parallel(
+        filtered.data(), filtered.size(), filtered_stride * rows_per_band);
+    
+    std::vector<unsigned char> ihdr;
+    append_be32(ihdr, static_cast<uint32_t>(width));
+    append_be32(ihdr, static_cast<uint32_t>(height));
+    ihdr.push_back(8);  // Bit depth
+    ihdr.push_back(2);  // Color type: RGB
+    ihdr.push_back(0);  // Compression: deflate
+    ihdr.push_back(0);  // Filter method: adaptive
+    ihdr.push_back(0);  // No interlacing
+    
+    static const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<unsigned char> data(PNG_SIGNATURE, PNG_SIGNATURE + 8);
+    data.reserve(idat.size() + 64);
+    append_png_chunk(data, "IHDR", ihdr.data(), ihdr.size());
+    append_png_chunk(data, "IDAT", idat.data(), idat.size());
+    append_png_chunk(data, "IEND", nullptr, 0);
+    
+    return write_file(filename, data);
+}
+
+bool Image::save_exr(const std::string& filename) const {
+    constexpr int TILE_SIZE = 64;
+    constexpr int HALF_PIXEL_TYPE = 1;
+    constexpr unsigned char ZIP_COMPRESSION = 3;
+    static const char* const CHANNELS[3] = {"B", "G", "R"};  // EXR stores channels alphabetically
+    
+    std::vector<unsigned char> header;
+    append_le<uint32_t>(header, 20000630u);          // Magic number
+    append_le<uint32_t>(header, 2u | 0x200u);        // Version 2, single-part tiled
+    
+    std::vector<unsigned char> value;
+    for (const char* channel : CHANNELS) {
+        value.insert(value.end(), channel, channel + std::strlen(channel) + 1);
+        append_le<int32_t>(value, HALF_PIXEL_TYPE);
+        value.insert(value.end(), {0, 0, 0, 0});     // pLinear + reserved
+        append_le<int32_t>(value, 1);                // x sampling
+        append_le<int32_t>(value, 1);                // y sampling
+    }
+    value.push_back(0);
+    append_exr_attribute(header, "channels", "chlist", value);
+    
+    append_exr_attribute(header, "compression", "compression", {ZIP_COMPRESSION});
+    
+    value.clear();
+    append_le<int32_t>(value, 0);
+    append_le<int32_t>(value, 0);
+    append_le<int32_t>(value, width - 1);
+    append_le<int32_t>(value, height - 1);
+    append_exr_attribute(header, "dataWindow", "box2i", value);
+    append_exr_attribute(header, "displayWindow", "box2i", value);
+    
+    append_exr_attribute(header, "lineOrder", "lineOrder", {0});  // Increasing Y
+    
+    value.clear();
+    append_le<float>(value, 1.0f);
+    append_exr_attribute(header, "pixelAspectRatio", "float", value);
+    append_exr_attribute(header, "screenWindowWidth", "float", value);
+    
+    value.clear();
+    append_le<float>(value, 0.0f);
+    append_le<float>(value, 0.0f);
+    append_exr_attribute(header, "screenWindowCenter", "v2f", value);
+    
+    value.clear();
+    append_le<uint32_t>(value, TILE_SIZE);
+    append_le<uint32_t>(value, TILE_SIZE);
+    value.push_back(0);  // ONE_LEVEL, round down
+    append_exr_attribute(header, "tiles", "tiledesc", value);
+    
+    header.push_back(0);  // End of header
+    
+    // Tiles are converted and compressed independently across all worker threads
+    const int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const int tile_count = tiles_x * tiles_y;
+    std::vector<std::vector<unsigned char>> tiles(tile_count);
+    
+    Parallel::parallel_for(tile_count, [&](int tile) {
+        PROFILE_SCOPE("EXR tile");
+        const int tx = tile % tiles_x;
+        const int ty = tile / tiles_x;
+        const int x0 = tx * TILE_SIZE;
+        const int y0 = ty * TILE_SIZE;
+        const int tile_width = std::min(TILE_SIZE, width - x0);
+        const int tile_height = std::min(TILE_SIZE, height - y0);
+        
+        // Per scanline, one run of halves per channel; EXR y runs top to bottom
+        std::vector<unsigned char> raw;
+        raw.reserve(static_cast<size_t>(tile_width) * tile_height * 3 * sizeof(uint16_t));
+        for (int row = y0; row < y0 + tile_height; ++row) {
+            const Color* src = &pixels[static_cast<size_t>(height - 1 - row) * width + x0];
+            for (int channel = 0; channel < 3; ++channel) {
+                for (int i = 0; i < tile_width; ++i) {
+                    const float component = channel == 0 ? src[i].z : (channel == 1 ? src[i].y : src[i].x);
+                    append_le<uint16_t>(raw, float_to_half(component));
+                }
             }
         }
+        
+        const std::vector<unsigned char> compressed = exr_zip_compress(raw);
+        std::vector<unsigned char>& chunk = tiles[tile];
+        chunk.reserve(compressed.size() + 20);
+        append_le<int32_t>(chunk, tx);
+        append_le<int32_t>(chunk, ty);
+        append_le<int32_t>(chunk, 0);  // Level x
+        append_le<int32_t>(chunk, 0);  // Level y
+        append_le<int32_t>(chunk, static_cast<int32_t>(compressed.size()));
+        chunk.insert(chunk.end(), compressed.begin(), compressed.end());
+    });
+    
+    // Offset table follows the header, then the tile chunks in order
+    std::vector<unsigned char> data = std::move(header);
+    uint64_t offset = data.size() + sizeof(uint64_t) * tile_count;
+    for (const auto& chunk : tiles) {
+        append_le<uint64_t>(data, offset);
+        offset += chunk.size();
+    }
+    data.reserve(offset);
+    for (const auto& chunk : tiles) {
+        data.insert(data.end(), chunk.begin(), chunk.end());
     }
     
-    if (file.fail()) {
+    return write_file(filename, data);
+}
+
+bool Image::save(const std::string& filename, bool apply_tone_map) const {
+    PROFILE_SCOPE("Image save");
+    
+    size_t dot_pos = filename.find_last_of('.');
+    std::string extension = dot_pos != std::string::npos ? filename.substr(dot_pos + 1) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    
+    if (extension == "ppm") return save_ppm(filename, apply_tone_map);
+    if (extension == "png") return save_png(filename, apply_tone_map);
+    if (extension == "pfm") return save_pfm(filename);
+    if (extension == "exr") return save_exr(filename);
+    
+    ErrorHandling::Logger::error("Unsupported image format: " + filename);
+    return false;
+}
+
+bool Image::is_supported_extension(const std::string& extension) {
+    return extension == "ppm" || extension == "png" || extension == "pfm" || extension == "exr";
+}
+
+bool Image::write_file(const std::string& filename, const std::vector<unsigned char>& data) {
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        ErrorHandling::Logger::error("Failed to open file for writing: " + filename);
+        return false;
+    }
+    
+    // Unbuffered: the whole image goes out in one write instead of being copied through stdio
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    const size_t written = std::fwrite(data.data(), 1, data.size(), file);
+    const bool closed = std::fclose(file) == 0;
+    
+    if (written != data.size() || !closed) {
         ErrorHandling::Logger::error("Failed to write complete image to file: " + filename);
+        return false;
     }
+    return true;
 }
 
 Color Image::tone_map(const Color& hdr_color) {
@@ -66,7 +66,7 @@ void InputHandler::process_mouse(double x_pos, double y_pos) {
     camera->update_camera();
     
     if (window) {
-        window->reset_accumulation();
+        window->camera_changed();
     }
 }
 
@@ -150,14 +150,14 @@ void InputHandler::update(float delta_time) {
         camera->update_camera();
         
         if (window) {
-            window->reset_accumulation();
+            window->camera_changed();
         }
     }
     
     if (camera_moved) {
         camera->update_camera();
         if (window) {
-            window->reset_accumulation();
+            window->camera_changed();
         }
     }
 }
@@ -0,0 +1,73 @@
+#include "light_tree.h"
+#include "profiler.h"
+#include <algorithm>
+#include <limits>
+
+void LightTree::build(const std::vector<std::shared_ptr<Light>>& lights) {
+    PROFILE_SCOPE("Light tree build");
+    
+    nodes_.clear();
+    
+    std::vector<Entry> entries;
+    for (size_t i = 0; i < lights.size(); ++i) {
+        const Light& light = *lights[i];
+        if (light.type != LightType::POINT && light.type != LightType::SPOT) continue;
+        
+        float energy = luminance(light.intensity);
+        if (energy <= 0.0f) continue;  // Never contributes, so it is never worth sampling
+        entries.push_back({light.position, energy, static_cast<int>(i)});
+    }
+    
+    if (entries.empty()) return;
+    
+    // A binary tree over N leaves has 2N - 1 nodes
+    nodes_.reserve(2 * entries.size() - 1);
+    build_recursive(entries, 0, static_cast<int>(entries.size()));
+}
+
+int LightTree::build_recursive(std::vector<Entry>& entries, int start, int end) {
+    const int index = static_cast<int>(nodes_.size());
+    nodes_.push_back(Node{});
+    
+    Vec3 bounds_min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    Vec3 bounds_max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    float energy = 0.0f;
+    for (int i = start; i < end; ++i) {
+        const Vec3& p = entries[i].position;
+        bounds_min = Vec3(std::min(bounds_min.x, p.x), std::min(bounds_min.y, p.y), std::min(bounds_min.z, p.z));
+        bounds_max = Vec3(std::max(bounds_max.x, p.x), std::max(bounds_max.y, p.y), std::max(bounds_max.z, p.z));
+        energy += entries[i].energy;
+    }
+    
+    int light_index = -1, left = -1, right = -1;
+    if (end - start == 1) {
+        light_index = entries[start].light_index;
+    } else {
+        // Median split along the longest axis, as in the geometry BVH
+        Vec3 extent = bounds_max - bounds_min;
+        int axis = 0;
+        if (extent.y > extent.x) axis = 1;
+        if (extent.z > (axis == 0 ? extent.x : extent.y)) axis = 2;
+        
+        int mid = start + (end - start) / 2;
+        std::nth_element(entries.begin() + start, entries.begin() + mid, entries.begin() + end,
+            [axis](const Entry& a, const Entry& b) {
+                if (axis == 0) return a.position.x < b.position.x;
+                if (axis == 1) return a.position.y < b.position.y;
+                return a.position.z < b.position.z;
+            });
+        
+        left = build_recursive(entries, start, mid);
+        right = build_recursive(entries, mid, end);
+    }
+    
+    // Children were appended after this node, so write it by index rather than by reference
+    Node& node = nodes_[index];
+    node.bounds_min = bounds_min;
+    node.energy = energy;
+    node.bounds_max = bounds_max;
+    node.light_index = light_index;
+    node.left = left;
+    node.right = right;
+    return index;
+}
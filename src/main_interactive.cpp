@@ -3,6 +3,7 @@
 #include "parser.h"
 #include "gpu_raytracer.h"
 #include "image.h"
+#include "profiler.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -18,7 +19,32 @@ int main(int argc, char* argv[]) {
         std::cout << "  -h, --height <int>       Window height (default: 800)\n";
         std::cout << "  -s, --samples <int>      Samples per frame (default: 1)\n";
         std::cout << "  -d, --depth <int>        Maximum ray depth (default: 8)\n";
-        std::cout << "  -o, --output <filename>  Save rendered frame to file (headless mode)\n";
+        std::cout << "  --rr-depth <int>         Bounces traced before Russian roulette on path throughput (default: 3)\n";
+        std::cout << "  --max-diffuse <int>      Diffuse bounces per path (default: 0 = limited by --depth only)\n";
+        std::cout << "  --max-specular <int>     Metal reflections per path (default: 0 = limited by --depth only)\n";
+        std::cout << "  --max-transmission <int> Dielectric bounces per path (default: 0 = limited by --depth only)\n";
+        std::cout << "  --light-samples <int>    Lights sampled per shading point from the light tree (default: 1)\n";
+        std::cout << "  --sampler <name>         Sample generator: sobol, blue-noise or random (default: sobol)\n";
+        std::cout << "  --adaptive <threshold>   Stop tracing 8x8 tiles once their tone-mapped noise falls below threshold\n";
+        std::cout << "                           (e.g. 0.005; default: 0 = off). Headless: --spp becomes the maximum\n";
+        std::cout << "  --denoise                Edge-aware a-trous denoising (interactive: GPU, toggle with N;\n";
+        std::cout << "                           headless: applied to the final image on the CPU)\n";
+        std::cout << "  --reproject <blend>      Interactive: keep accumulated samples while the camera moves by reprojecting\n";
+        std::cout << "                           them, new passes weighing at least blend (e.g. 0.1; default: 0 = off)\n";
+        std::cout << "  --frame-budget <ms>      Interactive: lower resolution and samples while moving to keep GPU time\n";
+        std::cout << "                           near ms per frame (e.g. 16.6; default: 0 = always full quality)\n";
+        std::cout << "  --motion-pattern <name>  Interactive: pixels traced while the camera moves: full, checkerboard\n";
+        std::cout << "                           or foveated (checkerboard centre, quarter rate outside; default: full)\n";
+        std::cout << "  --tile <size>            Dispatch passes as size x size pixel tiles, centre first, so long\n";
+        std::cout << "                           frames stay under driver watchdog limits (default: 0 = whole image)\n";
+        std::cout << "  --tiles-per-submit <int> Tiles dispatched per submission; interactive mode shows the pass\n";
+        std::cout << "                           filling in at this rate (default: 4)\n";
+        std::cout << "  -o, --output <filename>  Save rendered frame to file (headless mode: .png, .ppm, .exr, .pfm)\n";
+        std::cout << "  --no-tonemap             Write linear values without tone mapping (EXR/PFM are always linear)\n";
+        std::cout << "  --spp <int>              Headless: accumulate passes until this many samples per pixel\n";
+        std::cout << "  --time-budget <seconds>  Headless: accumulate passes until the time budget is spent\n";
+        std::cout << "  --checkpoint <int>       Headless: rewrite the output image every N passes\n";
+        std::cout << "  --trace <file.json>      Write a Chrome trace timeline on exit (needs ENABLE_PROFILING)\n";
         std::cout << "Controls:\n";
         std::cout << "  WASD - Move camera\n";
         std::cout << "  Click - Capture/release mouse for looking\n";
@@ -26,6 +52,7 @@ int main(int argc, char* argv[]) {
         std::cout << "  Space/Shift - Move up/down\n";
         std::cout << "  R - Reset camera position\n";
         std::cout << "  F1 - Toggle detailed stats\n";
+        std::cout << "  N - Toggle denoising\n";
         std::cout << "  ESC - Exit\n";
         return 1;
     }
@@ -36,7 +63,22 @@ int main(int argc, char* argv[]) {
     int window_height = 800;
     int samples_per_frame = 4;
     int max_depth = 10;
+    PathTermination path_termination;
+    int light_samples = 1;
+    Sampling::Type sampler_type = Sampling::Type::SOBOL;
+    float adaptive_threshold = 0.0f;  // 0 = adaptive sampling off
+    bool denoise = false;
+    float reproject_blend = 0.0f;     // 0 = restart accumulation on camera motion
+    float frame_budget_ms = 0.0f;     // 0 = dynamic resolution off
+    SparsePattern motion_pattern = SparsePattern::None;
+    int tile_size = 0;                // 0 = one dispatch per pass
+    int tiles_per_submit = 4;
     std::string output_filename = "";
+    bool tone_map_output = true;
+    int target_spp = 0;               // 0 = no sample target
+    double time_budget = 0.0;         // Seconds, 0 = no time budget
+    int checkpoint_interval = 0;      // Passes between checkpoint images, 0 = disabled
+    std::string trace_filename;
     
     try {
         for (int i = 2; i < argc; i++) {
@@ -61,10 +103,105 @@ int main(int argc, char* argv[]) {
                 if (max_depth <= 0) {
                     throw std::invalid_argument("Max ray depth must be positive");
                 }
+            } else if (arg == "--rr-depth" && i + 1 < argc) {
+                path_termination.roulette_depth = std::stoi(argv[++i]);
+                if (path_termination.roulette_depth < 0) {
+                    throw std::invalid_argument("Russian roulette depth must not be negative");
+                }
+            } else if (arg == "--max-diffuse" && i + 1 < argc) {
+                path_termination.diffuse_bounces = std::stoi(argv[++i]);
+                if (path_termination.diffuse_bounces < 0) {
+                    throw std::invalid_argument("Diffuse bounce limit must not be negative");
+                }
+            } else if (arg == "--max-specular" && i + 1 < argc) {
+                path_termination.specular_bounces = std::stoi(argv[++i]);
+                if (path_termination.specular_bounces < 0) {
+                    throw std::invalid_argument("Specular bounce limit must not be negative");
+                }
+            } else if (arg == "--max-transmission" && i + 1 < argc) {
+                path_termination.transmission_bounces = std::stoi(argv[++i]);
+                if (path_termination.transmission_bounces < 0) {
+                    throw std::invalid_argument("Transmission bounce limit must not be negative");
+                }
+            } else if (arg == "--light-samples" && i + 1 < argc) {
+                light_samples = std::stoi(argv[++i]);
+                if (light_samples <= 0) {
+                    throw std::invalid_argument("Light samples must be positive");
+                }
+            } else if (arg == "--sampler" && i + 1 < argc) {
+                if (!Sampling::parse_type(argv[++i], sampler_type)) {
+                    throw std::invalid_argument("Unknown sampler (expected sobol, blue-noise or random)");
+                }
+            } else if (arg == "--adaptive" && i + 1 < argc) {
+                adaptive_threshold = std::stof(argv[++i]);
+                if (adaptive_threshold < 0.0f) {
+                    throw std::invalid_argument("Adaptive sampling threshold must not be negative");
+                }
+            } else if (arg == "--denoise") {
+                denoise = true;
+            } else if (arg == "--reproject" && i + 1 < argc) {
+                reproject_blend = std::stof(argv[++i]);
+                if (reproject_blend < 0.0f || reproject_blend > 1.0f) {
+                    throw std::invalid_argument("Reprojection blend must be between 0 and 1");
+                }
+            } else if (arg == "--motion-pattern" && i + 1 < argc) {
+                const std::string name = argv[++i];
+                if (name == "full") {
+                    motion_pattern = SparsePattern::None;
+                } else if (name == "checkerboard") {
+                    motion_pattern = SparsePattern::Checkerboard;
+                } else if (name == "foveated") {
+                    motion_pattern = SparsePattern::Foveated;
+                } else {
+                    throw std::invalid_argument("Unknown motion pattern (expected full, checkerboard or foveated)");
+                }
+            } else if (arg == "--tile" && i + 1 < argc) {
+                tile_size = std::stoi(argv[++i]);
+                if (tile_size < 0) {
+                    throw std::invalid_argument("Tile size must not be negative");
+                }
+            } else if (arg == "--tiles-per-submit" && i + 1 < argc) {
+                tiles_per_submit = std::stoi(argv[++i]);
+                if (tiles_per_submit <= 0) {
+                    throw std::invalid_argument("Tiles per submit must be positive");
+                }
+            } else if (arg == "--frame-budget" && i + 1 < argc) {
+                frame_budget_ms = std::stof(argv[++i]);
+                if (frame_budget_ms < 0.0f) {
+                    throw std::invalid_argument("Frame budget must not be negative");
+                }
             } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
                 output_filename = argv[++i];
+            } else if (arg == "--no-tonemap") {
+                tone_map_output = false;
+            } else if (arg == "--spp" && i + 1 < argc) {
+                target_spp = std::stoi(argv[++i]);
+                if (target_spp <= 0) {
+                    throw std::invalid_argument("Target samples per pixel must be positive");
+                }
+            } else if (arg == "--time-budget" && i + 1 < argc) {
+                time_budget = std::stod(argv[++i]);
+                if (time_budget <= 0.0) {
+                    throw std::invalid_argument("Time budget must be positive");
+                }
+            } else if (arg == "--checkpoint" && i + 1 < argc) {
+                checkpoint_interval = std::stoi(argv[++i]);
+                if (checkpoint_interval <= 0) {
+                    throw std::invalid_argument("Checkpoint interval must be positive");
+                }
+            } else if (arg == "--trace" && i + 1 < argc) {
+                trace_filename = argv[++i];
             }
         }
+        
+        if (!trace_filename.empty()) {
+#ifdef ENABLE_PROFILING
+            PerformanceProfiler::get_instance().set_timeline_enabled(true);
+#else
+            std::cerr << "Warning: --trace ignored, profiling is not compiled in (ENABLE_PROFILING)" << std::endl;
+            trace_filename.clear();
+#endif
+        }
         std::cout << "Loading scene: " << scene_file << std::endl;
         
         // Load scene
@@ -79,8 +216,13 @@ int main(int argc, char* argv[]) {
         if (!output_filename.empty()) {
             std::cout << "Rendering to file: " << output_filename << std::endl;
             std::cout << "Resolution: " << window_width << "x" << window_height << std::endl;
-            std::cout << "Samples per pixel: " << samples_per_frame << std::endl;
+            std::cout << "Samples per pass: " << samples_per_frame << std::endl;
+            if (target_spp > 0) std::cout << "Target samples per pixel: " << target_spp << std::endl;
+            if (time_budget > 0.0) std::cout << "Time budget: " << time_budget << "s" << std::endl;
             std::cout << "Max ray depth: " << max_depth << std::endl;
+            if (tile_size > 0) {
+                std::cout << "Tiles: " << tile_size << "x" << tile_size << ", " << tiles_per_submit << " per submit" << std::endl;
+            }
             
             // Create headless GPU raytracer for file output
             // We still need a minimal OpenGL context, but no visible window
@@ -119,35 +261,15 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
+            gpu_raytracer.set_path_termination(path_termination);
+            gpu_raytracer.set_light_samples(light_samples);
+            gpu_raytracer.set_sampler(sampler_type);
+            gpu_raytracer.set_adaptive_threshold(adaptive_threshold);
+            gpu_raytracer.set_gbuffer_output(denoise);
+            gpu_raytracer.set_tiling(tile_size, tiles_per_submit);
             gpu_raytracer.load_scene(scene);
             
-            // Render frame
-            auto start_time = std::chrono::high_resolution_clock::now();
-            gpu_raytracer.render(scene.camera, samples_per_frame, max_depth);
-            auto end_time = std::chrono::high_resolution_clock::now();
-            
-            // Capture the rendered frame
-            Image image(window_width, window_height);
-            std::vector<unsigned char> pixels(window_width * window_height * 3);
-            
-            // Read pixels from framebuffer
-            glReadPixels(0, 0, window_width, window_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-            
-            // Convert from OpenGL format to image format
-            for (int y = 0; y < window_height; ++y) {
-                for (int x = 0; x < window_width; ++x) {
-                    int gl_y = window_height - 1 - y;  // Flip Y axis
-                    int pixel_index = (gl_y * window_width + x) * 3;
-                    
-                    float r = pixels[pixel_index] / 255.0f;
-                    float g = pixels[pixel_index + 1] / 255.0f;
-                    float b = pixels[pixel_index + 2] / 255.0f;
-                    
-                    image.set_pixel(x, y, Color(r, g, b));
-                }
-            }
-            
-            // Save the image
+            // Resolve the output name up front so checkpoints and the final image share it
             size_t dot_pos = output_filename.find_last_of('.');
             std::string extension;
             if (dot_pos != std::string::npos) {
@@ -155,27 +277,149 @@ int main(int argc, char* argv[]) {
                 std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
             }
             
+            // Default to PPM if no extension or unsupported extension
             std::string actual_filename = output_filename;
-            if (extension == "ppm") {
-                image.save_ppm(output_filename);
-            } else if (extension == "png") {
-                // PNG support not implemented, save as PPM instead
-                if (dot_pos != std::string::npos) {
-                    actual_filename = output_filename.substr(0, dot_pos) + ".ppm";
+            if (!Image::is_supported_extension(extension)) {
+                actual_filename = output_filename + ".ppm";
+            }
+            
+            // Without a sample target or time budget, render a single pass as before
+            if (target_spp == 0 && time_budget <= 0.0) {
+                target_spp = samples_per_frame;
+            }
+            
+            // Progressive rendering: accumulate passes until the sample target or time budget is met
+            Image image(window_width, window_height);
+            int passes = 0;
+            int accumulated_spp = 0;
+            int active_tiles = -1;
+            bool checkpoint_pending = false;
+            
+            auto start_time = std::chrono::high_resolution_clock::now();
+            while (true) {
+                int requested = samples_per_frame;
+                if (target_spp > 0) {
+                    requested = std::min(requested, target_spp - accumulated_spp);
+                }
+                gpu_raytracer.render(scene.camera, requested, max_depth);
+                if (!gpu_raytracer.pass_complete()) {
+                    // More tiles of this pass to submit; keep a single batch queued
+                    gpu_raytracer.wait_for_frames(1);
+                    continue;
+                }
+                passes++;
+                accumulated_spp = gpu_raytracer.accumulated_samples();
+                
+                // The previous checkpoint's readback completes while this pass runs
+                if (checkpoint_pending) {
+                    if (gpu_raytracer.read_accumulation(image) && image.save(actual_filename, tone_map_output)) {
+                        std::cout << "Checkpoint: " << accumulated_spp << " spp written to " << actual_filename << std::endl;
+                    }
+                    checkpoint_pending = false;
+                }
+                if (checkpoint_interval > 0 && passes % checkpoint_interval == 0) {
+                    gpu_raytracer.begin_readback();
+                    checkpoint_pending = true;
+                }
+                
+                // Keep one pass queued behind the running one so the GPU never idles
+                gpu_raytracer.wait_for_frames(1);
+                
+                if (target_spp > 0 && accumulated_spp >= target_spp) {
+                    break;
+                }
+                // The queued pass may still trace a few tiles, but every tile had converged before it
+                active_tiles = gpu_raytracer.active_tiles();
+                if (active_tiles == 0) {
+                    break;
+                }
+                if (time_budget > 0.0) {
+                    double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+                    double pass_time = elapsed / std::max(1, passes - 1);
+                    // The queued pass still has to finish; stop if one more would overrun
+                    if (elapsed + 2.0 * pass_time > time_budget) {
+                        break;
+                    }
+                }
+            }
+            gpu_raytracer.wait_for_frames(0);
+            auto end_time = std::chrono::high_resolution_clock::now();
+            gpu_raytracer.collect_gpu_timers(true);
+            
+            // Read back the linear float accumulation buffer; tone mapping happens once, on save
+            if (!gpu_raytracer.read_latest_accumulation(image)) {
+                std::cerr << "Failed to read back rendered image" << std::endl;
+                glfwDestroyWindow(headless_window);
+                glfwTerminate();
+                return 1;
+            }
+            
+            if (denoise) {
+                Denoise::GBuffer gbuffer;
+                if (gpu_raytracer.read_gbuffer(gbuffer)) {
+                    auto denoise_start = std::chrono::high_resolution_clock::now();
+                    Denoise::atrous(image, gbuffer, gpu_raytracer.get_denoise_settings());
+                    double denoise_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::high_resolution_clock::now() - denoise_start).count();
+                    std::cout << "Denoised in " << static_cast<long>(denoise_ms) << "ms" << std::endl;
                 } else {
-                    actual_filename = output_filename + ".ppm";
+                    std::cerr << "Failed to read back G-buffers, saving without denoising" << std::endl;
                 }
-                image.save_ppm(actual_filename);
-            } else {
-                // Default to PPM if no extension or unsupported extension
-                actual_filename = output_filename + ".ppm";
-                image.save_ppm(actual_filename);
             }
             
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-            std::cout << "GPU rendering completed in " << duration.count() << "ms" << std::endl;
+            bool saved = image.save(actual_filename, tone_map_output);
+            
+            if (!saved) {
+                std::cerr << "Failed to save image: " << actual_filename << std::endl;
+                glfwDestroyWindow(headless_window);
+                glfwTerminate();
+                return 1;
+            }
+            
+            double seconds = std::chrono::duration<double>(end_time - start_time).count();
+            double samples_per_second = seconds > 0.0 ?
+                static_cast<double>(window_width) * window_height * accumulated_spp / seconds : 0.0;
+            std::cout << "GPU rendering completed in " << static_cast<long>(seconds * 1000.0) << "ms" << std::endl;
+            std::cout << "Accumulated " << accumulated_spp << " spp in " << passes << " passes ("
+                      << std::fixed << std::setprecision(2) << samples_per_second / 1e6 << " Msamples/s)" << std::endl;
+            if (adaptive_threshold > 0.0f) {
+                // accumulated_spp above is the most any pixel received
+                if (active_tiles == 0) {
+                    std::cout << "Adaptive sampling: all " << gpu_raytracer.total_tiles() << " tiles converged" << std::endl;
+                } else if (active_tiles > 0) {
+                    std::cout << "Adaptive sampling: " << active_tiles << " of " << gpu_raytracer.total_tiles()
+                              << " tiles still above the noise threshold" << std::endl;
+                }
+            }
             std::cout << "Image saved as: " << actual_filename << std::endl;
             
+            // Wall-clock time above includes CPU submission and waits; these are GPU execution times
+            gpu_raytracer.collect_gpu_timers(true);
+            
+#ifdef ENABLE_RAY_STATS
+            RayStats::Snapshot ray_stats;
+            if (gpu_raytracer.read_ray_stats(ray_stats)) {
+                // Rate over GPU execution time when timer queries produced it, wall time otherwise
+                double trace_seconds = gpu_raytracer.gpu_timer_samples(GPUStage::Dispatch) == passes ?
+                    gpu_raytracer.gpu_total_ms(GPUStage::Dispatch) / 1000.0 : seconds;
+                RayStats::log_report("GPU, " + std::to_string(passes) + " passes", ray_stats, trace_seconds);
+            }
+#endif
+            int timed_passes = gpu_raytracer.gpu_timer_samples(GPUStage::Dispatch);
+            if (timed_passes > 0) {
+                double dispatch_ms = gpu_raytracer.gpu_total_ms(GPUStage::Dispatch);
+                std::cout << "GPU time: trace " << dispatch_ms << "ms (" << dispatch_ms / timed_passes
+                          << "ms/pass over " << timed_passes << " timed passes), readback "
+                          << gpu_raytracer.gpu_total_ms(GPUStage::Readback) << "ms" << std::endl;
+            }
+            
+#ifdef ENABLE_PROFILING
+            PerformanceProfiler::get_instance().print_results();
+            if (!trace_filename.empty()) {
+                PerformanceProfiler::get_instance().write_chrome_trace(trace_filename);
+            }
+#endif
+            
             glfwDestroyWindow(headless_window);
             glfwTerminate();
             return 0;
@@ -188,6 +432,15 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         
+        window.set_path_termination(path_termination);
+        window.set_light_samples(light_samples);
+        window.set_sampler(sampler_type);
+        window.set_adaptive_threshold(adaptive_threshold);
+        window.set_denoise(denoise);
+        window.set_temporal_reprojection(reproject_blend);
+        window.set_frame_budget(frame_budget_ms);
+        window.set_sparse_pattern(motion_pattern);
+        window.set_tiling(tile_size, tiles_per_submit);
         window.load_scene(scene);
         
         // Create input handler
@@ -202,6 +455,10 @@ int main(int argc, char* argv[]) {
             if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
                 window.toggle_detailed_stats();
             }
+            if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+                window.set_denoise(!window.get_denoise());
+                std::cout << "Denoising " << (window.get_denoise() ? "on" : "off") << std::endl;
+            }
             input.process_keyboard(key, action);
         });
         
@@ -225,6 +482,7 @@ int main(int argc, char* argv[]) {
         std::cout << "  Space/Shift - Move up/down" << std::endl;
         std::cout << "  R - Reset camera position" << std::endl;
         std::cout << "  F1 - Toggle detailed stats" << std::endl;
+        std::cout << "  N - Toggle denoising" << std::endl;
         std::cout << "  ESC - Exit" << std::endl;
         std::cout << "\nClick in the window to start looking around!" << std::endl;
         
@@ -245,11 +503,17 @@ int main(int argc, char* argv[]) {
                 float avg_frame_time = (frame_count > 0) ? (frame_time / frame_count * 1000.0f) : 0.0f;
                 
                 // Update window title with FPS
+#ifdef ENABLE_RAY_STATS
+                double mrays = window.update_ray_stats(frame_time);
+#endif
                 window.update_fps_display(fps, avg_frame_time);
                 
                 // Print to console (less frequently)
                 std::cout << "\rFPS: " << std::fixed << std::setprecision(1) << fps 
                          << " | Frame: " << avg_frame_time << "ms"
+#ifdef ENABLE_RAY_STATS
+                         << " | " << mrays << " Mrays/s"
+#endif
                          << " | Frames: " << total_frames << std::flush;
                          
                 frame_time = 0.0f;
@@ -284,6 +548,13 @@ int main(int argc, char* argv[]) {
             std::cout << "\nExiting normally after " << total_frames << " frames..." << std::endl;
         }
         
+#ifdef ENABLE_PROFILING
+        PerformanceProfiler::get_instance().print_results();
+        if (!trace_filename.empty()) {
+            PerformanceProfiler::get_instance().write_chrome_trace(trace_filename);
+        }
+#endif
+        
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,39 @@
+#include "mesh.h"
+#include <filesystem>
+#include <system_error>
+
+std::shared_ptr<const Mesh> MeshCache::find(const std::string& canonical_path, uint64_t content_hash) {
+    auto it = entries_.find(canonical_path);
+    if (it == entries_.end() || it->second.content_hash != content_hash) {
+        return nullptr;
+    }
+
+    hit_count_++;
+    return it->second.mesh;
+}
+
+void MeshCache::insert(const std::string& canonical_path, uint64_t content_hash, std::shared_ptr<const Mesh> mesh) {
+    entries_[canonical_path] = Entry{content_hash, std::move(mesh)};
+}
+
+std::string MeshCache::canonical_path(const std::string& filename) {
+    // weakly_canonical resolves "..", "." and symlinks without requiring the whole path to exist
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::weakly_canonical(filename, ec);
+    if (ec) {
+        return filename;
+    }
+    return path.string();
+}
+
+uint64_t MeshCache::hash_contents(const std::string& data) noexcept {
+    constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
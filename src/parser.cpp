@@ -1,6 +1,7 @@
 #include "parser.h"
 #include "light.h"
 #include "error_handling.h"
+#include "profiler.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
@@ -27,6 +28,8 @@ void Parser::FaceStatistics::log_statistics(size_t vertex_count) const {
 }
 
 bool Parser::parse_scene_file(const std::string& filename, Scene& scene) {
+    PROFILE_SCOPE("Scene parse");
+    
     // Determine file type by extension
     size_t dot_pos = filename.find_last_of('.');
     if (dot_pos == std::string::npos) {
@@ -54,7 +57,8 @@ bool Parser::parse_obj_file(const std::string& filename, Scene& scene) {
     int material_id = 0;  // Use default material
     
     // Call the main OBJ parser with camera setup enabled
-    return parse_obj_file_with_material(filename, scene, material_id, true);
+    MeshCache mesh_cache;
+    return parse_obj_file_with_material(filename, scene, material_id, mesh_cache, Vec3(0, 0, 0), true);
 }
 
 // Helper function to parse vertex indices from a face line
@@ -91,11 +95,9 @@ std::vector<int> Parser::parse_face_indices(std::istringstream& iss) {
     return face_indices;
 }
 
-// Helper function to triangulate a face and add triangles to the scene
+// Helper function to triangulate a face into the mesh index list
 void Parser::triangulate_face(const std::vector<int>& face_indices, 
-                             const std::vector<Vec3>& vertices,
-                             Scene& scene, 
-                             int material_id, 
+                             Mesh& mesh, 
                              FaceStatistics& stats) {
     if (face_indices.size() < 3) {
         return;
@@ -105,16 +107,12 @@ void Parser::triangulate_face(const std::vector<int>& face_indices,
     stats.update_face_type(face_indices.size());
     
     // Fan triangulation for polygons with more than 3 vertices
+    const size_t vertex_count = mesh.vertices.size();
     for (size_t i = 1; i < face_indices.size() - 1; i++) {
-        if (static_cast<size_t>(face_indices[0]) < vertices.size() && 
-            static_cast<size_t>(face_indices[i]) < vertices.size() && 
-            static_cast<size_t>(face_indices[i + 1]) < vertices.size()) {
-            scene.add_object(std::make_shared<Triangle>(
-                vertices[face_indices[0]],
-                vertices[face_indices[i]],
-                vertices[face_indices[i + 1]],
-                material_id
-            ));
+        if (static_cast<size_t>(face_indices[0]) < vertex_count && 
+            static_cast<size_t>(face_indices[i]) < vertex_count && 
+            static_cast<size_t>(face_indices[i + 1]) < vertex_count) {
+            mesh.triangles.push_back({face_indices[0], face_indices[i], face_indices[i + 1]});
             stats.total_triangles_created++;
         } else {
             ErrorHandling::Logger::warning("Vertex index out of bounds in OBJ file, skipping triangle");
@@ -122,6 +120,21 @@ void Parser::triangulate_face(const std::vector<int>& face_indices,
     }
 }
 
+// Helper function to emit one triangle per mesh face with the given material binding and placement
+void Parser::add_mesh_to_scene(const std::shared_ptr<const Mesh>& mesh, Scene& scene, int material_id,
+                               const Vec3& offset) {
+    const std::vector<Vec3>& vertices = mesh->vertices;
+    for (const auto& tri : mesh->triangles) {
+        scene.add_object(scene.make_object<Triangle>(
+            vertices[tri[0]] + offset,
+            vertices[tri[1]] + offset,
+            vertices[tri[2]] + offset,
+            material_id
+        ));
+    }
+    scene.add_mesh_instance(mesh, material_id, offset);
+}
+
 // Helper function to update bounding box for camera positioning
 void Parser::update_bounds(const Vec3& vertex, Vec3& min_bounds, Vec3& max_bounds) {
     min_bounds.x = std::min(min_bounds.x, vertex.x);
@@ -146,21 +159,55 @@ void Parser::setup_camera_from_bounds(Scene& scene, const Vec3& min_bounds, cons
     scene.camera = Camera(camera_pos, camera_target, camera_up, 50.0f, 16.0f/9.0f);
 }
 
-bool Parser::parse_obj_file_with_material(const std::string& filename, Scene& scene, int material_id, bool setup_camera) {
-    std::ifstream file(filename);
+bool Parser::parse_obj_file_with_material(const std::string& filename, Scene& scene, int material_id,
+                                          MeshCache& mesh_cache, const Vec3& offset, bool setup_camera) {
+    std::shared_ptr<const Mesh> mesh = load_obj_mesh(filename, mesh_cache);
+    if (!mesh) {
+        return false;
+    }
+    
+    add_mesh_to_scene(mesh, scene, material_id, offset);
+    
+    // Set up camera based on model bounds if requested
+    if (setup_camera && mesh->vertices.size() > 0) {
+        setup_camera_from_bounds(scene, mesh->min_bounds + offset, mesh->max_bounds + offset);
+    }
+    
+    return true;
+}
+
+std::shared_ptr<const Mesh> Parser::load_obj_mesh(const std::string& filename, MeshCache& mesh_cache) {
+    std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         ErrorHandling::Logger::error("Could not open file: " + filename);
-        return false;
+        return nullptr;
     }
     
-    std::vector<Vec3> vertices;
+    // Read the whole file once: the same bytes feed the content hash and the parser
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    const std::string contents = buffer.str();
+    
+    const std::string canonical = MeshCache::canonical_path(filename);
+    const uint64_t content_hash = MeshCache::hash_contents(contents);
+    
+    if (auto cached = mesh_cache.find(canonical, content_hash)) {
+        ErrorHandling::Logger::info("OBJ cache hit: " + filename + " (" +
+                                    std::to_string(cached->triangles.size()) + " triangles shared)");
+        return cached;
+    }
+    
+    std::shared_ptr<const Mesh> mesh = parse_obj_mesh(contents);
+    mesh_cache.insert(canonical, content_hash, mesh);
+    return mesh;
+}
+
+std::shared_ptr<const Mesh> Parser::parse_obj_mesh(const std::string& contents) {
+    auto mesh = std::make_shared<Mesh>();
+    std::istringstream file(contents);
     std::string line;
     FaceStatistics stats;
     
-    // Bounds tracking for camera positioning
-    Vec3 min_bounds{1000000.0f, 1000000.0f, 1000000.0f};
-    Vec3 max_bounds{-1000000.0f, -1000000.0f, -1000000.0f};
-    
     while (std::getline(file, line)) {
         // Strip comments from the line first
         std::string clean_line = strip_comments(line);
@@ -178,30 +225,23 @@ bool Parser::parse_obj_file_with_material(const std::string& filename, Scene& sc
             float x, y, z;
             iss >> x >> y >> z;
             Vec3 vertex(x, y, z);
-            vertices.push_back(vertex);
+            mesh->vertices.push_back(vertex);
             
-            // Update bounds for camera positioning
-            if (setup_camera) {
-                update_bounds(vertex, min_bounds, max_bounds);
-            }
+            // Track bounds for camera positioning
+            update_bounds(vertex, mesh->min_bounds, mesh->max_bounds);
         } else if (prefix == "f") {
             // Parse face indices
             std::vector<int> face_indices = parse_face_indices(iss);
             
-            // Triangulate and add to scene
-            triangulate_face(face_indices, vertices, scene, material_id, stats);
+            // Triangulate into the mesh index list
+            triangulate_face(face_indices, *mesh, stats);
         }
     }
     
-    // Set up camera based on model bounds if requested
-    if (setup_camera && vertices.size() > 0) {
-        setup_camera_from_bounds(scene, min_bounds, max_bounds);
-    }
-    
     // Log OBJ parsing statistics
-    stats.log_statistics(vertices.size());
+    stats.log_statistics(mesh->vertices.size());
     
-    return true;
+    return mesh;
 }
 
 bool Parser::parse_scene_description_file(const std::string& filename, Scene& scene) {
@@ -213,6 +253,7 @@ bool Parser::parse_scene_description_file(const std::string& filename, Scene& sc
     
     std::string line;
     std::map<std::string, int> material_map;
+    MeshCache mesh_cache;  // Repeated load_obj references parse each file once
     int line_number = 0;
     bool has_valid_content = false;
     
@@ -355,7 +396,7 @@ bool Parser::parse_scene_description_file(const std::string& filename, Scene& sc
                 return false;
             }
             
-            scene.add_object(std::make_shared<Sphere>(center, radius, material_id));
+            scene.add_object(scene.make_object<Sphere>(center, radius, material_id));
             has_valid_content = true;
             
         } else if (command == "plane") {
@@ -380,7 +421,7 @@ bool Parser::parse_scene_description_file(const std::string& filename, Scene& sc
                 return false;
             }
             
-            scene.add_object(std::make_shared<Plane>(point, normal, material_id));
+            scene.add_object(scene.make_object<Plane>(point, normal, material_id));
             has_valid_content = true;
             
         } else if (command == "point_light") {
@@ -473,8 +514,17 @@ bool Parser::parse_scene_description_file(const std::string& filename, Scene& sc
                 return false;
             }
             
+            // Optional translation, so one OBJ file can be placed several times
+            Vec3 offset(0, 0, 0);
+            if (iss >> offset.x) {
+                if (!(iss >> offset.y >> offset.z)) {
+                    ErrorHandling::Logger::error("Invalid load_obj offset at line " + std::to_string(line_number) + ": " + line);
+                    return false;
+                }
+            }
+            
             // Load OBJ file with specific material
-            if (!Parser::parse_obj_file_with_material(obj_filename, scene, material_id)) {
+            if (!Parser::parse_obj_file_with_material(obj_filename, scene, material_id, mesh_cache, offset)) {
                 ErrorHandling::Logger::error("Failed to load OBJ file '" + obj_filename + "' at line " + std::to_string(line_number));
                 return false;
             }
@@ -513,7 +563,7 @@ bool Parser::parse_scene_description_file(const std::string& filename, Scene& sc
                 return false;
             }
             
-            scene.add_object(std::make_shared<Cylinder>(base_center, axis, radius, height, material_id));
+            scene.add_object(scene.make_object<Cylinder>(base_center, axis, radius, height, material_id));
             has_valid_content = true;
         } else {
             // Unrecognized command - this is an error
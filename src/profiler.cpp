@@ -1,46 +1,273 @@
 #include "profiler.h"
 #include "error_handling.h"
-#include <iostream>
+#include <algorithm>
+#include <cstdio>
 #include <iomanip>
 #include <limits>
+#include <sstream>
+#include <thread>
 
 PerformanceProfiler PerformanceProfiler::instance_;
 
-void PerformanceProfiler::start_timer(const std::string& name) {
-    // For manual timing (not used with RAII approach)
+PerformanceProfiler::PerformanceProfiler()
+    : calibration_time_(std::chrono::steady_clock::now()), calibration_ticks_(now_ticks()) {
+    scope_names_.reserve(MAX_SCOPES);
 }
 
-void PerformanceProfiler::end_timer(const std::string& name) {
-    // For manual timing (not used with RAII approach)
+PerformanceProfiler::ThreadBufferLease::~ThreadBufferLease() {
+    if (buffer) {
+        PerformanceProfiler::get_instance().release_buffer(buffer);
+    }
+}
+
+PerformanceProfiler::ThreadBuffer* PerformanceProfiler::acquire_buffer() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_buffers_.empty()) {
+        ThreadBuffer* buffer = free_buffers_.back();
+        free_buffers_.pop_back();
+        buffer->open_depth = 0;
+        buffer->thread_index = next_thread_index_++;
+        return buffer;
+    }
+    buffers_.push_back(std::make_unique<ThreadBuffer>());
+    buffers_.back()->thread_index = next_thread_index_++;
+    return buffers_.back().get();
+}
+
+void PerformanceProfiler::release_buffer(ThreadBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_buffers_.push_back(buffer);
+}
+
+void PerformanceProfiler::append_event(ThreadBuffer& buffer, ScopeId id, uint64_t start_ticks, uint64_t end_ticks) {
+    const size_t index = buffer.event_count.load(std::memory_order_relaxed);
+    const size_t chunk = index / EVENTS_PER_CHUNK;
+    if (chunk == buffer.event_chunks.size()) {
+        // Cold path, once per EVENTS_PER_CHUNK events: the trace writer walks event_chunks under this lock
+        auto new_chunk = std::make_unique<EventChunk>();
+        std::lock_guard<std::mutex> lock(instance_.mutex_);
+        buffer.event_chunks.push_back(std::move(new_chunk));
+    }
+    (*buffer.event_chunks[chunk])[index % EVENTS_PER_CHUNK] = TraceEvent{start_ticks, end_ticks, id, buffer.thread_index};
+    buffer.event_count.store(index + 1, std::memory_order_release);
+}
+
+void PerformanceProfiler::sync_gpu_clock(uint64_t gpu_timestamp_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!gpu_buffer_) {
+        buffers_.push_back(std::make_unique<ThreadBuffer>());
+        gpu_buffer_ = buffers_.back().get();
+        gpu_buffer_->thread_index = next_thread_index_++;
+        gpu_buffer_->gpu_track = true;
+    }
+    gpu_sync_ns_ = gpu_timestamp_ns;
+    gpu_sync_ticks_ = now_ticks();
+}
+
+PerformanceProfiler::ScopeId PerformanceProfiler::intern(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = scope_ids_.find(name);
+    if (it != scope_ids_.end()) {
+        return it->second;
+    }
+
+    if (scope_names_.size() >= MAX_SCOPES) {
+        ErrorHandling::Logger::warning("Profiler scope limit reached, not recording: " + name);
+        return INVALID_SCOPE;
+    }
+
+    ScopeId id = static_cast<ScopeId>(scope_names_.size());
+    scope_names_.push_back(name);
+    scope_ids_.emplace(name, id);
+    return id;
+}
+
+void PerformanceProfiler::start_timer(ScopeId id) {
+    ThreadBuffer& buffer = thread_buffer();
+    if (buffer.open_depth >= static_cast<int>(buffer.open_starts.size())) {
+        ErrorHandling::Logger::warning("Profiler timer nesting too deep");
+        return;
+    }
+    buffer.open_ids[buffer.open_depth] = id;
+    buffer.open_starts[buffer.open_depth] = now_ticks();
+    buffer.open_depth++;
+}
+
+void PerformanceProfiler::end_timer(ScopeId id) {
+    const uint64_t end_ticks = now_ticks();
+    ThreadBuffer& buffer = thread_buffer();
+    if (buffer.open_depth == 0 || buffer.open_ids[buffer.open_depth - 1] != id) {
+        ErrorHandling::Logger::warning("Profiler end_timer does not match the innermost start_timer");
+        return;
+    }
+    buffer.open_depth--;
+    record(id, buffer.open_starts[buffer.open_depth], end_ticks);
+}
+
+double PerformanceProfiler::ticks_per_ms() const {
+#ifdef PROFILER_HAS_TSC
+    // Calibrate the TSC against steady_clock over the profiler's lifetime (at least 10ms)
+    auto now = std::chrono::steady_clock::now();
+    while (now - calibration_time_ < std::chrono::milliseconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        now = std::chrono::steady_clock::now();
+    }
+    const uint64_t ticks = now_ticks();
+    const double elapsed_ms = std::chrono::duration<double, std::milli>(now - calibration_time_).count();
+    return static_cast<double>(ticks - calibration_ticks_) / elapsed_ms;
+#else
+    return 1e6;  // Ticks are nanoseconds
+#endif
 }
 
 void PerformanceProfiler::print_results() const {
-    if (profiles_.empty()) {
+    struct Totals {
+        uint64_t call_count = 0;
+        double total_time = 0.0;
+        double min_time = std::numeric_limits<double>::max();
+        double max_time = 0.0;
+    };
+
+    const double ms_per_tick = 1.0 / ticks_per_ms();
+
+    std::vector<std::string> names;
+    std::vector<Totals> totals;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        names = scope_names_;
+        totals.resize(names.size());
+        for (const auto& buffer : buffers_) {
+            const double ms_per_unit = buffer->gpu_track ? 1e-6 : ms_per_tick;
+            for (size_t id = 0; id < names.size(); ++id) {
+                const ScopeSlot& slot = buffer->slots[id];
+                const uint64_t calls = slot.call_count.load(std::memory_order_relaxed);
+                if (calls == 0) continue;
+                Totals& t = totals[id];
+                t.call_count += calls;
+                t.total_time += slot.total_ticks.load(std::memory_order_relaxed) * ms_per_unit;
+                t.min_time = std::min(t.min_time, slot.min_ticks.load(std::memory_order_relaxed) * ms_per_unit);
+                t.max_time = std::max(t.max_time, slot.max_ticks.load(std::memory_order_relaxed) * ms_per_unit);
+            }
+        }
+    }
+
+    bool any_data = std::any_of(totals.begin(), totals.end(),
+                                [](const Totals& t) { return t.call_count > 0; });
+    if (!any_data) {
         ErrorHandling::Logger::info("No profiling data available");
         return;
     }
-    
+
     ErrorHandling::Logger::info("=== Performance Profiling Results ===");
     ErrorHandling::Logger::info("Name                     | Calls  | Total(ms) | Avg(ms)  | Min(ms)  | Max(ms)");
     ErrorHandling::Logger::info("-------------------------|--------|-----------|----------|----------|----------");
-    
-    for (const auto& [name, data] : profiles_) {
+
+    for (size_t id = 0; id < names.size(); ++id) {
+        const Totals& data = totals[id];
+        if (data.call_count == 0) continue;
+
         double avg_time = data.total_time / data.call_count;
-        
+
         std::ostringstream oss;
-        oss << std::left << std::setw(24) << name << " | "
+        oss << std::left << std::setw(24) << names[id] << " | "
             << std::right << std::setw(6) << data.call_count << " | "
             << std::right << std::setw(9) << std::fixed << std::setprecision(2) << data.total_time << " | "
             << std::right << std::setw(8) << std::fixed << std::setprecision(2) << avg_time << " | "
             << std::right << std::setw(8) << std::fixed << std::setprecision(2) << data.min_time << " | "
             << std::right << std::setw(8) << std::fixed << std::setprecision(2) << data.max_time;
-        
+
         ErrorHandling::Logger::info(oss.str());
     }
-    
+
     ErrorHandling::Logger::info("=====================================");
 }
 
 void PerformanceProfiler::reset() {
-    profiles_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+        for (auto& slot : buffer->slots) {
+            slot.call_count.store(0, std::memory_order_relaxed);
+            slot.total_ticks.store(0, std::memory_order_relaxed);
+            slot.min_ticks.store(UINT64_MAX, std::memory_order_relaxed);
+            slot.max_ticks.store(0, std::memory_order_relaxed);
+        }
+        buffer->event_count.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool PerformanceProfiler::write_chrome_trace(const std::string& filename) const {
+    FILE* file = std::fopen(filename.c_str(), "w");
+    if (!file) {
+        ErrorHandling::Logger::error("Failed to open trace file: " + filename);
+        return false;
+    }
+
+    const double us_per_tick = 1000.0 / ticks_per_ms();
+
+    // JSON-escaped scope names
+    auto escape = [](const std::string& name) {
+        std::string out;
+        out.reserve(name.size());
+        for (char c : name) {
+            if (c == '"' || c == '\\') out.push_back('\\');
+            if (static_cast<unsigned char>(c) >= 0x20) out.push_back(c);
+        }
+        return out;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> names;
+    names.reserve(scope_names_.size());
+    for (const auto& name : scope_names_) names.push_back(escape(name));
+
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"RayTracerGPU\"}}");
+
+    size_t event_total = 0;
+    std::vector<bool> named(next_thread_index_, false);
+    for (const auto& buffer : buffers_) {
+        const size_t count = buffer->event_count.load(std::memory_order_acquire);
+        if (count == 0) continue;
+
+        // GPU nanoseconds are placed on the CPU timeline through the clock sync point
+        const double gpu_sync_us = static_cast<double>(static_cast<int64_t>(gpu_sync_ticks_ - calibration_ticks_)) * us_per_tick;
+
+        for (size_t i = 0; i < count; ++i) {
+            const TraceEvent& event = (*buffer->event_chunks[i / EVENTS_PER_CHUNK])[i % EVENTS_PER_CHUNK];
+            if (event.id >= names.size()) continue;
+            // Name each tid before its first event; a recycled buffer's tids are all distinct
+            if (!named[event.thread_index]) {
+                named[event.thread_index] = true;
+                if (buffer->gpu_track) {
+                    std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+                                 event.thread_index);
+                } else {
+                    std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+                                 event.thread_index, event.thread_index);
+                }
+            }
+            // Timestamps are relative to profiler start, in microseconds
+            double ts, dur;
+            if (buffer->gpu_track) {
+                ts = gpu_sync_us + static_cast<double>(static_cast<int64_t>(event.start_ticks - gpu_sync_ns_)) * 1e-3;
+                dur = static_cast<double>(event.end_ticks - event.start_ticks) * 1e-3;
+            } else {
+                ts = static_cast<double>(static_cast<int64_t>(event.start_ticks - calibration_ticks_)) * us_per_tick;
+                dur = static_cast<double>(event.end_ticks - event.start_ticks) * us_per_tick;
+            }
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                         names[event.id].c_str(), buffer->gpu_track ? "gpu" : "cpu", ts, dur, event.thread_index);
+        }
+        event_total += count;
+    }
+
+    std::fprintf(file, "\n]}\n");
+    const bool ok = std::fclose(file) == 0;
+    if (!ok) {
+        ErrorHandling::Logger::error("Failed to write trace file: " + filename);
+        return false;
+    }
+
+    ErrorHandling::Logger::info("Wrote " + std::to_string(event_total) + " trace events to " + filename);
+    return true;
 }
@@ -0,0 +1,122 @@
+#include "ray_stats.h"
+#include "error_handling.h"
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+    const char* const COUNTER_NAMES[RayStats::COUNTER_COUNT] = {
+        "Ray casts", "Primary rays", "Secondary rays", "Shadow rays", "BVH node visits",
+        "Sphere tests", "Triangle tests", "Cylinder tests", "Plane tests"
+    };
+
+    // Owns every thread's counter block so totals survive thread exit
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<RayStats::ThreadCounters>> blocks;
+        std::vector<RayStats::ThreadCounters*> free_blocks;
+    };
+
+    Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    // Hands the block back for reuse when the thread exits (worker threads are short-lived)
+    struct BlockLease {
+        RayStats::ThreadCounters* block = nullptr;
+        ~BlockLease() {
+            if (block) {
+                std::lock_guard<std::mutex> lock(registry().mutex);
+                registry().free_blocks.push_back(block);
+            }
+        }
+    };
+}
+
+namespace RayStats {
+    Snapshot& Snapshot::operator+=(const Snapshot& other) {
+        for (int i = 0; i < COUNTER_COUNT; ++i) counters[i] += other.counters[i];
+        for (int i = 0; i < PATH_LENGTH_BINS; ++i) path_lengths[i] += other.path_lengths[i];
+        return *this;
+    }
+
+    ThreadCounters& thread_counters() {
+        thread_local BlockLease lease;
+        if (!lease.block) {
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (!reg.free_blocks.empty()) {
+                lease.block = reg.free_blocks.back();
+                reg.free_blocks.pop_back();
+            } else {
+                reg.blocks.push_back(std::make_unique<ThreadCounters>());
+                lease.block = reg.blocks.back().get();
+            }
+        }
+        return *lease.block;
+    }
+
+    Snapshot collect_cpu() {
+        Snapshot total;
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& block : reg.blocks) {
+            for (int i = 0; i < COUNTER_COUNT; ++i) {
+                total.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+            }
+            for (int i = 0; i < PATH_LENGTH_BINS; ++i) {
+                total.path_lengths[i] += block->path_lengths[i].load(std::memory_order_relaxed);
+            }
+        }
+        return total;
+    }
+
+    void reset_cpu() {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (auto& block : reg.blocks) {
+            for (auto& value : block->counters) value.store(0, std::memory_order_relaxed);
+            for (auto& value : block->path_lengths) value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void log_report(const std::string& label, const Snapshot& stats, double seconds) {
+        const uint64_t rays = stats[RayCasts];
+        const double mrays_per_second = seconds > 0.0 ? rays / seconds / 1e6 : 0.0;
+
+        std::ostringstream header;
+        header << "=== Ray Statistics (" << label << ") === " << rays << " rays in "
+               << std::fixed << std::setprecision(2) << seconds * 1000.0 << "ms: "
+               << mrays_per_second << " Mrays/s";
+        ErrorHandling::Logger::info(header.str());
+
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            if (stats.counters[i] == 0) continue;
+            std::ostringstream oss;
+            oss << std::left << std::setw(16) << COUNTER_NAMES[i] << std::right << std::setw(14) << stats.counters[i];
+            if (rays > 0 && i != RayCasts) {
+                oss << "  (" << std::fixed << std::setprecision(2)
+                    << static_cast<double>(stats.counters[i]) / rays << " per ray)";
+            }
+            ErrorHandling::Logger::info(oss.str());
+        }
+
+        uint64_t paths = 0;
+        for (uint64_t count : stats.path_lengths) paths += count;
+        if (paths == 0) return;
+
+        ErrorHandling::Logger::info("Path length histogram (bounces: share of paths)");
+        for (int i = 0; i < PATH_LENGTH_BINS; ++i) {
+            if (stats.path_lengths[i] == 0) continue;
+            const double share = static_cast<double>(stats.path_lengths[i]) / paths;
+            std::ostringstream oss;
+            oss << std::right << std::setw(3) << i << (i == PATH_LENGTH_BINS - 1 ? "+" : " ") << " "
+                << std::setw(6) << std::fixed << std::setprecision(2) << share * 100.0 << "% "
+                << std::string(static_cast<size_t>(share * 50.0 + 0.5), '#');
+            ErrorHandling::Logger::info(oss.str());
+        }
+    }
+}
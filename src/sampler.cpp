@@ -0,0 +1,225 @@
+#include "sampler.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Sampling {
+    const char* type_to_string(Type type) noexcept {
+        switch (type) {
+            case Type::RANDOM: return "random";
+            case Type::SOBOL: return "sobol";
+            case Type::BLUE_NOISE: return "blue-noise";
+        }
+        return "unknown";
+    }
+
+    bool parse_type(const std::string& name, Type& type) {
+        for (Type candidate : {Type::RANDOM, Type::SOBOL, Type::BLUE_NOISE}) {
+            if (name == type_to_string(candidate)) {
+                type = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t pcg_hash(uint32_t seed) noexcept {
+        const uint32_t state = seed * 747796405u + 2891336453u;
+        const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    uint32_t hash_combine(uint32_t seed, uint32_t value) noexcept {
+        return seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+    }
+
+    uint32_t reverse_bits(uint32_t x) noexcept {
+        x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+        x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+        x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+        x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+        return (x >> 16u) | (x << 16u);
+    }
+
+    uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept {
+        // Laine-Karras permutation on the reversed bits: each step only carries upwards,
+        // so after reversing back every bit depends on the bits above it
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    uint32_t sobol_dim1(uint32_t index) noexcept {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31u; index != 0; index >>= 1u, v ^= v >> 1u) {
+            if (index & 1u) result ^= v;
+        }
+        return result;
+    }
+
+    float to_unit_float(uint32_t x) noexcept {
+        return static_cast<float>(x >> 8u) * (1.0f / 16777216.0f);
+    }
+
+    std::vector<float> generate_blue_noise(int size, uint32_t seed) {
+        PROFILE_SCOPE("Blue noise generation");
+
+        // Void-and-cluster (Ulichney 1993) with a Gaussian energy filter on the torus
+        const int n = size * size;
+        constexpr float SIGMA = 1.5f;
+        std::vector<float> kernel(n);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                const float dx = static_cast<float>(std::min(x, size - x));
+                const float dy = static_cast<float>(std::min(y, size - y));
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+            }
+        }
+
+        std::vector<uint8_t> pattern(n, 0);
+        std::vector<float> energy(n, 0.0f);
+        auto toggle = [&](int p, std::vector<uint8_t>& bits, std::vector<float>& field) {
+            const float sign = bits[p] ? -1.0f : 1.0f;
+            bits[p] ^= 1;
+            const int px = p % size;
+            const int py = p / size;
+            for (int y = 0; y < size; ++y) {
+                const float* row = &kernel[((y - py + size) % size) * size];
+                float* out = &field[y * size];
+                for (int x = 0, kx = size - px; x < size; ++x, ++kx) {
+                    if (kx == size) kx = 0;
+                    out[x] += sign * row[kx];
+                }
+            }
+        };
+        // Tightest cluster: the set pixel with the most energy; largest void: the empty one with the least
+        auto tightest_cluster = [&](const std::vector<uint8_t>& bits, const std::vector<float>& field) {
+            int best = -1;
+            for (int p = 0; p < n; ++p) {
+                if (bits[p] && (best < 0 || field[p] > field[best])) best = p;
+            }
+            return best;
+        };
+        auto largest_void = [&](const std::vector<uint8_t>& bits, const std::vector<float>& field) {
+            int best = -1;
+            for (int p = 0; p < n; ++p) {
+                if (!bits[p] && (best < 0 || field[p] < field[best])) best = p;
+            }
+            return best;
+        };
+
+        // Initial binary pattern: a tenth of the pixels at hashed positions, then relaxed by
+        // moving the tightest cluster into the largest void until that stops changing anything
+        const int initial_count = std::max(1, n / 10);
+        int placed = 0;
+        for (uint32_t i = 0; placed < initial_count; ++i) {
+            const int p = static_cast<int>(pcg_hash(hash_combine(seed, i)) % static_cast<uint32_t>(n));
+            if (!pattern[p]) {
+                toggle(p, pattern, energy);
+                placed++;
+            }
+        }
+        for (int iteration = 0; iteration < n; ++iteration) {
+            const int cluster = tightest_cluster(pattern, energy);
+            toggle(cluster, pattern, energy);
+            const int gap = largest_void(pattern, energy);
+            toggle(gap, pattern, energy);
+            if (gap == cluster) break;
+        }
+
+        std::vector<int> rank(n, 0);
+        {
+            // Ranks below the initial count: remove tightest clusters from a copy
+            std::vector<uint8_t> bits = pattern;
+            std::vector<float> field = energy;
+            for (int r = initial_count - 1; r >= 0; --r) {
+                const int cluster = tightest_cluster(bits, field);
+                toggle(cluster, bits, field);
+                rank[cluster] = r;
+            }
+        }
+        // Remaining ranks: keep filling the largest void
+        for (int r = initial_count; r < n; ++r) {
+            const int gap = largest_void(pattern, energy);
+            toggle(gap, pattern, energy);
+            rank[gap] = r;
+        }
+
+        std::vector<float> values(n);
+        for (int p = 0; p < n; ++p) {
+            values[p] = (static_cast<float>(rank[p]) + 0.5f) / static_cast<float>(n);
+        }
+        return values;
+    }
+
+    const std::vector<float>& blue_noise_tile() {
+        static const std::vector<float> tile = generate_blue_noise(BLUE_NOISE_SIZE);
+        return tile;
+    }
+}
+
+void Sampler::start_pixel_sample(uint32_t x, uint32_t y, uint32_t sample_index) noexcept {
+    pixel_x_ = x;
+    pixel_y_ = y;
+    pixel_seed_ = Sampling::pcg_hash(x + Sampling::pcg_hash(y));
+    sample_index_ = sample_index;
+}
+
+float Sampler::blue_noise_mask(uint32_t dimension) const noexcept {
+    // Each dimension reads the tile at its own toroidal shift, spaced by the R2 sequence
+    const uint32_t mask = Sampling::BLUE_NOISE_SIZE - 1;
+    const uint32_t shift_x = (dimension * 3242174889u) >> 26u;
+    const uint32_t shift_y = (dimension * 2447445413u) >> 26u;
+    const uint32_t x = (pixel_x_ + shift_x) & mask;
+    const uint32_t y = (pixel_y_ + shift_y) & mask;
+    return Sampling::blue_noise_tile()[y * Sampling::BLUE_NOISE_SIZE + x];
+}
+
+float Sampler::get_1d(uint32_t dimension) const noexcept {
+    using namespace Sampling;
+    switch (type_) {
+        case Type::SOBOL: {
+            const uint32_t seed = hash_combine(pixel_seed_, dimension);
+            const uint32_t index = nested_uniform_scramble(sample_index_, seed);
+            return to_unit_float(nested_uniform_scramble(reverse_bits(index), pcg_hash(seed)));
+        }
+        case Type::BLUE_NOISE: {
+            // Golden-ratio Kronecker sequence over the samples, rotated by the pixel's mask value
+            const float value = blue_noise_mask(dimension) + to_unit_float(sample_index_ * 2654435769u);
+            return value - std::floor(value);
+        }
+        case Type::RANDOM:
+            break;
+    }
+    // The GPU draws these from a per-pixel xorshift stream; host code only needs the distribution
+    return to_unit_float(pcg_hash(hash_combine(hash_combine(pixel_seed_, sample_index_), dimension)));
+}
+
+void Sampler::get_2d(uint32_t dimension, float& u, float& v) const noexcept {
+    using namespace Sampling;
+    switch (type_) {
+        case Type::SOBOL: {
+            const uint32_t seed = hash_combine(pixel_seed_, dimension);
+            const uint32_t index = nested_uniform_scramble(sample_index_, seed);
+            u = to_unit_float(nested_uniform_scramble(reverse_bits(index), hash_combine(seed, 1u)));
+            v = to_unit_float(nested_uniform_scramble(sobol_dim1(index), hash_combine(seed, 2u)));
+            return;
+        }
+        case Type::BLUE_NOISE: {
+            // R2 sequence over the samples, rotated by the two dimensions' mask values
+            const float x = blue_noise_mask(dimension) + to_unit_float(sample_index_ * 3242174889u);
+            const float y = blue_noise_mask(dimension + 1) + to_unit_float(sample_index_ * 2447445413u);
+            u = x - std::floor(x);
+            v = y - std::floor(y);
+            return;
+        }
+        case Type::RANDOM:
+            break;
+    }
+    u = get_1d(dimension);
+    v = get_1d(dimension + 1);
+}
@@ -0,0 +1,407 @@
+#include "scene_generator.h"
+#include "error_handling.h"
+#include "profiler.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    struct MaterialSpec {
+        std::string name;
+        MaterialType type;
+        Color albedo;
+        float parameter;  // Roughness for metal/glossy, IOR for dielectric, unused otherwise
+    };
+
+    struct SphereSpec {
+        Vec3 center;
+        float radius;
+        int material_id;
+    };
+
+    // One mesh placed at several offsets; every placement may use its own material
+    struct MeshSpec {
+        std::shared_ptr<Mesh> mesh;
+        std::vector<Vec3> offsets;
+        std::vector<int> material_ids;
+    };
+
+    // Pattern output shared by the in-memory and file writers
+    struct Description {
+        Vec3 camera_position;
+        Vec3 camera_target;
+        float fov = 45.0f;
+        Color background{0.5f, 0.7f, 1.0f};
+        Color ambient{0.15f, 0.15f, 0.15f};
+        Vec3 light_position;
+        Color light_intensity;
+        std::vector<MaterialSpec> materials;
+        std::vector<SphereSpec> spheres;
+        std::vector<MeshSpec> meshes;
+    };
+
+    const std::vector<MaterialSpec>& palette() {
+        static const std::vector<MaterialSpec> materials = {
+            {"matte_red", MaterialType::LAMBERTIAN, Color(0.75f, 0.2f, 0.15f), 0.0f},
+            {"matte_white", MaterialType::LAMBERTIAN, Color(0.8f, 0.8f, 0.8f), 0.0f},
+            {"brushed_steel", MaterialType::METAL, Color(0.75f, 0.75f, 0.8f), 0.2f},
+            {"gold", MaterialType::METAL, Color(0.9f, 0.7f, 0.3f), 0.05f},
+            {"glass", MaterialType::DIELECTRIC, Color(0.95f, 0.95f, 0.95f), 1.5f},
+            {"blue_gloss", MaterialType::GLOSSY, Color(0.2f, 0.35f, 0.8f), 0.3f}
+        };
+        return materials;
+    }
+
+    std::shared_ptr<Material> make_material(const MaterialSpec& spec) {
+        switch (spec.type) {
+            case MaterialType::METAL:
+                return std::make_shared<Material>(spec.type, spec.albedo, spec.parameter, 1.0f, Color(0, 0, 0), 1.0f);
+            case MaterialType::DIELECTRIC:
+                return std::make_shared<Material>(spec.type, spec.albedo, 0.0f, spec.parameter);
+            case MaterialType::GLOSSY:
+                return std::make_shared<Material>(spec.type, spec.albedo, spec.parameter);
+            default:
+                return std::make_shared<Material>(spec.type, spec.albedo);
+        }
+    }
+
+    // Torus in the XY plane around the origin with a gentle displacement so the surface is not
+    // trivially regular; 2 * major_segments * minor_segments triangles
+    std::shared_ptr<Mesh> make_torus(int major_segments, int minor_segments, float major_radius, float minor_radius) {
+        auto mesh = std::make_shared<Mesh>();
+        mesh->vertices.reserve(static_cast<size_t>(major_segments) * minor_segments);
+        mesh->triangles.reserve(static_cast<size_t>(major_segments) * minor_segments * 2);
+
+        for (int i = 0; i < major_segments; ++i) {
+            const float u = Constants::TWO_PI * i / major_segments;
+            const Vec3 ring_center(std::cos(u) * major_radius, std::sin(u) * major_radius, 0.0f);
+            const Vec3 ring_out(std::cos(u), std::sin(u), 0.0f);
+            for (int j = 0; j < minor_segments; ++j) {
+                const float v = Constants::TWO_PI * j / minor_segments;
+                const float r = minor_radius * (1.0f + 0.08f * std::sin(7.0f * u) * std::sin(5.0f * v));
+                const Vec3 vertex = ring_center + ring_out * (std::cos(v) * r) + Vec3(0.0f, 0.0f, std::sin(v) * r);
+                mesh->vertices.push_back(vertex);
+                mesh->min_bounds = Vec3(std::min(mesh->min_bounds.x, vertex.x), std::min(mesh->min_bounds.y, vertex.y),
+                                        std::min(mesh->min_bounds.z, vertex.z));
+                mesh->max_bounds = Vec3(std::max(mesh->max_bounds.x, vertex.x), std::max(mesh->max_bounds.y, vertex.y),
+                                        std::max(mesh->max_bounds.z, vertex.z));
+            }
+        }
+
+        for (int i = 0; i < major_segments; ++i) {
+            const int next_i = (i + 1) % major_segments;
+            for (int j = 0; j < minor_segments; ++j) {
+                const int next_j = (j + 1) % minor_segments;
+                const int a = i * minor_segments + j;
+                const int b = next_i * minor_segments + j;
+                const int c = next_i * minor_segments + next_j;
+                const int d = i * minor_segments + next_j;
+                mesh->triangles.push_back({a, b, c});
+                mesh->triangles.push_back({a, c, d});
+            }
+        }
+        return mesh;
+    }
+
+    // Segment counts whose triangle count (2 * major * minor) is closest to the target,
+    // keeping the major ring about twice as finely divided as the tube
+    void torus_segments(size_t triangle_target, int& major_segments, int& minor_segments) {
+        const double target = std::max<double>(static_cast<double>(triangle_target), 18.0);
+        minor_segments = std::max(3, static_cast<int>(std::lround(std::sqrt(target / 4.0))));
+        major_segments = std::max(3, static_cast<int>(std::lround(target / (2.0 * minor_segments))));
+    }
+
+    void describe_sphere_field(const SceneGenerator::Options& options, Description& description) {
+        description.materials = palette();
+
+        // One sphere per jittered grid cell keeps them from overlapping at any count
+        const size_t count = options.primitive_count;
+        const size_t grid = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const float cell = 1.0f;
+        const float half_extent = grid * cell * 0.5f;
+
+        std::mt19937 rng(options.seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::uniform_int_distribution<int> material(0, static_cast<int>(description.materials.size()) - 1);
+
+        description.spheres.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const float radius = cell * (0.15f + 0.25f * unit(rng));
+            const float slack = cell * 0.5f - radius;
+            const float x = (i % grid + 0.5f) * cell - half_extent + (unit(rng) * 2.0f - 1.0f) * slack;
+            const float z = (i / grid + 0.5f) * cell - half_extent + (unit(rng) * 2.0f - 1.0f) * slack;
+            description.spheres.push_back(SphereSpec{Vec3(x, radius, z), radius, material(rng)});
+        }
+
+        description.camera_target = Vec3(0.0f, 0.0f, 0.0f);
+        description.camera_position = Vec3(0.0f, half_extent * 0.9f + 2.0f, half_extent * 1.6f + 3.0f);
+        description.light_position = Vec3(half_extent * 0.3f, half_extent + 10.0f, half_extent * 0.5f);
+    }
+
+    void describe_tessellated_mesh(const SceneGenerator::Options& options, Description& description) {
+        description.materials = {palette()[5]};
+
+        int major_segments, minor_segments;
+        torus_segments(options.primitive_count, major_segments, minor_segments);
+
+        MeshSpec spec;
+        spec.mesh = make_torus(major_segments, minor_segments, 4.0f, 1.5f);
+        spec.offsets.push_back(Vec3(0.0f, 0.0f, 0.0f));
+        spec.material_ids.push_back(0);
+        description.meshes.push_back(std::move(spec));
+
+        description.camera_target = Vec3(0.0f, 0.0f, 0.0f);
+        description.camera_position = Vec3(0.0f, 5.0f, 15.0f);
+        description.light_position = Vec3(6.0f, 10.0f, 12.0f);
+    }
+
+    void describe_instanced_grid(const SceneGenerator::Options& options, Description& description) {
+        constexpr size_t BASE_TRIANGLES = 128;
+        description.materials = palette();
+
+        // Small counts shrink the base mesh instead of rounding up to a whole copy
+        const size_t base_target = std::min(options.primitive_count, BASE_TRIANGLES);
+        int major_segments, minor_segments;
+        torus_segments(base_target, major_segments, minor_segments);
+        std::shared_ptr<Mesh> mesh = make_torus(major_segments, minor_segments, 1.0f, 0.35f);
+
+        const size_t base_count = mesh->triangles.size();
+        const size_t copies = std::max<size_t>(1, (options.primitive_count + base_count / 2) / base_count);
+        const size_t grid = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(copies))));
+        const float spacing = 3.0f;
+        const float half_extent = (grid - 1) * spacing * 0.5f;
+
+        std::mt19937 rng(options.seed);
+        std::uniform_int_distribution<int> material(0, static_cast<int>(description.materials.size()) - 1);
+
+        MeshSpec spec;
+        spec.mesh = mesh;
+        spec.offsets.reserve(copies);
+        spec.material_ids.reserve(copies);
+        for (size_t i = 0; i < copies; ++i) {
+            // Rows recede along -Z so the grid stands up in front of the camera
+            spec.offsets.push_back(Vec3((i % grid) * spacing - half_extent, 1.4f, -static_cast<float>(i / grid) * spacing));
+            spec.material_ids.push_back(material(rng));
+        }
+        description.meshes.push_back(std::move(spec));
+
+        const float depth = (grid - 1) * spacing;
+        description.camera_target = Vec3(0.0f, 1.4f, -depth * 0.5f);
+        description.camera_position = Vec3(0.0f, half_extent * 0.8f + 3.0f, half_extent * 1.4f + 5.0f);
+        description.light_position = Vec3(half_extent * 0.5f, half_extent + 10.0f, half_extent + 5.0f);
+    }
+
+    bool describe(const SceneGenerator::Options& options, Description& description) {
+        if (options.primitive_count == 0) {
+            ErrorHandling::Logger::error("Generated scene needs at least one primitive");
+            return false;
+        }
+        if (options.aspect_ratio <= 0.0f) {
+            ErrorHandling::Logger::error("Generated scene aspect ratio must be positive");
+            return false;
+        }
+
+        switch (options.pattern) {
+            case SceneGenerator::Pattern::SPHERE_FIELD: describe_sphere_field(options, description); break;
+            case SceneGenerator::Pattern::TESSELLATED_MESH: describe_tessellated_mesh(options, description); break;
+            case SceneGenerator::Pattern::INSTANCED_GRID: describe_instanced_grid(options, description); break;
+        }
+
+        // Cancel the renderer's point light falloff at the scene center so brightness does not
+        // depend on how far the light had to move out for large scenes
+        const float distance = (description.light_position - description.camera_target).length();
+        const float power = 3.0f * (1.0f + 0.1f * distance + 0.01f * distance * distance);
+        description.light_intensity = Color(power, power * 0.95f, power * 0.9f);
+        return true;
+    }
+
+    size_t primitive_total(const Description& description) {
+        size_t total = description.spheres.size();
+        for (const MeshSpec& spec : description.meshes) {
+            total += spec.mesh->triangles.size() * spec.offsets.size();
+        }
+        return total;
+    }
+
+    void log_generated(const SceneGenerator::Options& options, const Description& description) {
+        ErrorHandling::Logger::info("Generated " + std::string(SceneGenerator::pattern_to_string(options.pattern)) +
+                                    " with " + std::to_string(primitive_total(description)) + " primitives (requested " +
+                                    std::to_string(options.primitive_count) + ", seed " + std::to_string(options.seed) + ")");
+    }
+
+    bool write_obj(const Mesh& mesh, const std::string& filename) {
+        std::ofstream out(filename);
+        if (!out) {
+            ErrorHandling::Logger::error("Failed to open OBJ file for writing: " + filename);
+            return false;
+        }
+        out << std::setprecision(7);
+        out << "# Generated by SceneGenerator: " << mesh.vertices.size() << " vertices, "
+            << mesh.triangles.size() << " triangles\n";
+        for (const Vec3& v : mesh.vertices) {
+            out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+        }
+        for (const auto& tri : mesh.triangles) {
+            out << "f " << tri[0] + 1 << " " << tri[1] + 1 << " " << tri[2] + 1 << "\n";
+        }
+        out.close();
+        if (!out) {
+            ErrorHandling::Logger::error("Failed to write OBJ file: " + filename);
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace SceneGenerator {
+    const char* pattern_to_string(Pattern pattern) noexcept {
+        switch (pattern) {
+            case Pattern::SPHERE_FIELD: return "sphere_field";
+            case Pattern::TESSELLATED_MESH: return "mesh";
+            case Pattern::INSTANCED_GRID: return "instanced_grid";
+            default: return "unknown";
+        }
+    }
+
+    bool parse_pattern(const std::string& name, Pattern& pattern) {
+        for (Pattern candidate : {Pattern::SPHERE_FIELD, Pattern::TESSELLATED_MESH, Pattern::INSTANCED_GRID}) {
+            if (name == pattern_to_string(candidate)) {
+                pattern = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parse_count(const std::string& text, size_t& count) {
+        if (text.empty()) return false;
+        size_t multiplier = 1;
+        std::string digits = text;
+        const char suffix = text.back();
+        if (suffix == 'k' || suffix == 'K') {
+            multiplier = 1000;
+            digits.pop_back();
+        } else if (suffix == 'm' || suffix == 'M') {
+            multiplier = 1000000;
+            digits.pop_back();
+        }
+        if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) return false;
+        try {
+            count = static_cast<size_t>(std::stoull(digits)) * multiplier;
+        } catch (const std::out_of_range&) {
+            return false;
+        }
+        return count > 0;
+    }
+
+    bool generate(const Options& options, Scene& scene) {
+        PROFILE_SCOPE("Scene generate");
+        Description description;
+        if (!describe(options, description)) {
+            return false;
+        }
+
+        scene = Scene();
+        scene.camera = Camera(description.camera_position, description.camera_target, Vec3(0.0f, 1.0f, 0.0f),
+                              description.fov, options.aspect_ratio);
+        scene.background_color = description.background;
+        scene.ambient_light = description.ambient;
+        scene.add_light(std::make_shared<PointLight>(description.light_position, description.light_intensity));
+        for (const MaterialSpec& spec : description.materials) {
+            scene.add_material(make_material(spec));
+        }
+
+        scene.objects.reserve(primitive_total(description));
+        for (const SphereSpec& sphere : description.spheres) {
+            scene.add_object(scene.make_object<Sphere>(sphere.center, sphere.radius, sphere.material_id));
+        }
+        for (const MeshSpec& spec : description.meshes) {
+            const std::shared_ptr<const Mesh> mesh = spec.mesh;
+            for (size_t i = 0; i < spec.offsets.size(); ++i) {
+                const Vec3& offset = spec.offsets[i];
+                for (const auto& tri : mesh->triangles) {
+                    scene.add_object(scene.make_object<Triangle>(mesh->vertices[tri[0]] + offset,
+                                                                 mesh->vertices[tri[1]] + offset,
+                                                                 mesh->vertices[tri[2]] + offset,
+                                                                 spec.material_ids[i]));
+                }
+                scene.add_mesh_instance(mesh, spec.material_ids[i], offset);
+            }
+        }
+
+        log_generated(options, description);
+        return true;
+    }
+
+    bool write_scene_file(const Options& options, const std::string& scene_path) {
+        Description description;
+        if (!describe(options, description)) {
+            return false;
+        }
+
+        std::string obj_path;
+        if (!description.meshes.empty()) {
+            obj_path = std::filesystem::path(scene_path).replace_extension(".obj").string();
+            if (!write_obj(*description.meshes.front().mesh, obj_path)) {
+                return false;
+            }
+        }
+
+        std::ofstream out(scene_path);
+        if (!out) {
+            ErrorHandling::Logger::error("Failed to open scene file for writing: " + scene_path);
+            return false;
+        }
+        out << std::setprecision(7);
+
+        out << "# Generated " << pattern_to_string(options.pattern) << ": " << primitive_total(description)
+            << " primitives (requested " << options.primitive_count << ", seed " << options.seed << ")\n";
+        const Vec3& eye = description.camera_position;
+        const Vec3& target = description.camera_target;
+        out << "camera " << eye.x << " " << eye.y << " " << eye.z << " " << target.x << " " << target.y << " "
+            << target.z << " 0 1 0 " << description.fov << " " << options.aspect_ratio << "\n";
+        out << "background " << description.background.x << " " << description.background.y << " "
+            << description.background.z << "\n";
+        out << "ambient " << description.ambient.x << " " << description.ambient.y << " " << description.ambient.z << "\n";
+        out << "point_light " << description.light_position.x << " " << description.light_position.y << " "
+            << description.light_position.z << " " << description.light_intensity.x << " "
+            << description.light_intensity.y << " " << description.light_intensity.z << "\n\n";
+
+        for (const MaterialSpec& spec : description.materials) {
+            out << "material " << spec.name << " " << MaterialUtils::type_to_string(spec.type) << " "
+                << spec.albedo.x << " " << spec.albedo.y << " " << spec.albedo.z;
+            if (spec.type != MaterialType::LAMBERTIAN) {
+                out << " " << spec.parameter;
+            }
+            out << "\n";
+        }
+        out << "\n";
+
+        for (const SphereSpec& sphere : description.spheres) {
+            out << "sphere " << sphere.center.x << " " << sphere.center.y << " " << sphere.center.z << " "
+                << sphere.radius << " " << description.materials[sphere.material_id].name << "\n";
+        }
+        for (const MeshSpec& spec : description.meshes) {
+            for (size_t i = 0; i < spec.offsets.size(); ++i) {
+                const Vec3& offset = spec.offsets[i];
+                out << "load_obj " << obj_path << " " << description.materials[spec.material_ids[i]].name;
+                if (offset.x != 0.0f || offset.y != 0.0f || offset.z != 0.0f) {
+                    out << " " << offset.x << " " << offset.y << " " << offset.z;
+                }
+                out << "\n";
+            }
+        }
+
+        out.close();
+        if (!out) {
+            ErrorHandling::Logger::error("Failed to write scene file: " + scene_path);
+            return false;
+        }
+
+        log_generated(options, description);
+        ErrorHandling::Logger::info("Scene written to " + scene_path + (obj_path.empty() ? "" : " (mesh: " + obj_path + ")"));
+        return true;
+    }
+}
@@ -141,7 +141,11 @@ const char* Shader::get_raytracing_compute_shader() {
 
 layout(local_size_x = 8, local_size_y = 8) in;
 layout(rgba32f, binding = 0) uniform image2D output_image;
-layout(rgba32f, binding = 1) uniform image2D accumulation_buffer;
+layout(rgba32f, binding = 1) uniform image2D accumulation_buffer;  // rgb: running mean, a: sample count
+layout(r32f, binding = 2) uniform image2D moment_buffer;  // Running mean of squared sample luminance
+layout(rgba32f, binding = 3) uniform image2D gbuffer_normal_depth;  // Mean first-hit normal (xyz) and distance (w)
+layout(rgba32f, binding = 4) uniform image2D gbuffer_albedo;        // Mean first-hit albedo
+layout(rgba32f, binding = 5) uniform image2D gbuffer_emission;      // Mean emitter/background radiance seen directly
 
 struct Material {
     vec3 albedo;
@@ -195,10 +199,8 @@ struct GPUCamera {
 };
 
 struct Light {
-    int type;           // 0=point, 1=spot, 2=area
-    float padding1;
     vec3 position;
-    float padding2;
+    int type;           // 0=point, 1=spot, 2=directional (area plane lights are uploaded as 2)
     vec3 intensity;
     float radius;       // Soft shadow radius
     vec3 direction;     // For spot lights
@@ -209,7 +211,7 @@ struct Light {
     float width;        // For area lights
     float height;       // For area lights
     int samples;        // For area lights
-    float padding3[2];
+    float padding[2];
 };
 
 layout(std430, binding = 2) buffer MaterialBuffer {
@@ -228,6 +230,34 @@ layout(std430, binding = 5) buffer LightBuffer {
     Light lights[];
 };
 
+// Hierarchy over lights[0, num_tree_lights), see LightTree. Root at index 0;
+// leaves have light_index >= 0.
+struct LightNode {
+    vec3 bounds_min;
+    float energy;
+    vec3 bounds_max;
+    int light_index;
+    int left;
+    int right;
+    float padding[2];
+};
+
+layout(std430, binding = 9) buffer LightTreeBuffer {
+    LightNode light_nodes[];
+};
+
+// Emissive primitives, picked in proportion to their power via the cumulative cdf
+struct Emitter {
+    int primitive_type;   // 0=sphere, 1=triangle, 2=cylinder
+    int primitive_index;
+    float cdf;
+    float padding;
+};
+
+layout(std430, binding = 10) buffer EmitterBuffer {
+    Emitter emitters[];
+};
+
 layout(std430, binding = 6) buffer TriangleBuffer {
     Triangle triangles[];
 };
@@ -236,12 +266,97 @@ layout(std430, binding = 7) buffer CylinderBuffer {
     Cylinder cylinders[];
 };
 
+#ifdef RAY_STATS
+// Indices match RayStats::Counter; path length bins follow the counters.
+// Every value is 64 bits stored as (low, high) uint pairs.
+#define RAY_STAT_RAY_CASTS 0
+#define RAY_STAT_PRIMARY_RAYS 1
+#define RAY_STAT_SECONDARY_RAYS 2
+#define RAY_STAT_SHADOW_RAYS 3
+#define RAY_STAT_SPHERE_TESTS 5
+#define RAY_STAT_TRIANGLE_TESTS 6
+#define RAY_STAT_CYLINDER_TESTS 7
+#define RAY_STAT_COUNTERS 9
+#define RAY_STAT_PATH_BINS 16
+#define RAY_STAT_SLOTS (RAY_STAT_COUNTERS + RAY_STAT_PATH_BINS)
+
+layout(std430, binding = 8) buffer RayStatsBuffer {
+    uint ray_stat_words[];
+};
+
+// Counters and path length bins are counted per invocation and flushed with one atomic per
+// non-zero slot at the end of main()
+uint ray_stat_counts[RAY_STAT_SLOTS];
+
+void ray_stat_flush(int index, uint value) {
+    if (value == 0u) return;
+    uint previous = atomicAdd(ray_stat_words[2 * index], value);
+    if (previous + value < previous) {
+        atomicAdd(ray_stat_words[2 * index + 1], 1u);  // Carry into the high word
+    }
+}
+
+#define RAY_STAT_INC(counter) ray_stat_counts[counter]++
+#define RAY_STAT_PATH_LENGTH(bounces) ray_stat_counts[RAY_STAT_COUNTERS + min(bounces, RAY_STAT_PATH_BINS - 1)]++
+#else
+#define RAY_STAT_INC(counter)
+#define RAY_STAT_PATH_LENGTH(bounces)
+#endif
+
 uniform int max_depth;
 uniform int samples_per_pixel;
+
+// Path termination (GPURayTracer::set_path_termination). Russian roulette starts after
+// roulette_depth bounces; each lobe limit caps that lobe's scattering events per path, 0 = no
+// limit beyond max_depth.
+#define LOBE_DIFFUSE 0
+#define LOBE_SPECULAR 1
+#define LOBE_TRANSMISSION 2
+uniform int roulette_depth;
+uniform int max_diffuse_bounces;
+uniform int max_specular_bounces;
+uniform int max_transmission_bounces;
+
 uniform float time;
 uniform int frame_count;
 uniform bool reset_accumulation;
 uniform vec3 ambient_light;
+uniform int num_tree_lights;
+uniform int light_samples;
+uniform float inv_emitter_power;  // 1 / sum of luminance(emission) * area over all emitters
+uniform bool adaptive_sampling;
+uniform bool write_gbuffer;  // Accumulate the denoiser's G-buffers and luminance moments
+uniform ivec2 tile_offset;   // Pixel origin of the screen tile this dispatch covers (0 untiled)
+uniform ivec2 render_size;   // Traced bottom-left part of the images (smaller under dynamic resolution)
+
+// Temporal reprojection: on a pass after the camera moved or the render size changed, history
+// is fetched from where each pixel's first hit was seen by the previous camera (copies of the
+// accumulation, moment and normal/depth images made before the pass) instead of from the same pixel
+uniform bool reproject;
+uniform ivec2 history_size;   // Render size the history was traced at
+uniform float history_limit;  // Most samples of reprojected history kept, so it decays like an EMA
+uniform vec3 prev_camera_position;
+uniform vec3 prev_lower_left_corner;
+uniform vec3 prev_horizontal;
+uniform vec3 prev_vertical;
+uniform sampler2D history_color;
+uniform sampler2D history_moment;
+uniform sampler2D history_normal_depth;
+
+// Sparse passes while the camera moves: only the pixels selected by pixel_traced are path
+// traced. The rest keep reprojected history when there is some and are otherwise marked with
+// alpha 0 in the output image for the display pass to fill in from traced neighbours.
+#define SPARSE_NONE 0
+#define SPARSE_CHECKERBOARD 1
+#define SPARSE_FOVEATED 2
+uniform int sparse_pattern;
+uniform uint sparse_phase;   // Advances every sparse pass so the traced subset rotates
+uniform float fovea_radius;  // Foveated: checkerboard within this distance of the centre, in image heights
+
+// One flag per 8x8 tile (one workgroup), written by the adaptive sampling estimate pass
+layout(std430, binding = 12) buffer TileStateBuffer {
+    uint tile_active[];
+};
 
 uvec4 rng_state;
 
@@ -252,7 +367,7 @@ uint pcg_hash(uint seed) {
 }
 
 void init_random(uvec2 pixel, uint frame) {
-    rng_state.x = pcg_hash(pixel.x + 1920u * pixel.y);
+    rng_state.x = pcg_hash(pixel.x + pcg_hash(pixel.y));
     rng_state.y = pcg_hash(rng_state.x + frame);
     rng_state.z = pcg_hash(rng_state.y + pixel.x);
     rng_state.w = pcg_hash(rng_state.z + pixel.y);
@@ -279,14 +394,6 @@ vec3 random_vec3() {
     return vec3(random(), random(), random());
 }
 
-vec3 random_in_unit_sphere() {
-    // Fast uniform sphere sampling using Box-Muller transform
-    float z = 1.0 - 2.0 * random();
-    float r = sqrt(max(0.0, 1.0 - z * z));
-    float phi = 2.0 * 3.14159265359 * random();
-    return vec3(r * cos(phi), r * sin(phi), z);
-}
-
 vec3 random_cosine_direction() {
     // Optimized cosine-weighted hemisphere sampling
     float r1 = random();
@@ -298,11 +405,11 @@ vec3 random_cosine_direction() {
     return vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
 }
 
-vec3 random_unit_vector() {
-    // Direct unit vector generation without rejection sampling
-    float z = 1.0 - 2.0 * random();
+// Uniform direction on the unit sphere from a 2D sample, without rejection sampling
+vec3 sample_unit_vector(vec2 u) {
+    float z = 1.0 - 2.0 * u.x;
     float r = sqrt(max(0.0, 1.0 - z * z));
-    float phi = 2.0 * 3.14159265359 * random();
+    float phi = 2.0 * 3.14159265359 * u.y;
     return vec3(r * cos(phi), r * sin(phi), z);
 }
 
@@ -317,6 +424,104 @@ vec2 stratified_sample(int sample_index, int total_samples) {
     return (vec2(x, y) + jitter) / float(sqrt_samples);
 }
 
+// Sampler selected by GPURayTracer::set_sampler, mirrored on the host by Sampler (sampler.cpp).
+// Dimensions are fixed per camera sample: pixel, lens, then one block per bounce, so each
+// decision of a path draws from the same low-discrepancy dimension in every sample of a pixel.
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_BLUE_NOISE 2
+
+#define DIM_PIXEL 0
+#define DIM_LENS 2
+#define DIM_FIRST_BOUNCE 4
+// Offsets within a bounce's block; the light tree samples follow, one dimension each
+#define DIM_BSDF 0
+#define DIM_ROULETTE 2
+#define DIM_EMITTER_SELECT 3
+#define DIM_EMITTER_POINT 4
+#define DIM_LIGHT 6
+
+#define BLUE_NOISE_SIZE 64
+
+uniform int sampler_type;
+uniform uint sample_index_base;  // Samples accumulated since the last reset
+
+layout(std430, binding = 11) buffer BlueNoiseBuffer {
+    float blue_noise[];  // BLUE_NOISE_SIZE^2 ranks in [0, 1), row-major
+};
+
+uvec2 sample_pixel;
+uint pixel_seed;
+uint sample_index;
+
+void init_sampler(uvec2 pixel) {
+    sample_pixel = pixel;
+    pixel_seed = pcg_hash(pixel.x + pcg_hash(pixel.y));
+}
+
+uint hash_combine(uint seed, uint value) {
+    return seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u));
+}
+
+// Owen scrambling via a Laine-Karras permutation of the reversed bits (Burley 2020)
+uint nested_uniform_scramble(uint x, uint seed) {
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+uint sobol_dim1(uint index) {
+    uint result = 0u;
+    for (uint v = 1u << 31u; index != 0u; index >>= 1u, v ^= v >> 1u) {
+        if ((index & 1u) != 0u) result ^= v;
+    }
+    return result;
+}
+
+float to_unit_float(uint x) {
+    return float(x >> 8u) * (1.0 / 16777216.0);
+}
+
+// Blue-noise tile value at this pixel, shifted per dimension along the R2 sequence
+float blue_noise_mask(int dimension) {
+    uint mask = uint(BLUE_NOISE_SIZE - 1);
+    uvec2 shift = uvec2(uint(dimension) * 3242174889u, uint(dimension) * 2447445413u) >> 26u;
+    uvec2 p = (sample_pixel + shift) & mask;
+    return blue_noise[p.y * uint(BLUE_NOISE_SIZE) + p.x];
+}
+
+float sample_1d(int dimension) {
+    if (sampler_type == SAMPLER_SOBOL) {
+        uint seed = hash_combine(pixel_seed, uint(dimension));
+        uint index = nested_uniform_scramble(sample_index, seed);
+        return to_unit_float(nested_uniform_scramble(bitfieldReverse(index), pcg_hash(seed)));
+    } else if (sampler_type == SAMPLER_BLUE_NOISE) {
+        return fract(blue_noise_mask(dimension) + to_unit_float(sample_index * 2654435769u));
+    }
+    return random();
+}
+
+vec2 sample_2d(int dimension) {
+    if (sampler_type == SAMPLER_SOBOL) {
+        uint seed = hash_combine(pixel_seed, uint(dimension));
+        uint index = nested_uniform_scramble(sample_index, seed);
+        return vec2(to_unit_float(nested_uniform_scramble(bitfieldReverse(index), hash_combine(seed, 1u))),
+                    to_unit_float(nested_uniform_scramble(sobol_dim1(index), hash_combine(seed, 2u))));
+    } else if (sampler_type == SAMPLER_BLUE_NOISE) {
+        return fract(vec2(blue_noise_mask(dimension), blue_noise_mask(dimension + 1)) +
+                     vec2(to_unit_float(sample_index * 3242174889u), to_unit_float(sample_index * 2447445413u)));
+    }
+    return random_vec2();
+}
+
+int bounce_dimension(int bounce) {
+    return DIM_FIRST_BOUNCE + bounce * (DIM_LIGHT + light_samples);
+}
+
 struct Ray {
     vec3 origin;
     vec3 direction;
@@ -331,6 +536,7 @@ struct HitRecord {
 };
 
 bool hit_sphere(Sphere sphere, Ray ray, float t_min, float t_max, out HitRecord rec) {
+    RAY_STAT_INC(RAY_STAT_SPHERE_TESTS);
     vec3 oc = ray.origin - sphere.center;
     float a = dot(ray.direction, ray.direction);
     float half_b = dot(oc, ray.direction);
@@ -359,6 +565,7 @@ bool hit_sphere(Sphere sphere, Ray ray, float t_min, float t_max, out HitRecord
 }
 
 bool hit_triangle(Triangle tri, Ray ray, float t_min, float t_max, out HitRecord rec) {
+    RAY_STAT_INC(RAY_STAT_TRIANGLE_TESTS);
     // Optimized Möller-Trumbore ray-triangle intersection
     const float EPSILON = 0.000001;
     vec3 edge1 = tri.v1 - tri.v0;
@@ -405,6 +612,7 @@ bool hit_triangle(Triangle tri, Ray ray, float t_min, float t_max, out HitRecord
 }
 
 bool hit_cylinder(Cylinder cyl, Ray ray, float t_min, float t_max, out HitRecord rec) {
+    RAY_STAT_INC(RAY_STAT_CYLINDER_TESTS);
     // Transform ray to cylinder coordinate system
     vec3 oc = ray.origin - cyl.base_center;
     
@@ -452,6 +660,7 @@ bool hit_cylinder(Cylinder cyl, Ray ray, float t_min, float t_max, out HitRecord
 }
 
 bool hit_world(Ray ray, float t_min, float t_max, out HitRecord rec) {
+    RAY_STAT_INC(RAY_STAT_RAY_CASTS);
     HitRecord temp_rec;
     bool hit_anything = false;
     float closest_so_far = t_max;
@@ -474,45 +683,12 @@ bool hit_world(Ray ray, float t_min, float t_max, out HitRecord rec) {
         }
     }
     
-    // Early exit for performance if we have many triangles
-    if (triangles.length() > 100 && hit_anything && closest_so_far < 5.0) {
-        return true; // Skip distant triangle tests if we hit something close
-    }
-    
-    // Test triangles with aggressive optimizations for large triangle counts
-    int triangle_count = triangles.length();
-    if (triangle_count > 100) {
-        // For triangle-heavy scenes, use aggressive stride-based sampling
-        int stride = max(2, triangle_count / 50); // Even more aggressive stride
-        int tested = 0;
-        for (int i = 0; i < triangle_count && tested < 20; i += stride, tested++) {
-            if (hit_triangle(triangles[i], ray, t_min, closest_so_far, temp_rec)) {
-                hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
-                // If we find a close hit, break immediately
-                if (closest_so_far < 2.0) break;
-            }
-        }
-    } else if (triangle_count > 50) {
-        // For moderate triangle scenes, use moderate stride
-        int stride = max(1, triangle_count / 100);
-        for (int i = 0; i < triangle_count; i += stride) {
-            if (hit_triangle(triangles[i], ray, t_min, closest_so_far, temp_rec)) {
-                hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
-                if (closest_so_far < 1.0) break;
-            }
-        }
-    } else {
-        // For scenes with few triangles, test all
-        for (int i = 0; i < triangle_count; i++) {
-            if (hit_triangle(triangles[i], ray, t_min, closest_so_far, temp_rec)) {
-                hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
-            }
+    // Test triangles
+    for (int i = 0; i < triangles.length(); i++) {
+        if (hit_triangle(triangles[i], ray, t_min, closest_so_far, temp_rec)) {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
         }
     }
     
@@ -525,6 +701,7 @@ bool in_shadow(vec3 point, vec3 light_pos, float max_distance) {
     float distance = length(shadow_dir);
     if (distance > max_distance) return false;
     
+    RAY_STAT_INC(RAY_STAT_SHADOW_RAYS);
     shadow_dir = normalize(shadow_dir);
     Ray shadow_ray = Ray(point + shadow_dir * 0.001, shadow_dir);
     HitRecord shadow_rec;
@@ -532,100 +709,285 @@ bool in_shadow(vec3 point, vec3 light_pos, float max_distance) {
     return hit_world(shadow_ray, 0.001, distance - 0.001, shadow_rec);
 }
 
-// Calculate lighting contribution from all lights
-vec3 calculate_lighting(vec3 point, vec3 normal, Material mat) {
-    vec3 total_light = ambient_light;
-    
-    // Skip shadow calculations for triangle-heavy scenes for performance
-    bool skip_shadows = (triangles.length() > 100);
-    
-    for (int i = 0; i < lights.length(); i++) {
-        Light light = lights[i];
-        vec3 light_contribution = vec3(0.0);
+// Contribution of one light at a shading point, including its shadow test
+vec3 light_contribution(Light light, vec3 point, vec3 normal) {
+    if (light.type == 0) {
+        // Point light - simplified for performance
+        vec3 light_dir = light.position - point;
+        float distance = length(light_dir);
+        light_dir = normalize(light_dir);
         
-        if (light.type == 0) {
-            // Point light - simplified for performance
-            vec3 light_dir = light.position - point;
-            float distance = length(light_dir);
-            light_dir = normalize(light_dir);
-            
-            // Distance attenuation (inverse square)
+        // Distance attenuation (inverse square)
+        float attenuation = 1.0 / (1.0 + 0.1 * distance + 0.01 * distance * distance);
+        
+        if (!in_shadow(point, light.position, distance)) {
+            return light.intensity * attenuation * max(0.0, dot(normal, light_dir));
+        }
+    } else if (light.type == 1) {
+        // Spot light
+        vec3 light_dir = light.position - point;
+        float distance = length(light_dir);
+        light_dir = normalize(light_dir);
+        
+        // Check if point is within spot cone
+        float spot_cos = dot(-light_dir, light.direction);
+        if (spot_cos > light.outer_angle) {
+            // Distance attenuation
             float attenuation = 1.0 / (1.0 + 0.1 * distance + 0.01 * distance * distance);
             
-            // Skip shadows for performance if many triangles
-            if (skip_shadows || !in_shadow(point, light.position, distance)) {
-                light_contribution = light.intensity * attenuation * max(0.0, dot(normal, light_dir));
+            // Spot attenuation (smooth falloff between inner and outer angles)
+            float spot_intensity = 1.0;
+            if (spot_cos < light.inner_angle) {
+                spot_intensity = (spot_cos - light.outer_angle) / (light.inner_angle - light.outer_angle);
             }
-        } else if (light.type == 1) {
-            // Spot light
-            vec3 light_dir = light.position - point;
-            float distance = length(light_dir);
-            light_dir = normalize(light_dir);
             
-            // Check if point is within spot cone
-            float spot_cos = dot(-light_dir, light.direction);
-            if (spot_cos > light.outer_angle) {
-                // Distance attenuation
-                float attenuation = 1.0 / (1.0 + 0.1 * distance + 0.01 * distance * distance);
-                
-                // Spot attenuation (smooth falloff between inner and outer angles)
-                float spot_intensity = 1.0;
-                if (spot_cos < light.inner_angle) {
-                    spot_intensity = (spot_cos - light.outer_angle) / (light.inner_angle - light.outer_angle);
-                }
-                
-                // Skip shadows for performance if many triangles
-                if (skip_shadows || !in_shadow(point, light.position, distance)) {
-                    light_contribution = light.intensity * attenuation * spot_intensity * max(0.0, dot(normal, light_dir));
-                }
+            if (!in_shadow(point, light.position, distance)) {
+                return light.intensity * attenuation * spot_intensity * max(0.0, dot(normal, light_dir));
             }
-        } else if (light.type == 2) {
-            // Directional light
-            vec3 light_dir = -light.direction;
+        }
+    } else if (light.type == 2) {
+        // Directional light
+        vec3 light_dir = -light.direction;
+        
+        if (!in_shadow(point, point + light_dir * 1000.0, 1000.0)) {
+            return light.intensity * max(0.0, dot(normal, light_dir));
+        }
+    }
+    
+    return vec3(0.0);
+}
+
+// Estimated contribution of all lights under a tree node: their energy with the shader's
+// distance falloff at the nearest the node's bounding sphere can be. Zero only when the
+// whole box lies behind the surface, where none of its lights can contribute.
+float light_node_importance(int node_index, vec3 point, vec3 normal) {
+    vec3 bounds_min = light_nodes[node_index].bounds_min;
+    vec3 bounds_max = light_nodes[node_index].bounds_max;
+    vec3 center = 0.5 * (bounds_min + bounds_max);
+    vec3 half_extent = 0.5 * (bounds_max - bounds_min);
+    vec3 to_center = center - point;
+    if (dot(normal, to_center) + dot(abs(normal), half_extent) <= 0.0) return 0.0;
+    
+    float distance = max(length(to_center) - length(half_extent), 0.0);
+    return light_nodes[node_index].energy / (1.0 + 0.1 * distance + 0.01 * distance * distance);
+}
+
+// Walks the light tree from the root, choosing each child in proportion to its importance.
+// One sample u drives the whole walk: after each choice it is rescaled to [0, 1) within the
+// chosen branch, which keeps its stratification. Returns the chosen light's index and its
+// selection probability, or -1 when no light under the root can reach this point.
+int sample_light_tree(vec3 point, vec3 normal, float u, out float pdf) {
+    pdf = 1.0;
+    int index = 0;
+    int light_index = -1;
+    if (light_node_importance(0, point, normal) > 0.0) {
+        light_index = light_nodes[0].light_index;
+        while (light_index < 0) {
+            int left = light_nodes[index].left;
+            int right = light_nodes[index].right;
+            float left_weight = light_node_importance(left, point, normal);
+            float right_weight = light_node_importance(right, point, normal);
+            float total = left_weight + right_weight;
+            if (total <= 0.0) break;
             
-            // Skip shadows for performance if many triangles
-            if (skip_shadows || !in_shadow(point, point + light_dir * 1000.0, 1000.0)) {
-                light_contribution = light.intensity * max(0.0, dot(normal, light_dir));
+            // Never take a zero-weight branch, even when rounding pushes u * total to the edge
+            float scaled = u * total;
+            bool go_left = right_weight <= 0.0 || (left_weight > 0.0 && scaled < left_weight);
+            pdf *= (go_left ? left_weight : right_weight) / total;
+            u = go_left ? scaled / left_weight : (scaled - left_weight) / right_weight;
+            u = clamp(u, 0.0, 0.99999994);
+            index = go_left ? left : right;
+            light_index = light_nodes[index].light_index;
+        }
+    }
+    
+    return light_index;
+}
+
+// Calculate lighting contribution from all lights. With more point/spot lights than
+// light_samples, those are importance sampled through the light tree and weighted by
+// 1 / (pdf * light_samples), which keeps the estimate unbiased; the rest are evaluated directly.
+vec3 calculate_lighting(vec3 point, vec3 normal, Material mat, int dimension) {
+    vec3 total_light = ambient_light;
+    
+    int first_direct = 0;
+    if (num_tree_lights > light_samples && light_nodes.length() > 0) {
+        for (int s = 0; s < light_samples; s++) {
+            float pdf;
+            int light_index = sample_light_tree(point, normal, sample_1d(dimension + s), pdf);
+            if (light_index >= 0) {
+                total_light += light_contribution(lights[light_index], point, normal) /
+                               (pdf * float(light_samples));
             }
         }
-        
-        total_light += light_contribution;
+        first_direct = num_tree_lights;
+    }
+    
+    for (int i = first_direct; i < lights.length(); i++) {
+        total_light += light_contribution(lights[i], point, normal);
     }
     
     return total_light;
 }
 
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float power_heuristic(float pdf, float other_pdf) {
+    float pdf2 = pdf * pdf;
+    return pdf2 / (pdf2 + other_pdf * other_pdf);
+}
+
+// Area density of next-event estimation picking a point on an emitter with this emission:
+// select probability (power / total power) times 1 / area
+float emitter_area_pdf(vec3 emission) {
+    return luminance(emission) * inv_emitter_power;
+}
+
+// Uniformly distributed point on an emitter's surface
+void sample_emitter_point(Emitter emitter, vec2 u, out vec3 position, out vec3 normal, out int material_id) {
+    if (emitter.primitive_type == 0) {
+        Sphere sphere = spheres[emitter.primitive_index];
+        normal = sample_unit_vector(u);
+        position = sphere.center + sphere.radius * normal;
+        material_id = sphere.material_id;
+    } else if (emitter.primitive_type == 1) {
+        Triangle tri = triangles[emitter.primitive_index];
+        float su = sqrt(u.x);
+        float b0 = 1.0 - su;
+        float b1 = u.y * su;
+        position = b0 * tri.v0 + b1 * tri.v1 + (1.0 - b0 - b1) * tri.v2;
+        normal = normalize(cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+        material_id = tri.material_id;
+    } else {
+        Cylinder cyl = cylinders[emitter.primitive_index];
+        vec3 helper = abs(cyl.axis.x) > 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+        vec3 tangent = normalize(cross(cyl.axis, helper));
+        vec3 bitangent = cross(cyl.axis, tangent);
+        float phi = 2.0 * 3.14159265359 * u.x;
+        normal = cos(phi) * tangent + sin(phi) * bitangent;
+        position = cyl.base_center + u.y * cyl.height * cyl.axis + cyl.radius * normal;
+        material_id = cyl.material_id;
+    }
+}
+
+// Next-event estimation at a diffuse vertex: one emitter picked by power, a uniform point on
+// it and a shadow ray, MIS weighted against the cosine-weighted bounce that could also have
+// hit it. Multiply by the vertex's throughput after its albedo (the BRDF is albedo / pi).
+// dimension is the bounce's first sampler dimension.
+vec3 sample_emitters(vec3 point, vec3 normal, int dimension) {
+    float u = sample_1d(dimension + DIM_EMITTER_SELECT);
+    int lo = 0;
+    int hi = emitters.length() - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (emitters[mid].cdf <= u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    vec3 emitter_point;
+    vec3 emitter_normal;
+    int material_id;
+    sample_emitter_point(emitters[lo], sample_2d(dimension + DIM_EMITTER_POINT), emitter_point, emitter_normal, material_id);
+    
+    vec3 to_emitter = emitter_point - point;
+    float distance_squared = dot(to_emitter, to_emitter);
+    float distance = sqrt(distance_squared);
+    vec3 direction = to_emitter / distance;
+    
+    // Emitters shine from both sides, matching what a bounce ray sees when it hits one
+    float cos_surface = dot(normal, direction);
+    float cos_emitter = abs(dot(emitter_normal, direction));
+    if (cos_surface <= 0.0 || cos_emitter <= 0.0) return vec3(0.0);
+    
+    // Stop short of the emitter's own surface, which lies exactly at the end of the ray
+    RAY_STAT_INC(RAY_STAT_SHADOW_RAYS);
+    HitRecord shadow_rec;
+    if (hit_world(Ray(point, direction), 0.001, distance * 0.999, shadow_rec)) return vec3(0.0);
+    
+    vec3 emission = materials[material_id].emission;
+    float area_pdf = emitter_area_pdf(emission);
+    float light_pdf = area_pdf * distance_squared / cos_emitter;
+    float bsdf_pdf = cos_surface / 3.14159265359;
+    float weight = power_heuristic(light_pdf, bsdf_pdf);
+    
+    return emission * (weight * cos_surface / (3.14159265359 * light_pdf));
+}
+
+// First surface the current sample hit, recorded by ray_color for the denoiser's G-buffers.
+// Misses keep depth 0; the albedo is what the denoiser divides out, so 1 where nothing is.
+// Emission or background seen directly is noise-free and kept out of the filter.
+vec3 first_hit_normal;
+float first_hit_depth;
+vec3 first_hit_albedo;
+vec3 first_hit_emission;
+
 vec3 ray_color(Ray ray, int depth) {
+    first_hit_normal = vec3(0.0);
+    first_hit_depth = 0.0;
+    first_hit_albedo = vec3(1.0);
+    first_hit_emission = vec3(0.0);
+    
     vec3 color = vec3(1.0);
     vec3 attenuation = vec3(1.0);
+    vec3 radiance = vec3(0.0);   // Emitter light gathered by next-event estimation
+    float bsdf_pdf = 0.0;        // Solid-angle pdf of the last bounce if it was diffuse, else 0
     
-    // Reduce max bounces for triangle-heavy scenes
-    int max_bounces = depth;
-    if (triangles.length() > 100) {
-        max_bounces = min(depth, 4); // Max 4 bounces for triangle-heavy scenes
-    }
+    ivec3 lobe_bounces = ivec3(0);  // Scattering events so far, indexed by LOBE_*
+    ivec3 lobe_limits = ivec3(max_diffuse_bounces, max_specular_bounces, max_transmission_bounces);
     
-    for (int bounce = 0; bounce < max_bounces; bounce++) {
+    for (int bounce = 0; bounce < depth; bounce++) {
+        int dimension = bounce_dimension(bounce);
         HitRecord rec;
+        if (bounce == 0) {
+            RAY_STAT_INC(RAY_STAT_PRIMARY_RAYS);
+        } else {
+            RAY_STAT_INC(RAY_STAT_SECONDARY_RAYS);
+        }
         if (hit_world(ray, 0.001, 1000000.0, rec)) {
             Material mat = materials[rec.material_id];
             
-            // Emissive material
+            if (bounce == 0) {
+                first_hit_normal = rec.normal;
+                first_hit_depth = rec.t;
+                if (mat.type != 2 && mat.type != 3) {
+                    first_hit_albedo = mat.albedo;
+                }
+            }
+            
+            // Emissive material. After a diffuse bounce, next-event estimation at that vertex could
+            // have sampled this point too, so the two strategies are MIS weighted.
             if (mat.type == 3) {
-                return color * attenuation * mat.emission;
+                float weight = 1.0;
+                if (bsdf_pdf > 0.0 && inv_emitter_power > 0.0) {
+                    float cos_emitter = abs(dot(rec.normal, ray.direction));
+                    float light_pdf = emitter_area_pdf(mat.emission) * rec.t * rec.t / max(cos_emitter, 1e-6);
+                    weight = power_heuristic(bsdf_pdf, light_pdf);
+                }
+                RAY_STAT_PATH_LENGTH(bounce + 1);
+                if (bounce == 0) {
+                    first_hit_emission = mat.emission;
+                }
+                return radiance + color * attenuation * mat.emission * weight;
             }
             
             vec3 target;
+            bool diffuse = false;
             
             if (mat.type == 0) {
                 // Lambertian - only apply lighting on first bounce for performance
-                vec3 lighting = (bounce == 0) ? calculate_lighting(rec.point, rec.normal, mat) : ambient_light;
-                target = rec.point + rec.normal + random_unit_vector();
+                vec3 lighting = (bounce == 0) ? calculate_lighting(rec.point, rec.normal, mat, dimension + DIM_LIGHT) : ambient_light;
+                target = rec.point + rec.normal + sample_unit_vector(sample_2d(dimension + DIM_BSDF));
                 attenuation *= mat.albedo * lighting;
+                diffuse = true;
             } else if (mat.type == 1) {
                 // Metal - no lighting calculation needed for reflective surfaces
                 vec3 reflected = reflect(normalize(ray.direction), rec.normal);
-                target = rec.point + reflected + mat.roughness * random_in_unit_sphere();
+                target = rec.point + reflected + mat.roughness * sample_unit_vector(sample_2d(dimension + DIM_BSDF));
                 attenuation *= mat.albedo;
             } else if (mat.type == 2) {
                 // Dielectric - simplified for performance
@@ -646,83 +1008,296 @@ vec3 ray_color(Ray ray, int depth) {
                 attenuation *= vec3(0.95); // Keep dielectric mostly transparent
             } else {
                 // Other materials - simple diffuse
-                target = rec.point + rec.normal + random_unit_vector();
+                target = rec.point + rec.normal + sample_unit_vector(sample_2d(dimension + DIM_BSDF));
                 attenuation *= mat.albedo;
+                diffuse = true;
+            }
+            
+            // A lobe over its limit ends the path here, before next-event estimation, as the
+            // total depth does
+            int lobe = diffuse ? LOBE_DIFFUSE : (mat.type == 1 ? LOBE_SPECULAR : LOBE_TRANSMISSION);
+            lobe_bounces[lobe]++;
+            if (lobe_limits[lobe] > 0 && lobe_bounces[lobe] > lobe_limits[lobe]) {
+                RAY_STAT_PATH_LENGTH(bounce + 1);
+                return radiance;
             }
             
             ray = Ray(rec.point, normalize(target - rec.point));
             
-            // Very aggressive early termination for better performance
-            if (bounce > 0) {
-                float max_component = max(max(attenuation.r, attenuation.g), attenuation.b);
-                if (random() > max_component || max_component < 0.2) {
-                    break;
+            // Sample an emitter directly unless the path ends before it could reach one
+            bsdf_pdf = 0.0;
+            if (diffuse && bounce + 1 < depth && emitters.length() > 0) {
+                radiance += attenuation * sample_emitters(rec.point, rec.normal, dimension);
+                bsdf_pdf = max(dot(rec.normal, ray.direction), 0.0) / 3.14159265359;
+            }
+            
+            // Russian roulette: continue with probability equal to the throughput (at most 1)
+            // and divide by it on survival, so the expected contribution is unchanged
+            if (bounce >= roulette_depth && bounce + 1 < depth) {
+                float survival = min(max(max(attenuation.r, attenuation.g), attenuation.b), 1.0);
+                if (sample_1d(dimension + DIM_ROULETTE) >= survival) {
+                    RAY_STAT_PATH_LENGTH(bounce + 1);
+                    return radiance;
                 }
-                attenuation /= max_component;
+                attenuation /= survival;
             }
         } else {
             // Background
             vec3 unit_direction = normalize(ray.direction);
             float t = 0.5 * (unit_direction.y + 1.0);
             vec3 background = (1.0 - t) * vec3(1.0, 1.0, 1.0) + t * vec3(0.5, 0.7, 1.0);
-            return color * attenuation * background;
+            RAY_STAT_PATH_LENGTH(bounce);
+            if (bounce == 0) {
+                first_hit_emission = background;
+            }
+            return radiance + color * attenuation * background;
         }
     }
     
-    return vec3(0.0);
+    RAY_STAT_PATH_LENGTH(depth);
+    return radiance;
+}
+
+vec3 safe_normalize(vec3 v) {
+    float len = length(v);
+    return len > 0.0 ? v / len : vec3(0.0);
+}
+
+// Bilinear history fetch at the previous frame's view of this pixel's first hit. Each tap must
+// show the same surface (distance from the previous eye within 5%, normals within ~25 degrees);
+// returns false when too little of the footprint passes and the history is dropped.
+bool reproject_history(ivec2 pixel_coords, ivec2 image_size, vec4 normal_depth, out vec4 color, out float moment) {
+    color = vec4(0.0);
+    moment = 0.0;
+    
+    vec2 uv = (vec2(pixel_coords) + 0.5) / vec2(image_size);
+    vec3 direction = normalize(camera.lower_left_corner + uv.x * camera.horizontal + uv.y * camera.vertical - camera.position);
+    vec3 world_point = camera.position + direction * normal_depth.w;
+    vec3 normal = safe_normalize(normal_depth.xyz);
+    
+    // Intersect the line from the previous eye to the point with the previous image plane
+    vec3 to_point = world_point - prev_camera_position;
+    vec3 plane_normal = cross(prev_horizontal, prev_vertical);
+    float denominator = dot(to_point, plane_normal);
+    if (abs(denominator) < 1e-12) {
+        return false;
+    }
+    float t = dot(prev_lower_left_corner - prev_camera_position, plane_normal) / denominator;
+    if (t <= 0.0) {
+        return false;
+    }
+    vec3 on_plane = prev_camera_position + to_point * t - prev_lower_left_corner;
+    vec2 prev_uv = vec2(dot(on_plane, prev_horizontal) / dot(prev_horizontal, prev_horizontal),
+                        dot(on_plane, prev_vertical) / dot(prev_vertical, prev_vertical));
+    vec2 prev_pixel = prev_uv * vec2(history_size) - 0.5;
+    ivec2 base = ivec2(floor(prev_pixel));
+    vec2 f = prev_pixel - vec2(base);
+    float prev_distance = length(to_point);
+    
+    float total_weight = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 tap = base + ivec2(i & 1, i >> 1);
+        if (tap.x < 0 || tap.y < 0 || tap.x >= history_size.x || tap.y >= history_size.y) continue;
+        vec4 tap_normal_depth = texelFetch(history_normal_depth, tap, 0);
+        if (tap_normal_depth.w <= 0.0 || abs(tap_normal_depth.w - prev_distance) > 0.05 * prev_distance) continue;
+        if (dot(safe_normalize(tap_normal_depth.xyz), normal) < 0.9) continue;
+        
+        float weight = ((i & 1) != 0 ? f.x : 1.0 - f.x) * ((i >> 1) != 0 ? f.y : 1.0 - f.y);
+        color += weight * texelFetch(history_color, tap, 0);
+        moment += weight * texelFetch(history_moment, tap, 0).r;
+        total_weight += weight;
+    }
+    if (total_weight < 0.01) {
+        color = vec4(0.0);
+        moment = 0.0;
+        return false;
+    }
+    color /= total_weight;
+    moment /= total_weight;
+    return true;
+}
+
+bool pixel_traced(ivec2 pixel_coords, ivec2 image_size) {
+    if (sparse_pattern == SPARSE_FOVEATED) {
+        vec2 offset = (vec2(pixel_coords) + 0.5 - 0.5 * vec2(image_size)) / float(image_size.y);
+        if (length(offset) > fovea_radius) {
+            // One pixel of each 2x2 quad, visiting the diagonal first so two passes cover a checkerboard
+            const int quad_order[4] = int[](0, 3, 1, 2);
+            return (pixel_coords.x & 1) + 2 * (pixel_coords.y & 1) == quad_order[sparse_phase & 3u];
+        }
+    }
+    if (sparse_pattern != SPARSE_NONE) {
+        return ((pixel_coords.x + pixel_coords.y) & 1) == int(sparse_phase & 1u);
+    }
+    return true;
+}
+
+// A pixel skipped by a sparse pass: on a reprojecting pass a primary ray (no shading) finds its
+// surface so history can still follow the camera; otherwise it is left empty (zero samples).
+// The host only runs sparse passes that start afresh or reproject; any other pass keeps the
+// accumulation but still marks the pixel as a gap, since its output is not from this view.
+void skip_pixel(ivec2 pixel_coords, ivec2 image_size, bool first_pass) {
+    if (!first_pass && !reproject) {
+        imageStore(output_image, pixel_coords, vec4(0.0));
+        return;
+    }
+    
+    vec4 color = vec4(0.0);
+    float moment = 0.0;
+    vec4 normal_depth = vec4(0.0);
+    vec3 albedo = vec3(1.0);
+    vec3 emission = vec3(0.0);
+    if (reproject) {
+        vec2 uv = (vec2(pixel_coords) + 0.5) / vec2(image_size);
+        Ray ray = Ray(camera.position, normalize(camera.lower_left_corner + uv.x * camera.horizontal + uv.y * camera.vertical - camera.position));
+        HitRecord rec;
+        // Without history the G-buffers stay empty too, so neither the denoiser nor the next
+        // reprojection treats the pixel as holding samples
+        if (hit_world(ray, 0.001, 1000000.0, rec) &&
+            reproject_history(pixel_coords, image_size, vec4(rec.normal, rec.t), color, moment)) {
+            Material mat = materials[rec.material_id];
+            color.a = min(color.a, history_limit);
+            normal_depth = vec4(rec.normal, rec.t);
+            if (mat.type != 2 && mat.type != 3) {
+                albedo = mat.albedo;
+            }
+            if (mat.type == 3) {
+                emission = mat.emission;
+            }
+        }
+    }
+    
+    imageStore(accumulation_buffer, pixel_coords, color);
+    imageStore(moment_buffer, pixel_coords, vec4(moment));
+    if (write_gbuffer) {
+        imageStore(gbuffer_normal_depth, pixel_coords, normal_depth);
+        imageStore(gbuffer_albedo, pixel_coords, vec4(albedo, 1.0));
+        imageStore(gbuffer_emission, pixel_coords, vec4(emission, 1.0));
+    }
+    vec3 final_color = pow(color.rgb / (color.rgb + vec3(1.0)), vec3(1.0/2.2));
+    imageStore(output_image, pixel_coords, vec4(final_color, color.a > 0.0 ? 1.0 : 0.0));
 }
 
 void main() {
-    ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy);
-    ivec2 image_size = imageSize(output_image);
+    ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy) + tile_offset;
+    ivec2 image_size = render_size;
     
     if (pixel_coords.x >= image_size.x || pixel_coords.y >= image_size.y) {
         return;
     }
     
+    bool first_pass = reset_accumulation || frame_count == 1;
+    
+    // Converged tiles keep their accumulated result and trace nothing (unless the view moved).
+    // Screen tiles are multiples of 8 pixels, so each workgroup is one whole 8x8 tile.
+    if (adaptive_sampling && !first_pass && !reproject) {
+        uint tile = uint(pixel_coords.y / 8) * uint((image_size.x + 7) / 8) + uint(pixel_coords.x / 8);
+        if (tile_active[tile] == 0u) {
+            return;
+        }
+    }
+    
+    if (!pixel_traced(pixel_coords, image_size)) {
+        skip_pixel(pixel_coords, image_size, first_pass);
+        return;
+    }
+    
     // Initialize RNG with better seeding
     init_random(uvec2(pixel_coords), uint(frame_count));
+    init_sampler(uvec2(pixel_coords));
     
-    vec3 pixel_color = vec3(0.0);
+#ifdef RAY_STATS
+    for (int i = 0; i < RAY_STAT_SLOTS; i++) ray_stat_counts[i] = 0u;
+#endif
     
-    // Adaptive sampling - aggressive reduction for triangle-heavy scenes
-    int adaptive_samples = samples_per_pixel;
-    if (triangles.length() > 200) {
-        adaptive_samples = 1; // Single sample for very heavy scenes
-    } else if (triangles.length() > 100) {
-        adaptive_samples = max(1, samples_per_pixel / 4); // Quarter samples for triangle-heavy scenes
-    } else if (triangles.length() > 50) {
-        adaptive_samples = max(1, samples_per_pixel / 2); // Half samples for moderate triangle scenes
-    }
+    vec3 pixel_color = vec3(0.0);
+    float pixel_moment = 0.0;
+    vec4 pixel_normal_depth = vec4(0.0);
+    vec3 pixel_albedo = vec3(0.0);
+    vec3 pixel_emission = vec3(0.0);
     
     // Use stratified sampling for better coverage
-    for (int s = 0; s < adaptive_samples; s++) {
-        vec2 sample_offset = stratified_sample(s, adaptive_samples);
+    for (int s = 0; s < samples_per_pixel; s++) {
+        sample_index = sample_index_base + uint(s);
+        vec2 sample_offset = (sampler_type == SAMPLER_RANDOM) ? stratified_sample(s, samples_per_pixel) : sample_2d(DIM_PIXEL);
         
         float u = (float(pixel_coords.x) + sample_offset.x) / float(image_size.x);
         float v = (float(pixel_coords.y) + sample_offset.y) / float(image_size.y);
         
+        // Thin lens: rays start on the aperture disk and converge on the focus plane
         vec3 ray_origin = camera.position;
-        vec3 ray_direction = camera.lower_left_corner + u * camera.horizontal + v * camera.vertical - camera.position;
+        if (camera.lens_radius > 0.0) {
+            vec2 lens = sample_2d(DIM_LENS);
+            float radius = camera.lens_radius * sqrt(lens.x);
+            float theta = 2.0 * 3.14159265359 * lens.y;
+            ray_origin += camera.u * (radius * cos(theta)) + camera.v * (radius * sin(theta));
+        }
+        vec3 ray_direction = camera.lower_left_corner + u * camera.horizontal + v * camera.vertical - ray_origin;
         
         Ray ray = Ray(ray_origin, normalize(ray_direction));
-        pixel_color += ray_color(ray, max_depth);
+        vec3 sample_color = ray_color(ray, max_depth);
+        pixel_color += sample_color;
+        float sample_luminance = luminance(sample_color);
+        pixel_moment += sample_luminance * sample_luminance;
+        pixel_normal_depth += vec4(first_hit_normal, first_hit_depth);
+        pixel_albedo += first_hit_albedo;
+        pixel_emission += first_hit_emission;
     }
     
-    pixel_color /= float(adaptive_samples);
+    pixel_color /= float(samples_per_pixel);
+    pixel_moment /= float(samples_per_pixel);
+    pixel_normal_depth /= float(samples_per_pixel);
+    pixel_albedo /= float(samples_per_pixel);
+    pixel_emission /= float(samples_per_pixel);
     
-    // Temporal accumulation for interactive mode
-    vec3 accumulated_color;
-    if (reset_accumulation || frame_count == 1) {
-        accumulated_color = pixel_color;
-    } else {
+#ifdef RAY_STATS
+    for (int i = 0; i < RAY_STAT_SLOTS; i++) ray_stat_flush(i, ray_stat_counts[i]);
+#endif
+    
+    // Temporal accumulation for interactive mode, weighted by per-pixel sample counts since
+    // pixels in converged tiles stop receiving passes
+    bool track_moments = adaptive_sampling || write_gbuffer;
+    vec3 accumulated_color = pixel_color;
+    float accumulated_moment = pixel_moment;
+    vec4 accumulated_normal_depth = pixel_normal_depth;
+    vec3 accumulated_albedo = pixel_albedo;
+    vec3 accumulated_emission = pixel_emission;
+    float sample_count = float(samples_per_pixel);
+    if (reproject) {
+        // G-buffers describe the new view, so only color and moments carry over
+        vec4 reprojected_color;
+        float reprojected_moment;
+        if (pixel_normal_depth.w > 0.0 && reproject_history(pixel_coords, image_size, pixel_normal_depth, reprojected_color, reprojected_moment)) {
+            sample_count += min(reprojected_color.a, history_limit);
+            float weight = float(samples_per_pixel) / sample_count;
+            accumulated_color = mix(reprojected_color.rgb, pixel_color, weight);
+            accumulated_moment = mix(reprojected_moment, pixel_moment, weight);
+        }
+    } else if (!first_pass) {
         vec4 prev_color = imageLoad(accumulation_buffer, pixel_coords);
-        float weight = 1.0 / float(frame_count);
+        sample_count += prev_color.a;
+        float weight = float(samples_per_pixel) / sample_count;
         accumulated_color = mix(prev_color.rgb, pixel_color, weight);
+        if (track_moments) {
+            accumulated_moment = mix(imageLoad(moment_buffer, pixel_coords).r, pixel_moment, weight);
+        }
+        if (write_gbuffer) {
+            accumulated_normal_depth = mix(imageLoad(gbuffer_normal_depth, pixel_coords), pixel_normal_depth, weight);
+            accumulated_albedo = mix(imageLoad(gbuffer_albedo, pixel_coords).rgb, pixel_albedo, weight);
+            accumulated_emission = mix(imageLoad(gbuffer_emission, pixel_coords).rgb, pixel_emission, weight);
+        }
     }
     
     // Store accumulated color
-    imageStore(accumulation_buffer, pixel_coords, vec4(accumulated_color, 1.0));
+    imageStore(accumulation_buffer, pixel_coords, vec4(accumulated_color, sample_count));
+    if (track_moments) {
+        imageStore(moment_buffer, pixel_coords, vec4(accumulated_moment));
+    }
+    if (write_gbuffer) {
+        imageStore(gbuffer_normal_depth, pixel_coords, accumulated_normal_depth);
+        imageStore(gbuffer_albedo, pixel_coords, vec4(accumulated_albedo, 1.0));
+        imageStore(gbuffer_emission, pixel_coords, vec4(accumulated_emission, 1.0));
+    }
     
     // Apply tone mapping and gamma correction
     vec3 final_color = accumulated_color;
@@ -738,6 +1313,209 @@ void main() {
 )";
 }
 
+const char* Shader::get_adaptive_sampling_compute_shader() {
+    return R"(
+#version 430
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Runs after each batch of screen tiles over the 8x8 tiles the ray tracing shader just traced
+layout(rgba32f, binding = 1) uniform readonly image2D accumulation_buffer;
+layout(r32f, binding = 2) uniform readonly image2D moment_buffer;
+
+layout(std430, binding = 12) buffer TileStateBuffer {
+    uint tile_active[];
+};
+
+layout(std430, binding = 13) buffer TileCounterBuffer {
+    uint active_tiles;
+};
+
+uniform float error_threshold;
+uniform float min_samples;
+uniform ivec2 render_size;  // Traced bottom-left part of the images
+uniform ivec2 tile_offset;  // Pixel origin of the screen tile this dispatch covers
+
+shared float tile_error[64];
+
+void main() {
+    ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy) + tile_offset;
+    ivec2 image_size = render_size;
+    uint local_index = gl_LocalInvocationIndex;
+    
+    float error = 0.0;
+    if (pixel_coords.x < image_size.x && pixel_coords.y < image_size.y) {
+        vec4 accumulated = imageLoad(accumulation_buffer, pixel_coords);
+        float n = accumulated.a;
+        if (n < min_samples) {
+            error = 1e30;
+        } else {
+            float mean = dot(accumulated.rgb, vec3(0.2126, 0.7152, 0.0722));
+            float second_moment = imageLoad(moment_buffer, pixel_coords).r;
+            float variance = max(second_moment - mean * mean, 0.0) * n / (n - 1.0);
+            // Standard error of the pixel mean, scaled by the slope of the x / (1 + x) tone map
+            // so bright pixels are not held back by noise the display compresses away
+            float slope = 1.0 / ((1.0 + mean) * (1.0 + mean));
+            error = sqrt(variance / n) * slope;
+        }
+    }
+    
+    // The tile is as noisy as its worst pixel
+    tile_error[local_index] = error;
+    barrier();
+    for (uint stride = 32u; stride > 0u; stride >>= 1u) {
+        if (local_index < stride) {
+            tile_error[local_index] = max(tile_error[local_index], tile_error[local_index + stride]);
+        }
+        barrier();
+    }
+    
+    if (local_index == 0u) {
+        // Same indexing as the ray tracing shader
+        uint tile = uint(pixel_coords.y / 8) * uint((image_size.x + 7) / 8) + uint(pixel_coords.x / 8);
+        bool noisy = tile_error[0] > error_threshold;
+        tile_active[tile] = noisy ? 1u : 0u;
+        if (noisy) {
+            atomicAdd(active_tiles, 1u);
+        }
+    }
+}
+)";
+}
+
+const char* Shader::get_denoise_compute_shader() {
+    return R"(
+#version 430
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// One à-trous iteration of the SVGF filter (see denoiser.h, whose CPU version matches this).
+// GPURayTracer::render runs Denoise::Settings::iterations of them with step sizes 1, 2, 4, ...
+// ping-ponging between two filter images.
+layout(rgba32f, binding = 0) uniform writeonly image2D output_image;
+layout(rgba32f, binding = 1) uniform readonly image2D accumulation_buffer;
+layout(r32f, binding = 2) uniform readonly image2D moment_buffer;
+layout(rgba32f, binding = 3) uniform readonly image2D gbuffer_normal_depth;
+layout(rgba32f, binding = 4) uniform readonly image2D gbuffer_albedo;
+layout(rgba32f, binding = 5) uniform readonly image2D gbuffer_emission;
+layout(rgba32f, binding = 6) uniform readonly image2D filter_input;    // Illumination (rgb) and its variance (a)
+layout(rgba32f, binding = 7) uniform writeonly image2D filter_output;
+
+uniform int step_size;
+uniform bool first_iteration;  // Demodulate the accumulation buffer instead of reading filter_input
+uniform bool last_iteration;   // Remodulate, tone map and write output_image
+uniform float sigma_luminance;
+uniform float sigma_normal;
+uniform float sigma_depth;
+uniform ivec2 render_size;  // Traced bottom-left part of the images; taps never leave it
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 demodulation_albedo(ivec2 p) {
+    return max(imageLoad(gbuffer_albedo, p).rgb, vec3(0.01));
+}
+
+vec4 load_input(ivec2 p) {
+    if (!first_iteration) {
+        return imageLoad(filter_input, p);
+    }
+    vec4 accumulated = imageLoad(accumulation_buffer, p);
+    vec3 albedo = demodulation_albedo(p);
+    float albedo_luminance = luminance(albedo);
+    // Variance of the accumulated mean, from the luminance moments and the sample count
+    float mean = luminance(accumulated.rgb);
+    float variance = max(imageLoad(moment_buffer, p).r - mean * mean, 0.0) / max(accumulated.a - 1.0, 1.0);
+    vec3 illumination = max(accumulated.rgb - imageLoad(gbuffer_emission, p).rgb, vec3(0.0)) / albedo;
+    return vec4(illumination, variance / (albedo_luminance * albedo_luminance));
+}
+
+float load_depth(ivec2 p, ivec2 image_size, float fallback) {
+    bool inside = p.x >= 0 && p.y >= 0 && p.x < image_size.x && p.y < image_size.y;
+    return inside ? imageLoad(gbuffer_normal_depth, p).w : fallback;
+}
+
+vec3 safe_normalize(vec3 v) {
+    float len = length(v);
+    return len > 0.0 ? v / len : vec3(0.0);
+}
+
+void main() {
+    ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 image_size = render_size;
+    if (pixel_coords.x >= image_size.x || pixel_coords.y >= image_size.y) {
+        return;
+    }
+    
+    vec4 center = load_input(pixel_coords);
+    vec4 normal_depth = imageLoad(gbuffer_normal_depth, pixel_coords);
+    float depth = normal_depth.w;
+    vec4 result = center;
+    
+    if (depth > 0.0) {
+        // Smallest one-sided difference per axis, so silhouettes do not inflate it
+        float gradient_x = min(abs(load_depth(pixel_coords + ivec2(1, 0), image_size, depth) - depth),
+                               abs(depth - load_depth(pixel_coords - ivec2(1, 0), image_size, depth)));
+        float gradient_y = min(abs(load_depth(pixel_coords + ivec2(0, 1), image_size, depth) - depth),
+                               abs(depth - load_depth(pixel_coords - ivec2(0, 1), image_size, depth)));
+        float depth_gradient = max(gradient_x, gradient_y);
+        
+        // 3x3 Gaussian of the variance steers the luminance edge stop
+        float variance = 0.0;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                ivec2 q = clamp(pixel_coords + ivec2(dx, dy), ivec2(0), image_size - 1);
+                float weight = (dx == 0 ? 0.5 : 0.25) * (dy == 0 ? 0.5 : 0.25);
+                variance += weight * load_input(q).a;
+            }
+        }
+        
+        float center_luminance = luminance(center.rgb);
+        float luminance_scale = sigma_luminance * sqrt(max(variance, 0.0)) + 1e-4;
+        vec3 normal = safe_normalize(normal_depth.xyz);
+        
+        const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+        float center_weight = kernel[0] * kernel[0];
+        vec3 sum = center.rgb * center_weight;
+        float sum_variance = center_weight * center_weight * center.a;
+        float sum_weight = center_weight;
+        for (int dy = -2; dy <= 2; dy++) {
+            for (int dx = -2; dx <= 2; dx++) {
+                ivec2 q = pixel_coords + ivec2(dx, dy) * step_size;
+                bool inside = q.x >= 0 && q.y >= 0 && q.x < image_size.x && q.y < image_size.y;
+                if ((dx == 0 && dy == 0) || !inside) continue;
+                vec4 sample_normal_depth = imageLoad(gbuffer_normal_depth, q);
+                if (sample_normal_depth.w <= 0.0) continue;
+                
+                vec4 sample_value = load_input(q);
+                float distance = float(step_size) * length(vec2(dx, dy));
+                float w_normal = pow(max(dot(normal, safe_normalize(sample_normal_depth.xyz)), 0.0), sigma_normal);
+                float w_depth = exp(-abs(depth - sample_normal_depth.w) / (sigma_depth * depth_gradient * distance + 1e-3));
+                float w_luminance = exp(-abs(center_luminance - luminance(sample_value.rgb)) / luminance_scale);
+                float weight = kernel[abs(dx)] * kernel[abs(dy)] * w_normal * w_depth * w_luminance;
+                
+                sum += sample_value.rgb * weight;
+                sum_variance += weight * weight * sample_value.a;
+                sum_weight += weight;
+            }
+        }
+        result = vec4(sum / sum_weight, sum_variance / (sum_weight * sum_weight));
+    }
+    
+    if (last_iteration) {
+        // Same tone mapping and gamma as the ray tracing shader's output
+        vec3 final_color = result.rgb * demodulation_albedo(pixel_coords) + imageLoad(gbuffer_emission, pixel_coords).rgb;
+        final_color = final_color / (final_color + vec3(1.0));
+        final_color = pow(final_color, vec3(1.0/2.2));
+        // Pixels a sparse pass left empty stay marked for the display pass
+        float coverage = imageLoad(accumulation_buffer, pixel_coords).a > 0.0 ? 1.0 : 0.0;
+        imageStore(output_image, pixel_coords, vec4(final_color, coverage));
+    } else {
+        imageStore(filter_output, pixel_coords, result);
+    }
+}
+)";
+}
+
 const char* Shader::get_display_vertex_shader() {
     return R"(
 #version 330 core
@@ -760,9 +1538,85 @@ out vec4 FragColor;
 
 in vec2 TexCoord;
 uniform sampler2D raytraced_texture;
+uniform bool upscale;       // The render size is smaller than the window (dynamic resolution)
+uniform vec2 source_size;   // Render size: the bottom-left part of the texture that was traced
+uniform vec2 texture_size;  // Allocated texture size
+uniform bool fill_gaps;    // A sparse pass left pixels empty, marked with alpha 0
+
+// Catmull-Rom bicubic from nine bilinear fetches: the middle two of each axis's four weights
+// are merged into one fetch between texels. Sharper than plain bilinear magnification.
+vec3 sample_catmull_rom(vec2 uv) {
+    vec2 position = uv * source_size;
+    vec2 center = floor(position - 0.5) + 0.5;
+    vec2 f = position - center;
+    
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    
+    // Texels past the render size are stale, so fetches are clamped to its edge texel centres
+    vec2 uv0 = clamp(center - 1.0, vec2(0.5), source_size - 0.5) / texture_size;
+    vec2 uv12 = clamp(center + w2 / w12, vec2(0.5), source_size - 0.5) / texture_size;
+    vec2 uv3 = clamp(center + 2.0, vec2(0.5), source_size - 0.5) / texture_size;
+    
+    vec3 color = texture(raytraced_texture, vec2(uv0.x, uv0.y)).rgb * w0.x * w0.y
+               + texture(raytraced_texture, vec2(uv12.x, uv0.y)).rgb * w12.x * w0.y
+               + texture(raytraced_texture, vec2(uv3.x, uv0.y)).rgb * w3.x * w0.y
+               + texture(raytraced_texture, vec2(uv0.x, uv12.y)).rgb * w0.x * w12.y
+               + texture(raytraced_texture, vec2(uv12.x, uv12.y)).rgb * w12.x * w12.y
+               + texture(raytraced_texture, vec2(uv3.x, uv12.y)).rgb * w3.x * w12.y
+               + texture(raytraced_texture, vec2(uv0.x, uv3.y)).rgb * w0.x * w3.y
+               + texture(raytraced_texture, vec2(uv12.x, uv3.y)).rgb * w12.x * w3.y
+               + texture(raytraced_texture, vec2(uv3.x, uv3.y)).rgb * w3.x * w3.y;
+    // The negative lobes can ring past the tone-mapped range at hard edges
+    return clamp(color, 0.0, 1.0);
+}
+
+// An empty pixel takes the mean of its traced 3x3 neighbours, edge neighbours counting double.
+// A checkerboard pass leaves all four edge neighbours traced, a quad pass at least one neighbour.
+vec3 filled_texel(ivec2 p) {
+    vec4 texel = texelFetch(raytraced_texture, p, 0);
+    if (texel.a > 0.0) {
+        return texel.rgb;
+    }
+    ivec2 last = ivec2(source_size) - 1;
+    vec3 sum = vec3(0.0);
+    float total_weight = 0.0;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            vec4 neighbour = texelFetch(raytraced_texture, clamp(p + ivec2(dx, dy), ivec2(0), last), 0);
+            float weight = (dx == 0 || dy == 0) ? 1.0 : 0.5;
+            if (neighbour.a > 0.0) {
+                sum += neighbour.rgb * weight;
+                total_weight += weight;
+            }
+        }
+    }
+    return total_weight > 0.0 ? sum / total_weight : vec3(0.0);
+}
+
+// Bilinear filtering over filled texels, since the hardware filter would blend in the empty ones
+vec3 sample_filled(vec2 uv) {
+    vec2 position = uv * source_size - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    ivec2 last = ivec2(source_size) - 1;
+    vec3 bottom = mix(filled_texel(clamp(base, ivec2(0), last)),
+                      filled_texel(clamp(base + ivec2(1, 0), ivec2(0), last)), f.x);
+    vec3 top = mix(filled_texel(clamp(base + ivec2(0, 1), ivec2(0), last)),
+                   filled_texel(clamp(base + ivec2(1, 1), ivec2(0), last)), f.x);
+    return mix(bottom, top, f.y);
+}
 
 void main() {
-    vec3 color = texture(raytraced_texture, TexCoord).rgb;
+    vec3 color;
+    if (fill_gaps) {
+        color = sample_filled(TexCoord);
+    } else {
+        color = upscale ? sample_catmull_rom(TexCoord) : texture(raytraced_texture, TexCoord * source_size / texture_size).rgb;
+    }
     FragColor = vec4(color, 1.0);
 }
 )";
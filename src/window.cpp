@@ -5,6 +5,7 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <string>
+#include <algorithm>
 
 Window::Window(int w, int h, const std::string& t) 
     : window(nullptr), width(w), height(h), title(t),
@@ -104,7 +105,11 @@ bool Window::initialize() {
             window_ptr->width = width;
             window_ptr->height = height;
             glViewport(0, 0, width, height);
-            window_ptr->gpu_raytracer->resize(width, height);
+            // Images are allocated at the window size; scale steps only change the traced part
+            if (width > 0 && height > 0) {
+                window_ptr->gpu_raytracer->resize(width, height);
+            }
+            window_ptr->apply_render_scale(window_ptr->frame_budget ? window_ptr->frame_budget->scale() : 1.0f);
             if (window_ptr->resize_callback) {
                 window_ptr->resize_callback(width, height);
             }
@@ -224,6 +229,25 @@ void Window::load_scene(const Scene& scene) {
     }
 }
 
+void Window::set_frame_budget(float target_ms) {
+    if (target_ms > 0.0f) {
+        FrameBudget::Settings settings;
+        settings.target_ms = target_ms;
+        frame_budget = std::make_unique<FrameBudget>(settings);
+    } else {
+        frame_budget.reset();
+    }
+    if (gpu_raytracer && window) {
+        apply_render_scale(1.0f);
+    }
+}
+
+void Window::apply_render_scale(float scale) {
+    const int render_width = std::max(1, static_cast<int>(width * scale + 0.5f));
+    const int render_height = std::max(1, static_cast<int>(height * scale + 0.5f));
+    gpu_raytracer->set_render_size(render_width, render_height);
+}
+
 void Window::render_frame(const Camera& camera, int samples, int max_depth) {
     // Check for OpenGL errors before rendering
     GLenum error = glGetError();
@@ -232,8 +256,21 @@ void Window::render_frame(const Camera& camera, int samples, int max_depth) {
         return;
     }
     
+    // Pick this frame's resolution and samples from the latest GPU timings (a frame or two old)
+    frame_samples = samples;
+    if (frame_budget) {
+        double gpu_ms = gpu_raytracer->gpu_last_ms(GPUStage::Dispatch) + gpu_raytracer->gpu_last_ms(GPUStage::Display);
+        if (gpu_raytracer->get_denoise()) {
+            gpu_ms += gpu_raytracer->gpu_last_ms(GPUStage::Denoise);
+        }
+        frame_budget->update(gpu_ms, camera_moving, samples);
+        apply_render_scale(frame_budget->scale());
+        frame_samples = frame_budget->samples();
+    }
+    camera_moving = false;
+    
     // Render with GPU raytracer
-    gpu_raytracer->render(camera, samples, max_depth);
+    gpu_raytracer->render(camera, frame_samples, max_depth);
     
     // Check for errors after GPU raytracer
     error = glGetError();
@@ -249,9 +286,18 @@ void Window::render_frame(const Camera& camera, int samples, int max_depth) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gpu_raytracer->get_output_texture());
     glUniform1i(glGetUniformLocation(display_shader_program, "raytraced_texture"), 0);
+    glUniform1i(glGetUniformLocation(display_shader_program, "upscale"),
+                gpu_raytracer->get_width() != width || gpu_raytracer->get_height() != height ? 1 : 0);
+    glUniform2f(glGetUniformLocation(display_shader_program, "source_size"),
+                static_cast<float>(gpu_raytracer->get_width()), static_cast<float>(gpu_raytracer->get_height()));
+    glUniform2f(glGetUniformLocation(display_shader_program, "texture_size"),
+                static_cast<float>(gpu_raytracer->get_texture_width()), static_cast<float>(gpu_raytracer->get_texture_height()));
+    glUniform1i(glGetUniformLocation(display_shader_program, "fill_gaps"), gpu_raytracer->last_pass_sparse() ? 1 : 0);
     
     glBindVertexArray(quad_vao);
+    gpu_raytracer->begin_gpu_timer(GPUStage::Display);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpu_raytracer->end_gpu_timer(GPUStage::Display);
     
     // Check for errors after display rendering
     error = glGetError();
@@ -315,8 +361,29 @@ void Window::update_fps_display(float fps, float frame_time) {
     std::string fps_title;
     if (show_detailed_stats) {
         // Detailed mode: show FPS, frame time, and additional info
-        fps_title = title + " - FPS: " + fps_buffer + " | Frame: " + time_buffer + "ms" +
-                   " | GPU RT | " + std::to_string(width) + "x" + std::to_string(height);
+        // GPU times come from timer queries, so they show execution rather than submission cost
+        char gpu_buffer[160] = "";
+        if (gpu_raytracer) {
+            snprintf(gpu_buffer, sizeof(gpu_buffer), " | GPU trace %.2fms, denoise %.2fms, display %.2fms, readback %.2fms",
+                     gpu_raytracer->gpu_time_ms(GPUStage::Dispatch),
+                     gpu_raytracer->get_denoise() ? gpu_raytracer->gpu_time_ms(GPUStage::Denoise) : 0.0,
+                     gpu_raytracer->gpu_time_ms(GPUStage::Display),
+                     gpu_raytracer->gpu_time_ms(GPUStage::Readback));
+        }
+        char rays_buffer[64] = "";
+        if (mrays_per_second >= 0.0) {
+            snprintf(rays_buffer, sizeof(rays_buffer), " | %.1f Mrays/s", mrays_per_second);
+        }
+        std::string resolution = std::to_string(width) + "x" + std::to_string(height);
+        if (gpu_raytracer && (gpu_raytracer->get_width() != width || gpu_raytracer->get_height() != height)) {
+            resolution += " (rendering " + std::to_string(gpu_raytracer->get_width()) + "x" +
+                          std::to_string(gpu_raytracer->get_height()) + ")";
+        }
+        if (frame_budget) {
+            resolution += ", " + std::to_string(frame_samples) + " spp";
+        }
+        fps_title = title + " - FPS: " + fps_buffer + " | Frame: " + time_buffer + "ms" + gpu_buffer + rays_buffer +
+                   " | " + resolution;
     } else {
         // Simple mode: just FPS and frame time
         fps_title = title + " - FPS: " + fps_buffer + " | " + time_buffer + "ms";
@@ -325,56 +392,39 @@ void Window::update_fps_display(float fps, float frame_time) {
     glfwSetWindowTitle(window, fps_title.c_str());
 }
 
+double Window::update_ray_stats(double interval_seconds) {
+    RayStats::Snapshot stats;
+    if (!gpu_raytracer || interval_seconds <= 0.0 || !gpu_raytracer->read_ray_stats(stats)) {
+        mrays_per_second = -1.0;
+        return mrays_per_second;
+    }
+    mrays_per_second = stats[RayStats::RayCasts] / interval_seconds / 1e6;
+    return mrays_per_second;
+}
+
 void Window::capture_frame(const std::string& filename) {
     if (!window) return;
     
-    // Create an Image object to store the framebuffer data
-    Image image(width, height);
-    
-    // Allocate buffer for reading pixels
-    std::vector<unsigned char> pixels(width * height * 3);
-    
-    // Read pixels from the front buffer
-    glReadBuffer(GL_FRONT);
-    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-    
-    // Check for OpenGL errors
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        ErrorHandling::Logger::error("OpenGL error during frame capture: " + std::to_string(error));
+    // Read the linear float accumulation buffer rather than the tone-mapped 8-bit framebuffer
+    // At the ray tracer's resolution, which is lower than the window's while dynamic resolution scales it down
+    if (!gpu_raytracer) return;
+    Image image(gpu_raytracer->get_width(), gpu_raytracer->get_height());
+    if (!gpu_raytracer->read_latest_accumulation(image)) {
+        ErrorHandling::Logger::error("Failed to read back frame for capture");
         return;
     }
     
-    // Convert from OpenGL format (bottom-left origin) to image format (top-left origin)
-    // and from unsigned char [0,255] to float [0,1]
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int gl_y = height - 1 - y;  // Flip Y axis
-            int pixel_index = (gl_y * width + x) * 3;
-            
-            float r = pixels[pixel_index] / 255.0f;
-            float g = pixels[pixel_index + 1] / 255.0f;
-            float b = pixels[pixel_index + 2] / 255.0f;
-            
-            image.set_pixel(x, y, Color(r, g, b));
-        }
-    }
-    
-    // Save the image
-    // Always save as PPM format
+    // Save the image, defaulting to PPM when the extension is not a supported format
     std::string actual_filename = filename;
-    if (filename.find('.') == std::string::npos) {
-        actual_filename += ".ppm";
-    } else {
-        // Change extension to .ppm
-        size_t dot_pos = filename.find_last_of('.');
-        if (dot_pos != std::string::npos) {
-            actual_filename = filename.substr(0, dot_pos) + ".ppm";
-        } else {
-            actual_filename = filename + ".ppm";
-        }
+    size_t dot_pos = filename.find_last_of('.');
+    std::string extension = dot_pos != std::string::npos ? filename.substr(dot_pos + 1) : "";
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (!Image::is_supported_extension(extension)) {
+        actual_filename = filename + ".ppm";
     }
     
-    image.save_ppm(actual_filename);
+    if (!image.save(actual_filename)) {
+        return;
+    }
     std::cout << "\n[Frame saved as: " << actual_filename << "]" << std::endl;
 }